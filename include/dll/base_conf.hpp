@@ -58,6 +58,9 @@ struct concatenate_id;
 struct init_weights_id;
 struct weight_type_id;
 struct free_energy_id;
+struct pcd_chains_id;
+struct packed_states_id;
+struct sparse_input_id;
 
 template<std::size_t B>
 struct batch_size : value_conf_elt<batch_size_id, std::size_t, B> {};
@@ -86,6 +89,12 @@ struct sparsity : value_conf_elt<sparsity_id, sparsity_method, M> {};
 template<bias_mode M = bias_mode::SIMPLE>
 struct bias : value_conf_elt<bias_id, bias_mode, M>{};
 
+/*!
+ * \brief Set the number of persistent chains used by PCD (0 for one chain per sample of the batch)
+ */
+template<std::size_t C>
+struct pcd_chains : value_conf_elt<pcd_chains_id, std::size_t, C> {};
+
 template<typename T>
 struct weight_type : type_conf_elt<weight_type_id, T> {};
 
@@ -102,6 +111,16 @@ struct init_weights : basic_conf_elt<init_weights_id> {};
 struct shuffle : basic_conf_elt<shuffle_id> {};
 struct free_energy : basic_conf_elt<free_energy_id> {};
 
+/*!
+ * \brief Pack the binary states in 64-bit words for the products with the weights
+ */
+struct packed_states : basic_conf_elt<packed_states_id> {};
+
+/*!
+ * \brief Use the sparse products for the mostly-zero visible inputs
+ */
+struct sparse_input : basic_conf_elt<sparse_input_id> {};
+
 } //end of dll namespace
 
 #endif
@@ -0,0 +1,147 @@
+//=======================================================================
+// Copyright (c) 2014 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file Bit-packed binary states
+ *
+ * The states of binary units are packed in 64-bit words. The products with
+ * the weights are then computed by accumulating the weights of the active
+ * units only, without any multiplication.
+ */
+
+#ifndef DLL_BIT_STATES_HPP
+#define DLL_BIT_STATES_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "etl/etl.hpp"
+
+namespace dll {
+
+/*!
+ * \brief A vector of binary states, packed in 64-bit words
+ */
+struct bit_states {
+    static constexpr const std::size_t bits = 64;
+
+    std::vector<std::uint64_t> words;
+    std::size_t n = 0;
+
+    /*!
+     * \brief Pack the given states.
+     *
+     * \return false if one of the values is neither 0 nor 1, in which case
+     * the packed states are not usable
+     */
+    template<typename S>
+    bool pack(const S& s){
+        n = etl::size(s);
+        words.resize((n + bits - 1) / bits);
+
+        for(std::size_t w = 0; w < words.size(); ++w){
+            std::uint64_t word = 0;
+
+            const std::size_t last = std::min(n, (w + 1) * bits);
+
+            for(std::size_t i = w * bits; i < last; ++i){
+                const auto value = s[i];
+
+                if(value == 1.0){
+                    word |= std::uint64_t(1) << (i - w * bits);
+                } else if(value != 0.0){
+                    return false;
+                }
+            }
+
+            words[w] = word;
+        }
+
+        return true;
+    }
+
+    /*!
+     * \brief Call fun(i) for the index of each active unit, in order
+     */
+    template<typename Functor>
+    void for_each_set(Functor&& fun) const {
+        for(std::size_t w = 0; w < words.size(); ++w){
+            auto word = words[w];
+
+            while(word){
+                fun(w * bits + __builtin_ctzll(word));
+                word &= word - 1;
+            }
+        }
+    }
+};
+
+/*!
+ * \brief Indicates if all the values of s are either 0 or 1, i.e. if s
+ * can be packed
+ */
+template<typename S>
+bool is_binary(const S& s){
+    for(std::size_t i = 0; i < etl::size(s); ++i){
+        if(s[i] != 0.0 && s[i] != 1.0){
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*!
+ * \brief Return the packed states buffer of the current thread
+ */
+inline bit_states& thread_bit_states(){
+    thread_local bit_states states;
+    return states;
+}
+
+/*!
+ * \brief Compute t = v * w where v contains packed binary states, by
+ * summing the rows of w of the active units
+ */
+template<typename W, typename T>
+void packed_vmmul(const bit_states& v, const W& w, T&& t){
+    const std::size_t columns = etl::columns(w);
+
+    for(std::size_t j = 0; j < columns; ++j){
+        t[j] = 0.0;
+    }
+
+    v.for_each_set([&w, &t, columns](std::size_t i){
+        for(std::size_t j = 0; j < columns; ++j){
+            t[j] += w(i, j);
+        }
+    });
+}
+
+/*!
+ * \brief Compute t = w * h where h contains packed binary states, by
+ * summing, for each row of w, the weights of the active units
+ */
+template<typename W, typename T>
+void packed_mvmul(const W& w, const bit_states& h, T&& t){
+    using weight = typename std::decay_t<W>::value_type;
+
+    for(std::size_t i = 0; i < etl::rows(w); ++i){
+        weight sum = 0.0;
+
+        h.for_each_set([&w, &sum, i](std::size_t j){
+            sum += w(i, j);
+        });
+
+        t[i] = sum;
+    }
+}
+
+} //end of dll namespace
+
+#endif
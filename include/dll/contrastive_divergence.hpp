@@ -17,6 +17,11 @@
 #ifndef DLL_CONTRASTIVE_DIVERGENCE_HPP
 #define DLL_CONTRASTIVE_DIVERGENCE_HPP
 
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
 #include "cpp_utils/assert.hpp"             //Assertions
 
 #include "etl/etl.hpp"
@@ -26,6 +31,7 @@
 #include "decay_type.hpp"
 #include "rbm_traits.hpp"
 #include "parallel.hpp"
+#include "random.hpp"
 
 namespace dll {
 
@@ -38,65 +44,337 @@ struct base_trainer {
 
     bool init = false;
 
-    template<typename T1, typename T2, bool M = rbm_traits<rbm_t>::has_momentum(), cpp::enable_if_u<M> = cpp::detail::dummy>
-    T2& get_fgrad(T1& , T2& inc){
-        return inc;
+    //The parameters used for the negative phase of the gradients
+    //By default, these are the parameters of the RBM
+
+    static const auto& negative_w(const rbm_t& rbm){
+        return rbm.w;
     }
 
-    template<typename T1, typename T2, bool M = rbm_traits<rbm_t>::has_momentum(), cpp::disable_if_u<M> = cpp::detail::dummy>
-    T1& get_fgrad(T1& grad, T2& ){
-        return grad;
+    static const auto& negative_b(const rbm_t& rbm){
+        return rbm.b;
     }
 
-    template<typename V, typename G>
-    void update_grad(G& grad, const V& value, const RBM& rbm, decay_type decay, double penalty){
-        if(decay == decay_type::L1){
-            grad = grad - rbm.l1_weight_cost * abs(value) - penalty;
-        } else if(decay == decay_type::L2){
-            grad = grad - rbm.l2_weight_cost * value - penalty;
-        } else if(decay == decay_type::L1L2){
-            grad = grad - rbm.l1_weight_cost * abs(value) - rbm.l2_weight_cost * value - penalty;
-        } else {
-            grad = grad - penalty;
-        }
+    static const auto& negative_c(const rbm_t& rbm){
+        return rbm.c;
     }
 };
 
-/* Some utilities */
+/*!
+ * \brief State of a chunk of a batch of the parallel CD training.
+ *
+ * Each chunk is a contiguous range of samples of the batch. The worker
+ * running the chunk runs the Gibbs chain on all its samples with batched
+ * activations and accumulates their (unnormalized) gradients and
+ * statistics in the accumulator of the chunk.
+ */
+template<typename RBM>
+struct cd_chunk_context {
+    using rbm_t = RBM;
+    using weight = typename rbm_t::weight;
 
-template<typename RBM, typename C, cpp::enable_if_u<rbm_traits<RBM>::is_dynamic()> = cpp::detail::dummy>
-auto reshape_nv1(RBM& rbm, C&& container){
-    return etl::reshape(container, rbm.num_visible, 1);
-}
+    std::size_t rows;      //Number of rows of the buffers
+    std::size_t first = 0; //Index of the first sample of the chunk
+    std::size_t n = 0;     //Number of samples of the chunk
 
-template<typename RBM, typename C, cpp::disable_if_u<rbm_traits<RBM>::is_dynamic()> = cpp::detail::dummy>
-auto reshape_nv1(RBM&, C&& container){
-    return etl::reshape<RBM::num_visible, 1>(container);
-}
+    etl::dyn_matrix<weight> v1;
+    etl::dyn_matrix<weight> vf;
+
+    etl::dyn_matrix<weight> h1_a;
+    etl::dyn_matrix<weight> h1_s;
+
+    etl::dyn_matrix<weight> v2_a;
+    etl::dyn_matrix<weight> v2_s;
+
+    etl::dyn_matrix<weight> h2_a;
+    etl::dyn_matrix<weight> h2_s;
+
+    etl::dyn_matrix<weight> ht;
+    etl::dyn_matrix<weight> vt;
+
+    //Stacked [vf; v2_a] and [h1_a; -h2_a] to compute the weight gradients with one GEMM
+    etl::dyn_matrix<weight> v_stack;
+    etl::dyn_matrix<weight> h_stack;
+
+    //Accumulator of the chunk
+    etl::dyn_matrix<weight> w_grad;
+    etl::dyn_vector<weight> b_grad;
+    etl::dyn_vector<weight> c_grad;
+    etl::dyn_vector<weight> q_local;
+
+    weight reconstruction_error = 0.0;
+    weight q_global = 0.0;
+
+    //The buffers have the rows of the largest chunk, the missing samples
+    //of a smaller chunk are zero rows
+    //The sample buffers are not allocated when the chain runs on probabilities only
+    cd_chunk_context(const rbm_t& rbm, std::size_t rows, bool sampling) :
+            rows(rows),
+            v1(rows, num_visible(rbm)), vf(rows, num_visible(rbm)),
+            h1_a(rows, num_hidden(rbm)), h1_s(sampling ? rows : 0, num_hidden(rbm)),
+            v2_a(rows, num_visible(rbm)), v2_s(sampling ? rows : 0, num_visible(rbm)),
+            h2_a(rows, num_hidden(rbm)), h2_s(sampling ? rows : 0, num_hidden(rbm)),
+            ht(rows, num_hidden(rbm)), vt(rows, num_visible(rbm)),
+            v_stack(2 * rows, num_visible(rbm)), h_stack(2 * rows, num_hidden(rbm)),
+            w_grad(num_visible(rbm), num_hidden(rbm)), b_grad(num_hidden(rbm)), c_grad(num_visible(rbm)),
+            q_local(num_hidden(rbm), static_cast<weight>(0.0)) {
+        //Nothing else to init
+    }
+};
 
-template<typename RBM, typename C, cpp::enable_if_u<rbm_traits<RBM>::is_dynamic()> = cpp::detail::dummy>
-auto reshape_1nh(RBM& rbm, C&& container){
-    return etl::reshape(container, 1, rbm.num_hidden);
+/*!
+ * \brief Create the contexts of the chunks of the parallel CD.
+ *
+ * The number of chunks is set by the RBM (parallel_chunks) and does not
+ * depend on the number of threads. The memory is bounded by the number of
+ * chunks and not by the size of the batch. The contexts are only created
+ * once.
+ */
+template<typename RBM, typename Trainer>
+void prepare_chunk_contexts(const RBM& rbm, Trainer& t){
+    if(!t.chunk_contexts.empty()){
+        return;
+    }
+
+    const auto batch = get_batch_size(rbm);
+    const auto chunks = std::max(std::size_t(1), std::min(rbm.parallel_chunks, batch));
+    const auto rows = (batch + chunks - 1) / chunks;
+
+    for(std::size_t c = 0; c < chunks; ++c){
+        t.chunk_contexts.emplace_back(rbm, rows, t.sampling);
+    }
 }
 
-template<typename RBM, typename C, cpp::disable_if_u<rbm_traits<RBM>::is_dynamic()> = cpp::detail::dummy>
-auto reshape_1nh(RBM&, C&& container){
-    return etl::reshape<1, RBM::num_hidden>(container);
+/*!
+ * \brief Sum the accumulators of the first chunks into the first one.
+ *
+ * The chunks are combined pairwise (c + s into c, for s = 1, 2, 4, ...), so
+ * the shape of the tree only depends on the number of chunks. At each
+ * level, the rows of the weights are distributed on the pool.
+ */
+template<typename Pool, typename Contexts>
+void reduce_chunks(Pool& pool, Contexts& contexts, std::size_t chunks){
+    const auto rows = etl::rows(contexts.front().w_grad);
+    const auto block = (rows + pool.size() - 1) / pool.size();
+
+    for(std::size_t s = 1; s < chunks; s *= 2){
+        for_each_block(pool, rows, block, [&contexts, chunks, s](std::size_t first, std::size_t last){
+            for(std::size_t c = 0; c + s < chunks; c += 2 * s){
+                for(std::size_t i = first; i < last; ++i){
+                    contexts[c].w_grad(i) += contexts[c + s].w_grad(i);
+                }
+            }
+        });
+
+        for(std::size_t c = 0; c + s < chunks; c += 2 * s){
+            auto& dst = contexts[c];
+            auto& src = contexts[c + s];
+
+            dst.b_grad += src.b_grad;
+            dst.c_grad += src.c_grad;
+            dst.q_local += src.q_local;
+
+            dst.reconstruction_error += src.reconstruction_error;
+            dst.q_global += src.q_global;
+        }
+    }
 }
 
+/*!
+ * \brief Pool of persistent chains for PCD.
+ *
+ * The number of chains is independent of the batch size. The
+ * probabilities and states of the hidden units of all the chains are
+ * stored in a single buffer, each chain starting on a new cache line. Each
+ * batch advances a rotating subset of the chains, as many as samples in
+ * the batch. A chain is started from the data the first time it is used.
+ */
+template<typename Weight>
+struct persistent_chains {
+    static constexpr const std::size_t cache_line = 64;
+    static constexpr const std::size_t line_values = (cache_line + sizeof(Weight) - 1) / sizeof(Weight);
+
+    std::size_t chains = 0; //Number of chains
+    std::size_t units = 0;  //Number of hidden units per chain
+    std::size_t stride = 0; //Distance between two chains (padded to a cache line)
+    std::size_t cursor = 0; //First chain of the next batch
+
+    std::vector<Weight> storage;
+    std::size_t offset = 0;                //Offset of the first cache-aligned value in storage
+
+    std::vector<char> initialized;         //Indicates if a chain has already been advanced
+    std::vector<char> fresh;               //Indicates if the chain of a sample of the current batch is new
+
+    void resize(std::size_t chains, std::size_t units){
+        this->chains = chains;
+        this->units = units;
+        this->stride = ((units + line_values - 1) / line_values) * line_values;
+
+        storage.assign(2 * chains * stride + line_values, Weight(0.0));
+
+        auto address = reinterpret_cast<std::uintptr_t>(storage.data());
+        offset = ((cache_line - address % cache_line) % cache_line) / sizeof(Weight);
+
+        initialized.assign(chains, 0);
+        cursor = 0;
+    }
+
+    /*!
+     * \brief Grow the pool to the given number of chains, the existing
+     * chains are kept and the new ones start from the data
+     */
+    void grow(std::size_t new_chains){
+        const auto old_storage = std::move(storage);
+        const auto old_initialized = std::move(initialized);
+        const auto old_chains = chains;
+        const auto old_offset = offset;
+        const auto old_cursor = cursor;
+
+        resize(new_chains, units);
+
+        for(std::size_t chain = 0; chain < old_chains; ++chain){
+            const auto* a = old_storage.data() + old_offset + chain * stride;
+            const auto* s = old_storage.data() + old_offset + (old_chains + chain) * stride;
+
+            std::copy(a, a + units, probs(chain));
+            std::copy(s, s + units, states(chain));
+
+            initialized[chain] = old_initialized[chain];
+        }
+
+        cursor = old_cursor;
+    }
+
+    Weight* probs(std::size_t chain){
+        return storage.data() + offset + chain * stride;
+    }
+
+    Weight* states(std::size_t chain){
+        return storage.data() + offset + (chains + chain) * stride;
+    }
+
+    /*!
+     * \brief Copy the next n chains into the rows of h_a and h_s
+     */
+    template<typename RBM, typename H1, typename H2>
+    void gather(const RBM& rbm, H1& h_a, H2& h_s, std::size_t n){
+        if(!chains){
+            resize(get_pcd_chains(rbm), num_hidden(rbm));
+        }
+
+        //A chain must not be advanced twice in the same batch
+        if(n > chains){
+            grow(n);
+        }
+
+        fresh.assign(n, 0);
+
+        for(std::size_t i = 0; i < n; ++i){
+            const auto chain = (cursor + i) % chains;
+
+            if(!initialized[chain]){
+                fresh[i] = 1;
+                continue;
+            }
+
+            const auto* a = probs(chain);
+            const auto* s = states(chain);
+
+            for(std::size_t j = 0; j < units; ++j){
+                h_a(i, j) = a[j];
+                h_s(i, j) = s[j];
+            }
+        }
+    }
+
+    /*!
+     * \brief Store the rows of h_a and h_s back into the chains and move to the next chains
+     */
+    template<typename H1, typename H2>
+    void scatter(const H1& h_a, const H2& h_s, std::size_t n){
+        for(std::size_t i = 0; i < n; ++i){
+            const auto chain = (cursor + i) % chains;
+
+            auto* a = probs(chain);
+            auto* s = states(chain);
+
+            for(std::size_t j = 0; j < units; ++j){
+                a[j] = h_a(i, j);
+                s[j] = h_s(i, j);
+            }
+
+            initialized[chain] = 1;
+        }
+
+        cursor = (cursor + n) % chains;
+    }
+};
+
+/*!
+ * \brief Apply the update of one parameter in a single step.
+ *
+ * The decay and the penalty are applied to the gradient, followed by the
+ * momentum and the learning rate, and the result is written back into
+ * the parameter. The decay type and the momentum are resolved at compile
+ * time, so the update engine only contains the needed operations.
+ */
+template<typename Weight, decay_type Decay, bool Momentum>
+struct fused_updater {
+    Weight l1_cost;
+    Weight l2_cost;
+    Weight momentum;
+    Weight eps;
+
+    template<typename RBM>
+    explicit fused_updater(const RBM& rbm) :
+            l1_cost(rbm.l1_weight_cost), l2_cost(rbm.l2_weight_cost),
+            momentum(rbm.momentum), eps(rbm.learning_rate) {
+        //Nothing else to init
+    }
+
+    template<typename V, typename G, typename I>
+    void operator()(V& value, const G& grad, I& inc, std::size_t k, Weight penalty) const {
+        const Weight v = value[k];
+
+        Weight g = grad[k] - penalty;
+
+        if(Decay == decay_type::L1){
+            g -= l1_cost * std::abs(v);
+        } else if(Decay == decay_type::L2){
+            g -= l2_cost * v;
+        } else if(Decay == decay_type::L1L2){
+            g -= l1_cost * std::abs(v) + l2_cost * v;
+        }
+
+        if(Momentum){
+            inc[k] = momentum * inc[k] + eps * g;
+            value[k] = v + inc[k];
+        } else {
+            value[k] = v + eps * g;
+        }
+
+        nan_check(value[k]);
+    }
+};
+
 /* The update weights procedure */
 
 template<typename RBM, typename Trainer>
 void update_normal(RBM& rbm, Trainer& t){
     using rbm_t = RBM;
+    using weight = typename rbm_t::weight;
+
+    constexpr const auto decay = rbm_traits<rbm_t>::decay();
+    constexpr const auto momentum = rbm_traits<rbm_t>::has_momentum();
+    constexpr const auto sparsity = rbm_traits<rbm_t>::sparsity_method();
 
     //Penalty to be applied to weights and hidden biases
-    typename rbm_t::weight w_penalty = 0.0;
-    typename rbm_t::weight h_penalty = 0.0;
-    typename rbm_t::weight v_penalty = 0.0;
+    weight w_penalty = 0.0;
+    weight h_penalty = 0.0;
+    weight v_penalty = 0.0;
 
     //Global sparsity method
-    if(rbm_traits<rbm_t>::sparsity_method() == sparsity_method::GLOBAL_TARGET){
+    if(sparsity == sparsity_method::GLOBAL_TARGET){
         auto decay_rate = rbm.decay_rate;
         auto p = rbm.sparsity_target;
         auto cost = rbm.sparsity_cost;
@@ -106,57 +384,42 @@ void update_normal(RBM& rbm, Trainer& t){
         w_penalty = h_penalty = cost * (t.q_global_t - p);
     }
 
-    //Apply L1/L2 regularization and penalties to the biases
-
-    t.update_grad(t.w_grad, rbm.w, rbm, w_decay(rbm_traits<rbm_t>::decay()), w_penalty);
-    t.update_grad(t.b_grad, rbm.b, rbm, b_decay(rbm_traits<rbm_t>::decay()), h_penalty);
-    t.update_grad(t.c_grad, rbm.c, rbm, b_decay(rbm_traits<rbm_t>::decay()), v_penalty);
-
     //Local sparsity method
-    if(rbm_traits<rbm_t>::sparsity_method() == sparsity_method::LOCAL_TARGET){
+    if(sparsity == sparsity_method::LOCAL_TARGET){
         auto decay_rate = rbm.decay_rate;
-        auto p = rbm.sparsity_target;
-        auto cost = rbm.sparsity_cost;
 
         t.q_local_t = decay_rate * t.q_local_t + (1.0 - decay_rate) * t.q_local_batch;
+    }
 
-        auto q_local_penalty = cost * (t.q_local_t - p);
+    const weight p = rbm.sparsity_target;
+    const weight cost = rbm.sparsity_cost;
 
-        t.b_grad -= q_local_penalty;
+    //Penalty of the local sparsity for the hidden unit i
+    auto local_penalty = [&](std::size_t i) -> weight {
+        return sparsity == sparsity_method::LOCAL_TARGET ? cost * (t.q_local_t[i] - p) : weight(0.0);
+    };
 
-        for(std::size_t i = 0; i < num_hidden(rbm); ++i){
-            for(std::size_t j = 0; j < num_visible(rbm); ++j){
-                t.w_grad(j, i) -= q_local_penalty(i);
-            }
-        }
-    }
+    const fused_updater<weight, w_decay(decay), momentum> w_updater(rbm);
+    const fused_updater<weight, b_decay(decay), momentum> b_updater(rbm);
 
-    //Apply momentum and learning rate
-    if(rbm_traits<rbm_t>::has_momentum()){
-        auto momentum = rbm.momentum;
-        auto eps = rbm.learning_rate;
+    const std::size_t nv = num_visible(rbm);
+    const std::size_t nh = num_hidden(rbm);
 
-        t.w_inc = momentum * t.w_inc + eps * t.w_grad;
-        t.b_inc = momentum * t.b_inc + eps * t.b_grad;
-        t.c_inc = momentum * t.c_inc + eps * t.c_grad;
-    }
-    //Apply the learning rate
-    else {
-        auto eps = rbm.learning_rate;
+    //Single sweep over w, w_grad and w_inc
 
-        t.w_grad *= eps;
-        t.b_grad *= eps;
-        t.c_grad *= eps;
+    for(std::size_t j = 0; j < nv; ++j){
+        for(std::size_t i = 0; i < nh; ++i){
+            w_updater(rbm.w, t.w_grad, t.w_inc, j * nh + i, w_penalty + local_penalty(i));
+        }
     }
 
-    //Update the weights and biases
-    //with the final gradients (if not momentum, these are the real gradients)
-    rbm.w += t.get_fgrad(t.w_grad, t.w_inc);
-    rbm.b += t.get_fgrad(t.b_grad, t.b_inc);
-    rbm.c += t.get_fgrad(t.c_grad, t.c_inc);
+    for(std::size_t i = 0; i < nh; ++i){
+        b_updater(rbm.b, t.b_grad, t.b_inc, i, h_penalty + local_penalty(i));
+    }
 
-    //Check for NaN
-    nan_check_deep_3(rbm.w, rbm.b, rbm.c);
+    for(std::size_t j = 0; j < nv; ++j){
+        b_updater(rbm.c, t.c_grad, t.c_inc, j, v_penalty);
+    }
 }
 
 template<typename RBM, typename Trainer>
@@ -165,15 +428,21 @@ void update_convolutional(RBM& rbm, Trainer& t){
     using weight = typename rbm_t::weight;
 
     constexpr const auto NC = rbm_t::NC;
+    constexpr const auto K = rbm_t::K;
+    constexpr const auto NH = rbm_t::NH;
     constexpr const auto NW = rbm_t::NW;
 
+    constexpr const auto decay = rbm_traits<rbm_t>::decay();
+    constexpr const auto momentum = rbm_traits<rbm_t>::has_momentum();
+    constexpr const auto sparsity = rbm_traits<rbm_t>::sparsity_method();
+
     //Penalty to be applied to weights and hidden biases
     weight w_penalty = 0.0;
     weight h_penalty = 0.0;
     weight v_penalty = 0.0;
 
     //Global sparsity method
-    if(rbm_traits<rbm_t>::sparsity_method() == sparsity_method::GLOBAL_TARGET){
+    if(sparsity == sparsity_method::GLOBAL_TARGET){
         auto decay_rate = rbm.decay_rate;
         auto p = rbm.sparsity_target;
         auto cost = rbm.sparsity_cost;
@@ -183,71 +452,53 @@ void update_convolutional(RBM& rbm, Trainer& t){
         w_penalty = h_penalty = cost * (t.q_global_t - p);
     }
 
-    //Apply L1/L2 regularization and penalties to the biases
-
-    t.update_grad(t.w_grad, rbm.w, rbm, w_decay(rbm_traits<rbm_t>::decay()), w_penalty);
-    t.update_grad(t.b_grad, rbm.b, rbm, b_decay(rbm_traits<rbm_t>::decay()), h_penalty);
-    t.update_grad(t.c_grad, rbm.c, rbm, b_decay(rbm_traits<rbm_t>::decay()), v_penalty);
+    //Penalty of the local sparsity for each group
+    etl::fast_vector<weight, K> k_penalty(0.0);
 
-    //Local sparsity method
-    if(rbm_traits<rbm_t>::sparsity_method() == sparsity_method::LOCAL_TARGET){
+    if(sparsity == sparsity_method::LOCAL_TARGET){
         auto decay_rate = rbm.decay_rate;
         auto p = rbm.sparsity_target;
         auto cost = rbm.sparsity_cost;
 
         t.q_local_t = decay_rate * t.q_local_t + (1.0 - decay_rate) * t.q_local_batch;
 
-        auto q_local_penalty = cost * (t.q_local_t - p);
-
-        t.b_grad -= sum_r(q_local_penalty);
-
-        auto k_penalty = etl::rep<NW, NW>(sum_r(q_local_penalty));
-        for(std::size_t channel = 0; channel < NC; ++channel){
-            t.w_grad(channel) = t.w_grad(channel) - k_penalty;
+        for(std::size_t k = 0; k < K; ++k){
+            for(std::size_t i = 0; i < NH * NH; ++i){
+                k_penalty[k] += cost * (t.q_local_t[k * NH * NH + i] - p);
+            }
         }
     }
 
-    if(rbm_traits<rbm_t>::sparsity_method() == sparsity_method::LEE){
-        auto eps = rbm.learning_rate;
+    //Factor of the sparsity biases
+    const weight lee = sparsity == sparsity_method::LEE ? rbm.pbias_lambda * (1.0 / rbm.learning_rate) : 0.0;
 
-        t.w_grad -= rbm.pbias_lambda * (1.0 / eps) * t.w_bias;
-        t.b_grad -= rbm.pbias_lambda * (1.0 / eps)* t.b_bias;
-        t.c_grad -= rbm.pbias_lambda * (1.0 / eps)* t.c_bias;
-    }
+    const fused_updater<weight, w_decay(decay), momentum> w_updater(rbm);
+    const fused_updater<weight, b_decay(decay), momentum> b_updater(rbm);
 
-    //Apply momentum and learning rate
-    if(rbm_traits<rbm_t>::has_momentum()){
-        auto momentum = rbm.momentum;
-        auto eps = rbm.learning_rate;
+    //Single sweep over w, w_grad and w_inc
 
-        t.w_inc = momentum * t.w_inc + eps * t.w_grad;
-        t.b_inc = momentum * t.b_inc + eps * t.b_grad;
-        t.c_inc = momentum * t.c_inc + eps * t.c_grad;
-    }
-    //Apply learning rate
-    else {
-        auto eps = rbm.learning_rate;
+    for(std::size_t channel = 0; channel < NC; ++channel){
+        for(std::size_t k = 0; k < K; ++k){
+            const auto first = (channel * K + k) * NW * NW;
 
-        t.w_grad *= eps;
-        t.b_grad *= eps;
-        t.c_grad *= eps;
+            for(std::size_t i = first; i < first + NW * NW; ++i){
+                w_updater(rbm.w, t.w_grad, t.w_inc, i, w_penalty + k_penalty[k] + lee * t.w_bias[i]);
+            }
+        }
     }
 
-    //Update the weights and biases
-    //with the final gradients (if not momentum, these are the real gradients)
-    rbm.w += t.get_fgrad(t.w_grad, t.w_inc);
-    rbm.b += t.get_fgrad(t.b_grad, t.b_inc);
-    rbm.c += t.get_fgrad(t.c_grad, t.c_inc);
+    for(std::size_t k = 0; k < K; ++k){
+        b_updater(rbm.b, t.b_grad, t.b_inc, k, h_penalty + k_penalty[k] + lee * t.b_bias[k]);
+    }
 
-    //Check for NaN
-    nan_check_deep(rbm.w);
-    nan_check_deep(rbm.b);
-    nan_check_deep(rbm.c);
+    for(std::size_t channel = 0; channel < NC; ++channel){
+        b_updater(rbm.c, t.c_grad, t.c_inc, channel, v_penalty + lee * t.c_bias[channel]);
+    }
 }
 
 /* The training procedures */
 
-template<bool Persistent, std::size_t K, typename T, typename RBM, typename Trainer>
+template<bool Persistent, std::size_t K, typename T, typename RBM, typename Trainer, cpp::disable_if_u<rbm_traits<RBM>::is_parallel()> = cpp::detail::dummy>
 void train_normal(const dll::batch<T>& input_batch, const dll::batch<T>& expected_batch, rbm_training_context& context, RBM& rbm, Trainer& t){
     cpp_assert(input_batch.size() > 0, "Invalid batch size");
     cpp_assert(input_batch.size() <= get_batch_size(rbm), "Invalid batch size");
@@ -256,70 +507,126 @@ void train_normal(const dll::batch<T>& input_batch, const dll::batch<T>& expecte
     using namespace etl;
     using rbm_t = RBM;
 
+    seed_random_streams(context.seed, context.epoch, context.sample);
+
+    //Copy input/expected for computations
     maybe_parallel_foreach_pair_i(t.pool, input_batch.begin(), input_batch.end(), expected_batch.begin(), expected_batch.end(),
-            [&](const auto& input, const auto& expected, std::size_t i)
+            [&t](const auto& input, const auto& expected, std::size_t i)
     {
-        //Copy input/expected for computations
         t.v1(i) = input;
         t.vf(i) = expected;
+    });
 
-        //First step
-        rbm.template activate_hidden<true, true>(t.h1_a(i), t.h1_s(i), t.v1(i), t.v1(i), t.ht(i));
+    //The Gibbs steps are done on the complete batch at once,
+    //each activation is a single matrix-matrix multiplication
 
-        if(Persistent && t.init){
-            t.p_h_a(i) = t.h1_a(i);
-            t.p_h_s(i) = t.h1_s(i);
-        }
+    //First step
+    rbm.template batch_activate_hidden<true, true>(t.h1_a, t.h1_s, t.v1, t.v1, t.ht);
 
-        //CD-1
-        if(Persistent){
-            rbm.template activate_visible<true, false>(t.p_h_a(i), t.p_h_s(i), t.v2_a(i), t.v2_s(i), t.vt(i));
-            rbm.template activate_hidden<true, true>(t.h2_a(i), t.h2_s(i), t.v2_a(i), t.v2_s(i), t.ht(i));
-        } else {
-            rbm.template activate_visible<true, false>(t.h1_a(i), t.h1_s(i), t.v2_a(i), t.v2_s(i), t.vt(i));
-            rbm.template activate_hidden<true, (K > 1)>(t.h2_a(i), t.h2_s(i), t.v2_a(i), t.v2_s(i), t.ht(i));
-        }
+    if(Persistent){
+        //Select the chains advanced by this batch, new chains start from the data
+        t.chains.gather(rbm, t.p_h_a, t.p_h_s, input_batch.size());
 
-        //CD-k
-        for(std::size_t k = 1; k < K; ++k){
-            rbm.template activate_visible<true, false>(t.h2_a(i), t.h2_s(i), t.v2_a(i), t.v2_s(i), t.vt(i));
-            rbm.template activate_hidden<true, true>(t.h2_a(i), t.h2_s(i), t.v2_a(i), t.v2_s(i), t.ht(i));
+        for(std::size_t i = 0; i < input_batch.size(); ++i){
+            if(t.chains.fresh[i]){
+                t.p_h_a(i) = t.h1_a(i);
+                t.p_h_s(i) = t.h1_s(i);
+            }
         }
+    }
 
-        //The following lines are equivalent to mmul(vf, h1_a) - mmul(v2_a, h2_a)
-        //Doing them this way is significantly faster than computing the two matrix mutplications
-        //and doing the subtraction later
+    //CD-1
+    if(Persistent){
+        rbm.template batch_activate_visible<true, false>(t.p_h_a, t.p_h_s, t.v2_a, t.v2_s, t.negative_c(rbm), t.negative_w(rbm), t.vt);
+        rbm.template batch_activate_hidden<true, true>(t.h2_a, t.h2_s, t.v2_a, t.v2_s, t.negative_b(rbm), t.negative_w(rbm), t.ht);
+    } else {
+        rbm.template batch_activate_visible<true, false>(t.h1_a, t.h1_s, t.v2_a, t.v2_s, t.negative_c(rbm), t.negative_w(rbm), t.vt);
+        rbm.template batch_activate_hidden<true, (K > 1)>(t.h2_a, t.h2_s, t.v2_a, t.v2_s, t.negative_b(rbm), t.negative_w(rbm), t.ht);
+    }
 
-        auto g = t.w_grad_b(i);
+    //CD-k
+    for(std::size_t k = 1; k < K; ++k){
+        rbm.template batch_activate_visible<true, false>(t.h2_a, t.h2_s, t.v2_a, t.v2_s, t.negative_c(rbm), t.negative_w(rbm), t.vt);
+        rbm.template batch_activate_hidden<true, true>(t.h2_a, t.h2_s, t.v2_a, t.v2_s, t.negative_b(rbm), t.negative_w(rbm), t.ht);
+    }
 
-        //Reset the batch gradients
-        g = 0;
+    if(Persistent){
+        t.chains.scatter(t.h2_a, t.h2_s, input_batch.size());
+    }
 
-        auto a1 = reshape_nv1(rbm, t.vf(i));
-        auto b1 = reshape_1nh(rbm, t.h1_a(i));
-        auto a2 = reshape_nv1(rbm, t.v2_a(i));
-        auto b2 = reshape_1nh(rbm, t.h2_a(i));
+    context.reconstruction_error += mean((t.vf - t.v2_a) * (t.vf - t.v2_a));
 
-        for(std::size_t i2 = 0; i2 < rows(a1); i2++){
-            for(std::size_t k = 0; k < columns(a1); k++){
-                for(std::size_t j = 0; j < columns(b1); j++){
-                    g(i2,j) += a1(i2,k) * b1(k,j) - a2(i2,k) * b2(k,j);
-                }
-            }
-        }
+    //Compute the gradients
+    //The weight gradients are the difference of two batched outer products:
+    //w_grad = (vf^T * h1_a - v2_a^T * h2_a) / batch_size
+
+    etl::mmul(etl::transpose(t.vf), t.h1_a, t.w_grad);
+    etl::mmul(etl::transpose(t.v2_a), t.h2_a, t.w_neg);
+
+    t.w_grad = (t.w_grad - t.w_neg) / static_cast<typename rbm_t::weight>(etl::rows(t.vf));
+    t.b_grad = mean_l(t.h1_a - t.h2_a);
+    t.c_grad = mean_l(t.vf - t.v2_a);
+
+    nan_check_deep_3(t.w_grad, t.b_grad, t.c_grad);
+
+    //Compute the mean activation probabilities
+    t.q_global_batch = mean(t.h2_a);
+
+    if(rbm_traits<rbm_t>::sparsity_method() == sparsity_method::LOCAL_TARGET){
+        t.q_local_batch = mean_l(t.h2_a);
+    }
+
+    //Accumulate the sparsity
+    context.sparsity += t.q_global_batch;
+
+    //Update the weights and biases based on the gradients
+    t.update(rbm);
+}
+
+/*!
+ * \brief Mean-field version of train_normal.
+ *
+ * The chain is run on the activation probabilities only, no unit is ever
+ * sampled and the sample buffers of the trainer are not used. The Gibbs
+ * steps are done on the complete batch at once.
+ */
+template<std::size_t K, typename T, typename RBM, typename Trainer>
+void train_mean_field(const dll::batch<T>& input_batch, const dll::batch<T>& expected_batch, rbm_training_context& context, RBM& rbm, Trainer& t){
+    cpp_assert(input_batch.size() > 0, "Invalid batch size");
+    cpp_assert(input_batch.size() <= get_batch_size(rbm), "Invalid batch size");
+    cpp_assert(input_batch.begin()->size() == input_size(rbm), "Invalid input dimensions");
+
+    using namespace etl;
+    using rbm_t = RBM;
+
+    //Copy input/expected for computations
+    maybe_parallel_foreach_pair_i(t.pool, input_batch.begin(), input_batch.end(), expected_batch.begin(), expected_batch.end(),
+            [&t](const auto& input, const auto& expected, std::size_t i)
+    {
+        t.v1(i) = input;
+        t.vf(i) = expected;
     });
 
-    if(Persistent){
-        t.p_h_a = t.h2_a;
-        t.p_h_s = t.h2_s;
+    //The probabilities are passed in place of the samples
 
-        t.init = false;
+    rbm.template batch_activate_hidden<true, false>(t.h1_a, t.h1_a, t.v1, t.v1, t.ht);
+
+    rbm.template batch_activate_visible<true, false>(t.h1_a, t.h1_a, t.v2_a, t.v2_a, t.negative_c(rbm), t.negative_w(rbm), t.vt);
+    rbm.template batch_activate_hidden<true, false>(t.h2_a, t.h2_a, t.v2_a, t.v2_a, t.negative_b(rbm), t.negative_w(rbm), t.ht);
+
+    for(std::size_t k = 1; k < K; ++k){
+        rbm.template batch_activate_visible<true, false>(t.h2_a, t.h2_a, t.v2_a, t.v2_a, t.negative_c(rbm), t.negative_w(rbm), t.vt);
+        rbm.template batch_activate_hidden<true, false>(t.h2_a, t.h2_a, t.v2_a, t.v2_a, t.negative_b(rbm), t.negative_w(rbm), t.ht);
     }
 
     context.reconstruction_error += mean((t.vf - t.v2_a) * (t.vf - t.v2_a));
 
     //Compute the gradients
-    t.w_grad = mean_l(t.w_grad_b);
+
+    etl::mmul(etl::transpose(t.vf), t.h1_a, t.w_grad);
+    etl::mmul(etl::transpose(t.v2_a), t.h2_a, t.w_neg);
+
+    t.w_grad = (t.w_grad - t.w_neg) / static_cast<typename rbm_t::weight>(etl::rows(t.vf));
     t.b_grad = mean_l(t.h1_a - t.h2_a);
     t.c_grad = mean_l(t.vf - t.v2_a);
 
@@ -339,6 +646,179 @@ void train_normal(const dll::batch<T>& input_batch, const dll::batch<T>& expecte
     t.update(rbm);
 }
 
+/*!
+ * \brief Parallel version of train_normal.
+ *
+ * The batch is split in a fixed number of contiguous chunks, distributed on
+ * the workers of the pool. Each worker runs the CD chain on its chunk with
+ * batched activations and accumulates its gradients in the context of the
+ * chunk. The accumulators are then combined by a pairwise tree whose shape
+ * only depends on the number of chunks, so that the result does not depend
+ * on the number of threads.
+ */
+template<bool Persistent, std::size_t K, typename T, typename RBM, typename Trainer, cpp::enable_if_u<rbm_traits<RBM>::is_parallel()> = cpp::detail::dummy>
+void train_normal(const dll::batch<T>& input_batch, const dll::batch<T>& expected_batch, rbm_training_context& context, RBM& rbm, Trainer& t){
+    cpp_assert(input_batch.size() > 0, "Invalid batch size");
+    cpp_assert(input_batch.size() <= get_batch_size(rbm), "Invalid batch size");
+    cpp_assert(input_batch.begin()->size() == input_size(rbm), "The size of the training sample must match visible units");
+
+    using namespace etl;
+    using rbm_t = RBM;
+    using weight = typename rbm_t::weight;
+
+    const std::size_t n = input_batch.size();
+
+    prepare_chunk_contexts(rbm, t);
+
+    auto& contexts = t.chunk_contexts;
+
+    //The chunks only depend on the size of the batch
+    const std::size_t chunks = std::min(contexts.size(), n);
+
+    for(std::size_t c = 0; c < chunks; ++c){
+        contexts[c].first = c * n / chunks;
+        contexts[c].n = (c + 1) * n / chunks - contexts[c].first;
+    }
+
+    if(Persistent){
+        //Select the chains advanced by this batch
+        t.chains.gather(rbm, t.p_h_a, t.p_h_s, n);
+    }
+
+    maybe_parallel_foreach_i(t.pool, contexts, [&](const auto&, std::size_t c){
+        if(c >= chunks){
+            return;
+        }
+
+        auto& ctx = contexts[c];
+        const auto R = ctx.rows;
+
+        //The draws only depend on the position of the samples, not on the thread
+        seed_random_streams(context.seed, context.epoch, context.sample + ctx.first);
+
+        //Copy input/expected of the chunk, the missing samples of a smaller chunk are zeroes
+
+        auto input = std::next(input_batch.begin(), ctx.first);
+        auto expected = std::next(expected_batch.begin(), ctx.first);
+
+        for(std::size_t i = 0; i < R; ++i){
+            if(i < ctx.n){
+                ctx.v1(i) = *input;
+                ctx.vf(i) = *expected;
+
+                ++input;
+                ++expected;
+            } else {
+                ctx.v1(i) = 0.0;
+                ctx.vf(i) = 0.0;
+            }
+        }
+
+        //First step
+        rbm.template batch_activate_hidden<true, true>(ctx.h1_a, ctx.h1_s, ctx.v1, ctx.v1, ctx.ht);
+
+        if(Persistent){
+            //Gather the persistent chains of the chunk, new chains start from the data
+            for(std::size_t i = 0; i < R; ++i){
+                if(i >= ctx.n || t.chains.fresh[ctx.first + i]){
+                    ctx.h2_a(i) = ctx.h1_a(i);
+                    ctx.h2_s(i) = ctx.h1_s(i);
+                } else {
+                    ctx.h2_a(i) = t.p_h_a(ctx.first + i);
+                    ctx.h2_s(i) = t.p_h_s(ctx.first + i);
+                }
+            }
+
+            for(std::size_t k = 0; k < K; ++k){
+                rbm.template batch_activate_visible<true, false>(ctx.h2_a, ctx.h2_s, ctx.v2_a, ctx.v2_s, t.negative_c(rbm), t.negative_w(rbm), ctx.vt);
+                rbm.template batch_activate_hidden<true, true>(ctx.h2_a, ctx.h2_s, ctx.v2_a, ctx.v2_s, t.negative_b(rbm), t.negative_w(rbm), ctx.ht);
+            }
+
+            //Scatter the chains back
+            for(std::size_t i = 0; i < ctx.n; ++i){
+                t.p_h_a(ctx.first + i) = ctx.h2_a(i);
+                t.p_h_s(ctx.first + i) = ctx.h2_s(i);
+            }
+        } else {
+            rbm.template batch_activate_visible<true, false>(ctx.h1_a, ctx.h1_s, ctx.v2_a, ctx.v2_s, t.negative_c(rbm), t.negative_w(rbm), ctx.vt);
+            rbm.template batch_activate_hidden<true, (K > 1)>(ctx.h2_a, ctx.h2_s, ctx.v2_a, ctx.v2_s, t.negative_b(rbm), t.negative_w(rbm), ctx.ht);
+
+            for(std::size_t k = 1; k < K; ++k){
+                rbm.template batch_activate_visible<true, false>(ctx.h2_a, ctx.h2_s, ctx.v2_a, ctx.v2_s, t.negative_c(rbm), t.negative_w(rbm), ctx.vt);
+                rbm.template batch_activate_hidden<true, true>(ctx.h2_a, ctx.h2_s, ctx.v2_a, ctx.v2_s, t.negative_b(rbm), t.negative_w(rbm), ctx.ht);
+            }
+        }
+
+        //Accumulate the gradients of the chunk
+        //w_grad = [vf; v2_a]^T * [h1_a; -h2_a] = vf^T * h1_a - v2_a^T * h2_a
+        //The rows of the missing samples are zeroes and do not contribute
+
+        for(std::size_t i = 0; i < R; ++i){
+            if(i < ctx.n){
+                ctx.v_stack(i) = ctx.vf(i);
+                ctx.v_stack(R + i) = ctx.v2_a(i);
+            } else {
+                ctx.v_stack(i) = 0.0;
+                ctx.v_stack(R + i) = 0.0;
+            }
+
+            ctx.h_stack(i) = ctx.h1_a(i);
+            ctx.h_stack(R + i) = -1.0 * ctx.h2_a(i);
+        }
+
+        etl::mmul(etl::transpose(ctx.v_stack), ctx.h_stack, ctx.w_grad);
+
+        ctx.b_grad = 0.0;
+        ctx.c_grad = 0.0;
+        ctx.q_local = 0.0;
+
+        ctx.reconstruction_error = 0.0;
+        ctx.q_global = 0.0;
+
+        for(std::size_t i = 0; i < ctx.n; ++i){
+            ctx.b_grad += ctx.h1_a(i) - ctx.h2_a(i);
+            ctx.c_grad += ctx.vf(i) - ctx.v2_a(i);
+
+            ctx.reconstruction_error += etl::sum((ctx.vf(i) - ctx.v2_a(i)) * (ctx.vf(i) - ctx.v2_a(i)));
+            ctx.q_global += etl::sum(ctx.h2_a(i));
+
+            if(rbm_traits<rbm_t>::sparsity_method() == sparsity_method::LOCAL_TARGET){
+                ctx.q_local += ctx.h2_a(i);
+            }
+        }
+    });
+
+    if(Persistent){
+        t.chains.scatter(t.p_h_a, t.p_h_s, n);
+    }
+
+    reduce_chunks(t.pool, contexts, chunks);
+
+    auto& root = contexts.front();
+
+    context.reconstruction_error += root.reconstruction_error / static_cast<weight>(n * num_visible(rbm));
+
+    //Normalize the gradients
+    t.w_grad = root.w_grad / static_cast<weight>(n);
+    t.b_grad = root.b_grad / static_cast<weight>(n);
+    t.c_grad = root.c_grad / static_cast<weight>(n);
+
+    nan_check_deep_3(t.w_grad, t.b_grad, t.c_grad);
+
+    //Compute the mean activation probabilities
+    t.q_global_batch = root.q_global / static_cast<weight>(n * num_hidden(rbm));
+
+    if(rbm_traits<rbm_t>::sparsity_method() == sparsity_method::LOCAL_TARGET){
+        t.q_local_batch = root.q_local / static_cast<weight>(n);
+    }
+
+    //Accumulate the sparsity
+    context.sparsity += t.q_global_batch;
+
+    //Update the weights and biases based on the gradients
+    t.update(rbm);
+}
+
 template<bool Persistent, std::size_t N, typename Trainer, typename T, typename RBM>
 void train_convolutional(const dll::batch<T>& input_batch, const dll::batch<T>& expected_batch, rbm_training_context& context, RBM& rbm, Trainer& t){
     cpp_assert(input_batch.size() > 0, "Invalid batch size");
@@ -354,6 +834,9 @@ void train_convolutional(const dll::batch<T>& input_batch, const dll::batch<T>&
         constexpr const auto K = rbm_t::K;
         constexpr const auto NC = rbm_t::NC;
 
+        //The draws only depend on the position of the sample, not on the thread
+        seed_random_streams(context.seed, context.epoch, context.sample + i);
+
         //Copy input/expected for computations
         t.v1(i) = input;
         t.vf(i) = expected;
@@ -368,17 +851,17 @@ void train_convolutional(const dll::batch<T>& input_batch, const dll::batch<T>&
 
         //CD-1
         if(Persistent){
-            rbm.activate_visible(t.p_h_a(i), t.p_h_s(i), t.v2_a(i), t.v2_s(i), t.h_cv(i));
-            rbm.activate_hidden(t.h2_a(i), t.h2_s(i), t.v2_a(i), t.v2_s(i), t.v_cv(i));
+            rbm.activate_visible(t.p_h_a(i), t.p_h_s(i), t.v2_a(i), t.v2_s(i), t.negative_c(rbm), t.negative_w(rbm), t.h_cv(i));
+            rbm.activate_hidden(t.h2_a(i), t.h2_s(i), t.v2_a(i), t.v2_s(i), t.negative_b(rbm), t.negative_w(rbm), t.v_cv(i));
         } else {
-            rbm.activate_visible(t.h1_a(i), t.h1_s(i), t.v2_a(i), t.v2_s(i), t.h_cv(i));
-            rbm.activate_hidden(t.h2_a(i), t.h2_s(i), t.v2_a(i), t.v2_s(i), t.v_cv(i));
+            rbm.activate_visible(t.h1_a(i), t.h1_s(i), t.v2_a(i), t.v2_s(i), t.negative_c(rbm), t.negative_w(rbm), t.h_cv(i));
+            rbm.activate_hidden(t.h2_a(i), t.h2_s(i), t.v2_a(i), t.v2_s(i), t.negative_b(rbm), t.negative_w(rbm), t.v_cv(i));
         }
 
         //CD-k
         for(std::size_t k = 1; k < N; ++k){
-            rbm.activate_visible(t.h2_a(i), t.h2_s(i), t.v2_a(i), t.v2_s(i), t.h_cv(i));
-            rbm.activate_hidden(t.h2_a(i), t.h2_s(i), t.v2_a(i), t.v2_s(i), t.v_cv(i));
+            rbm.activate_visible(t.h2_a(i), t.h2_s(i), t.v2_a(i), t.v2_s(i), t.negative_c(rbm), t.negative_w(rbm), t.h_cv(i));
+            rbm.activate_hidden(t.h2_a(i), t.h2_s(i), t.v2_a(i), t.v2_s(i), t.negative_b(rbm), t.negative_w(rbm), t.v_cv(i));
         }
 
         //Compute gradients
@@ -433,6 +916,52 @@ void train_convolutional(const dll::batch<T>& input_batch, const dll::batch<T>&
 
 /* The specialized trainers */
 
+/*!
+ * \brief The fast weights of FPCD.
+ *
+ * The fast weights are trained with the same gradients as the regular
+ * weights, but with a strong decay (rbm.fast_decay) instead of the
+ * regularization. The
+ * negative chains are run with the sum of the regular and fast weights.
+ */
+template<typename RBM>
+struct fast_weights {
+    using rbm_t = RBM;
+    using weight = typename rbm_t::weight;
+
+    using w_type = std::decay_t<decltype(std::declval<rbm_t>().w)>;
+    using b_type = std::decay_t<decltype(std::declval<rbm_t>().b)>;
+    using c_type = std::decay_t<decltype(std::declval<rbm_t>().c)>;
+
+    w_type w_f;  //Fast weights
+    b_type b_f;  //Fast hidden biases
+    c_type c_f;  //Fast visible biases
+
+    w_type w_c;  //Regular + fast weights
+    b_type b_c;  //Regular + fast hidden biases
+    c_type c_c;  //Regular + fast visible biases
+
+    fast_weights(const rbm_t& rbm) : w_f(rbm.w), b_f(rbm.b), c_f(rbm.c), w_c(rbm.w), b_c(rbm.b), c_c(rbm.c) {
+        w_f = 0.0;
+        b_f = 0.0;
+        c_f = 0.0;
+    }
+
+    template<typename Trainer>
+    void update(const rbm_t& rbm, const Trainer& t){
+        const weight eps = rbm.learning_rate;
+        const weight decay = rbm.fast_decay;
+
+        w_f = decay * w_f + eps * t.w_grad;
+        b_f = decay * b_f + eps * t.b_grad;
+        c_f = decay * c_f + eps * t.c_grad;
+
+        w_c = rbm.w + w_f;
+        b_c = rbm.b + b_f;
+        c_c = rbm.c + c_f;
+    }
+};
+
 /*!
  * \brief Base class for all Contrastive Divergence Trainer.
  *
@@ -452,21 +981,20 @@ struct base_cd_trainer : base_trainer<RBM> {
     etl::fast_matrix<weight, batch_size, num_visible> vf; //Expected
 
     etl::fast_matrix<weight, batch_size, num_hidden> h1_a;
-    etl::fast_matrix<weight, batch_size, num_hidden> h1_s;
+    etl::dyn_matrix<weight> h1_s;
 
     etl::fast_matrix<weight, batch_size, num_visible> v2_a;
-    etl::fast_matrix<weight, batch_size, num_visible> v2_s;
+    etl::dyn_matrix<weight> v2_s;
 
     etl::fast_matrix<weight, batch_size, num_hidden> h2_a;
-    etl::fast_matrix<weight, batch_size, num_hidden> h2_s;
-
-    etl::fast_matrix<weight, batch_size, 1, num_hidden> ht;
-    etl::fast_matrix<weight, batch_size, num_visible, 1> vt;
+    etl::dyn_matrix<weight> h2_s;
 
-    etl::fast_matrix<weight, batch_size, num_visible, num_hidden> w_grad_b;
+    etl::fast_matrix<weight, batch_size, num_hidden> ht;  //Temporary for batch hidden activations
+    etl::fast_matrix<weight, batch_size, num_visible> vt; //Temporary for batch visible activations
 
     //Gradients
     etl::fast_matrix<weight, num_visible, num_hidden> w_grad;
+    etl::fast_matrix<weight, num_visible, num_hidden> w_neg; //Negative phase of the weight gradients
     etl::fast_vector<weight, num_hidden> b_grad;
     etl::fast_vector<weight, num_visible> c_grad;
 
@@ -488,18 +1016,37 @@ struct base_cd_trainer : base_trainer<RBM> {
 
     //}}} Sparsity end
 
-    etl::fast_matrix<weight, batch_size, rbm_t::num_hidden> p_h_a;
-    etl::fast_matrix<weight, batch_size, rbm_t::num_hidden> p_h_s;
+    etl::dyn_matrix<weight> p_h_a;
+    etl::dyn_matrix<weight> p_h_s;
+
+    bool sampling; //Indicates if the units are sampled (false for mean-field CD)
 
     thread_pool<rbm_traits<rbm_t>::is_parallel()> pool;
 
+    persistent_chains<weight> chains; //Only used by PCD
+
+    std::vector<cd_chunk_context<rbm_t>> chunk_contexts; //Only used in parallel mode
+
+    //The sample buffers are dynamic, they are not allocated when the chain runs on probabilities only
+    static std::size_t sample_rows(bool sampling){
+        return sampling ? batch_size : 0;
+    }
+
     template<bool M = rbm_traits<rbm_t>::has_momentum(), cpp::disable_if_u<M> = cpp::detail::dummy>
-    base_cd_trainer(rbm_t&) : q_global_t(0.0), q_local_t(0.0) {
+    base_cd_trainer(rbm_t& rbm, bool sampling = true) :
+            h1_s(sample_rows(sampling), dll::num_hidden(rbm)), v2_s(sample_rows(sampling), dll::num_visible(rbm)), h2_s(sample_rows(sampling), dll::num_hidden(rbm)),
+            q_global_t(0.0), q_local_t(0.0),
+            p_h_a(sample_rows(sampling), dll::num_hidden(rbm)), p_h_s(sample_rows(sampling), dll::num_hidden(rbm)),
+            sampling(sampling), pool(rbm.threads) {
         static_assert(!rbm_traits<rbm_t>::has_momentum(), "This constructor should only be used without momentum support");
     }
 
     template<bool M = rbm_traits<rbm_t>::has_momentum(), cpp::enable_if_u<M> = cpp::detail::dummy>
-    base_cd_trainer(rbm_t&) : w_inc(0.0), b_inc(0.0), c_inc(0.0), q_global_t(0.0), q_local_t(0.0) {
+    base_cd_trainer(rbm_t& rbm, bool sampling = true) :
+            h1_s(sample_rows(sampling), dll::num_hidden(rbm)), v2_s(sample_rows(sampling), dll::num_visible(rbm)), h2_s(sample_rows(sampling), dll::num_hidden(rbm)),
+            w_inc(0.0), b_inc(0.0), c_inc(0.0), q_global_t(0.0), q_local_t(0.0),
+            p_h_a(sample_rows(sampling), dll::num_hidden(rbm)), p_h_s(sample_rows(sampling), dll::num_hidden(rbm)),
+            sampling(sampling), pool(rbm.threads) {
         static_assert(rbm_traits<rbm_t>::has_momentum(), "This constructor should only be used with momentum support");
     }
 
@@ -531,13 +1078,12 @@ struct base_cd_trainer<RBM, std::enable_if_t<rbm_traits<RBM>::is_dynamic()>> : b
     etl::dyn_matrix<weight> h2_a;
     etl::dyn_matrix<weight> h2_s;
 
-    etl::dyn_matrix<weight, 3> ht;
-    etl::dyn_matrix<weight, 3> vt;
-
-    etl::dyn_matrix<weight, 3> w_grad_b;
+    etl::dyn_matrix<weight> ht; //Temporary for batch hidden activations
+    etl::dyn_matrix<weight> vt; //Temporary for batch visible activations
 
     //Gradients
     etl::dyn_matrix<weight> w_grad;
+    etl::dyn_matrix<weight> w_neg; //Negative phase of the weight gradients
     etl::dyn_vector<weight> b_grad;
     etl::dyn_vector<weight> c_grad;
 
@@ -562,39 +1108,50 @@ struct base_cd_trainer<RBM, std::enable_if_t<rbm_traits<RBM>::is_dynamic()>> : b
     etl::dyn_matrix<weight> p_h_a;
     etl::dyn_matrix<weight> p_h_s;
 
+    bool sampling; //Indicates if the units are sampled (false for mean-field CD)
+
     thread_pool<rbm_traits<rbm_t>::is_parallel()> pool;
 
+    persistent_chains<weight> chains; //Only used by PCD
+
+    std::vector<cd_chunk_context<rbm_t>> chunk_contexts; //Only used in parallel mode
+
+    //The sample buffers are not allocated when the chain runs on probabilities only
+    static std::size_t sample_rows(const rbm_t& rbm, bool sampling){
+        return sampling ? get_batch_size(rbm) : 0;
+    }
+
     template<bool M = rbm_traits<rbm_t>::has_momentum(), cpp::disable_if_u<M> = cpp::detail::dummy>
-    base_cd_trainer(rbm_t& rbm) :
+    base_cd_trainer(rbm_t& rbm, bool sampling = true) :
             v1(get_batch_size(rbm), rbm.num_visible),
             vf(get_batch_size(rbm), rbm.num_visible),
-            h1_a(get_batch_size(rbm), rbm.num_hidden), h1_s(get_batch_size(rbm), rbm.num_hidden),
-            v2_a(get_batch_size(rbm), rbm.num_visible), v2_s(get_batch_size(rbm), rbm.num_visible),
-            h2_a(get_batch_size(rbm), rbm.num_hidden), h2_s(get_batch_size(rbm), rbm.num_hidden),
-            ht(get_batch_size(rbm), 1UL, rbm.num_hidden), vt(get_batch_size(rbm), rbm.num_visible, 1UL),
-            w_grad_b(get_batch_size(rbm), rbm.num_visible, rbm.num_hidden),
-            w_grad(rbm.num_visible, rbm.num_hidden), b_grad(rbm.num_hidden), c_grad(rbm.num_visible),
+            h1_a(get_batch_size(rbm), rbm.num_hidden), h1_s(sample_rows(rbm, sampling), rbm.num_hidden),
+            v2_a(get_batch_size(rbm), rbm.num_visible), v2_s(sample_rows(rbm, sampling), rbm.num_visible),
+            h2_a(get_batch_size(rbm), rbm.num_hidden), h2_s(sample_rows(rbm, sampling), rbm.num_hidden),
+            ht(get_batch_size(rbm), rbm.num_hidden), vt(get_batch_size(rbm), rbm.num_visible),
+            w_grad(rbm.num_visible, rbm.num_hidden), w_neg(rbm.num_visible, rbm.num_hidden), b_grad(rbm.num_hidden), c_grad(rbm.num_visible),
             w_inc(0,0), b_inc(0), c_inc(0),
             q_global_t(0.0),
             q_local_batch(rbm.num_hidden), q_local_t(rbm.num_hidden, static_cast<weight>(0.0)),
-            p_h_a(get_batch_size(rbm), rbm.num_hidden), p_h_s(get_batch_size(rbm), rbm.num_hidden)
+            p_h_a(sample_rows(rbm, sampling), rbm.num_hidden), p_h_s(sample_rows(rbm, sampling), rbm.num_hidden),
+            sampling(sampling), pool(rbm.threads)
     {
         static_assert(!rbm_traits<rbm_t>::has_momentum(), "This constructor should only be used without momentum support");
     }
 
     template<bool M = rbm_traits<rbm_t>::has_momentum(), cpp::enable_if_u<M> = cpp::detail::dummy>
-    base_cd_trainer(rbm_t& rbm) :
+    base_cd_trainer(rbm_t& rbm, bool sampling = true) :
             v1(get_batch_size(rbm), rbm.num_visible),
             vf(get_batch_size(rbm), rbm.num_visible),
-            h1_a(get_batch_size(rbm), rbm.num_hidden), h1_s(get_batch_size(rbm), rbm.num_hidden),
-            v2_a(get_batch_size(rbm), rbm.num_visible), v2_s(get_batch_size(rbm), rbm.num_visible),
-            h2_a(get_batch_size(rbm), rbm.num_hidden), h2_s(get_batch_size(rbm), rbm.num_hidden),
-            ht(get_batch_size(rbm), 1UL, rbm.num_hidden), vt(get_batch_size(rbm), rbm.num_visible, 1UL),
-            w_grad_b(get_batch_size(rbm), rbm.num_visible, rbm.num_hidden),
-            w_grad(rbm.num_visible, rbm.num_hidden), b_grad(rbm.num_hidden), c_grad(rbm.num_visible),
+            h1_a(get_batch_size(rbm), rbm.num_hidden), h1_s(sample_rows(rbm, sampling), rbm.num_hidden),
+            v2_a(get_batch_size(rbm), rbm.num_visible), v2_s(sample_rows(rbm, sampling), rbm.num_visible),
+            h2_a(get_batch_size(rbm), rbm.num_hidden), h2_s(sample_rows(rbm, sampling), rbm.num_hidden),
+            ht(get_batch_size(rbm), rbm.num_hidden), vt(get_batch_size(rbm), rbm.num_visible),
+            w_grad(rbm.num_visible, rbm.num_hidden), w_neg(rbm.num_visible, rbm.num_hidden), b_grad(rbm.num_hidden), c_grad(rbm.num_visible),
             w_inc(rbm.num_visible, rbm.num_hidden, static_cast<weight>(0.0)), b_inc(rbm.num_hidden, static_cast<weight>(0.0)), c_inc(rbm.num_visible, static_cast<weight>(0.0)),
             q_global_t(0.0), q_local_batch(rbm.num_hidden), q_local_t(rbm.num_hidden, static_cast<weight>(0.0)),
-            p_h_a(get_batch_size(rbm), rbm.num_hidden), p_h_s(get_batch_size(rbm), rbm.num_hidden)
+            p_h_a(sample_rows(rbm, sampling), rbm.num_hidden), p_h_s(sample_rows(rbm, sampling), rbm.num_hidden),
+            sampling(sampling), pool(rbm.threads)
     {
         static_assert(rbm_traits<rbm_t>::has_momentum(), "This constructor should only be used with momentum support");
     }
@@ -774,8 +1331,69 @@ struct cd_trainer<N, RBM, std::enable_if_t<rbm_traits<RBM>::is_convolutional()>>
     }
 };
 
+/*!
+ * \brief Mean-field Contrastive Divergence trainer for RBM.
+ *
+ * The chain is run on the activation probabilities, without sampling.
+ * The sample buffers are not allocated.
+ */
+template<std::size_t K, typename RBM, typename Enable = void>
+struct mf_cd_trainer : base_cd_trainer<RBM> {
+    static_assert(K > 0, "MF-CD-0 is not a valid training method");
+    static_assert(!rbm_traits<RBM>::is_convolutional(), "Mean-field CD is not supported for convolutional RBM");
+
+    using rbm_t = RBM;
+    using weight = typename rbm_t::weight;
+
+    rbm_t& rbm;
+
+    mf_cd_trainer(rbm_t& rbm) : base_cd_trainer<rbm_t>(rbm, false), rbm(rbm) {
+        //Nothing else to init here
+    }
+
+    template<typename T>
+    void train_batch(const dll::batch<T>& input_batch, const dll::batch<T>& expected_batch, rbm_training_context& context){
+        train_mean_field<K>(input_batch, expected_batch, context, rbm, *this);
+    }
+
+    static std::string name(){
+        return "Mean-field Contrastive Divergence";
+    }
+};
+
+/*!
+ * \brief Mean-field Contrastive Divergence trainer for dynamic RBM.
+ *
+ * The sample buffers are not allocated.
+ */
+template<std::size_t K, typename RBM>
+struct mf_cd_trainer<K, RBM, std::enable_if_t<rbm_traits<RBM>::is_dynamic()>> : base_cd_trainer<RBM> {
+    static_assert(K > 0, "MF-CD-0 is not a valid training method");
+
+    using rbm_t = RBM;
+    using weight = typename rbm_t::weight;
+
+    rbm_t& rbm;
+
+    mf_cd_trainer(rbm_t& rbm) : base_cd_trainer<RBM>(rbm, false), rbm(rbm) {
+        //Nothing else to init here
+    }
+
+    template<typename T>
+    void train_batch(const dll::batch<T>& input_batch, const dll::batch<T>& expected_batch, rbm_training_context& context){
+        train_mean_field<K>(input_batch, expected_batch, context, rbm, *this);
+    }
+
+    static std::string name(){
+        return "Mean-field Contrastive Divergence";
+    }
+};
+
 /*!
  * \brief Persistent Contrastive Divergence Trainer for RBM.
+ *
+ * The number of persistent chains can be configured with pcd_chains<N>
+ * and defaults to the batch size.
  */
 template<std::size_t K, typename RBM, typename Enable = void>
 struct persistent_cd_trainer : base_cd_trainer<RBM> {
@@ -851,18 +1469,167 @@ struct persistent_cd_trainer<N, RBM, std::enable_if_t<rbm_traits<RBM>::is_convol
     }
 };
 
+/*!
+ * \brief Fast Persistent Contrastive Divergence Trainer for RBM.
+ *
+ * The persistent chains are run with the sum of the regular weights and of
+ * the fast weights.
+ */
+template<std::size_t K, typename RBM, typename Enable = void>
+struct fast_persistent_cd_trainer : base_cd_trainer<RBM> {
+    static_assert(K > 0, "FPCD-0 is not a valid training method");
+
+    typedef RBM rbm_t;
+    typedef typename rbm_t::weight weight;
+
+    rbm_t& rbm;
+
+    fast_weights<rbm_t> fast;
+
+    fast_persistent_cd_trainer(rbm_t& rbm) : base_cd_trainer<RBM>(rbm), rbm(rbm), fast(rbm) {
+        //Nothing else to init here
+    }
+
+    const auto& negative_w(const rbm_t&) const {
+        return fast.w_c;
+    }
+
+    const auto& negative_b(const rbm_t&) const {
+        return fast.b_c;
+    }
+
+    const auto& negative_c(const rbm_t&) const {
+        return fast.c_c;
+    }
+
+    void update(rbm_t& rbm){
+        update_normal(rbm, *this);
+        fast.update(rbm, *this);
+    }
+
+    template<typename T>
+    void train_batch(const dll::batch<T>& input_batch, const dll::batch<T>& expected_batch, rbm_training_context& context){
+        train_normal<true, K>(input_batch, expected_batch, context, rbm, *this);
+    }
+
+    static std::string name(){
+        return "Fast Persistent Contrastive Divergence";
+    }
+};
+
+/*!
+ * \brief Fast Persistent Contrastive Divergence Trainer for dynamic RBM.
+ */
+template<std::size_t K, typename RBM>
+struct fast_persistent_cd_trainer<K, RBM, std::enable_if_t<rbm_traits<RBM>::is_dynamic()>> : base_cd_trainer<RBM> {
+    static_assert(K > 0, "FPCD-0 is not a valid training method");
+
+    typedef RBM rbm_t;
+    typedef typename rbm_t::weight weight;
+
+    rbm_t& rbm;
+
+    fast_weights<rbm_t> fast;
+
+    fast_persistent_cd_trainer(rbm_t& rbm) : base_cd_trainer<RBM>(rbm), rbm(rbm), fast(rbm) {
+        //Nothing else to init
+    }
+
+    const auto& negative_w(const rbm_t&) const {
+        return fast.w_c;
+    }
+
+    const auto& negative_b(const rbm_t&) const {
+        return fast.b_c;
+    }
+
+    const auto& negative_c(const rbm_t&) const {
+        return fast.c_c;
+    }
+
+    void update(rbm_t& rbm){
+        update_normal(rbm, *this);
+        fast.update(rbm, *this);
+    }
+
+    template<typename T>
+    void train_batch(const dll::batch<T>& input_batch, const dll::batch<T>& expected_batch, rbm_training_context& context){
+        train_normal<true, K>(input_batch, expected_batch, context, rbm, *this);
+    }
+
+    static std::string name(){
+        return "Fast Persistent Contrastive Divergence";
+    }
+};
+
+/*!
+ * \brief Specialization of fast_persistent_cd_trainer for Convolutional RBM.
+ */
+template<std::size_t N, typename RBM>
+struct fast_persistent_cd_trainer<N, RBM, std::enable_if_t<rbm_traits<RBM>::is_convolutional()>> : base_cd_trainer<RBM> {
+    static_assert(N > 0, "FPCD-0 is not a valid training method");
+
+    typedef RBM rbm_t;
+
+    rbm_t& rbm;
+
+    fast_weights<rbm_t> fast;
+
+    fast_persistent_cd_trainer(rbm_t& rbm) : base_cd_trainer<RBM>(rbm), rbm(rbm), fast(rbm) {
+        //Nothing else to init here
+    }
+
+    const auto& negative_w(const rbm_t&) const {
+        return fast.w_c;
+    }
+
+    const auto& negative_b(const rbm_t&) const {
+        return fast.b_c;
+    }
+
+    const auto& negative_c(const rbm_t&) const {
+        return fast.c_c;
+    }
+
+    void update(rbm_t& rbm){
+        update_convolutional(rbm, *this);
+        fast.update(rbm, *this);
+    }
+
+    template<typename T>
+    void train_batch(const dll::batch<T>& input_batch, const dll::batch<T>& expected_batch, rbm_training_context& context){
+        train_convolutional<true, N>(input_batch, expected_batch, context, rbm, *this);
+    }
+
+    static std::string name(){
+        return "Fast Persistent Contrastive Divergence (convolutional)";
+    }
+};
+
 /*!
  * \brief CD-1 trainer for RBM
  */
 template <typename RBM>
 using cd1_trainer_t = cd_trainer<1, RBM>;
 
+/*!
+ * \brief Mean-field CD-1 trainer for RBM
+ */
+template <typename RBM>
+using mf_cd1_trainer_t = mf_cd_trainer<1, RBM>;
+
 /*!
  * \brief PCD-1 trainer for RBM
  */
 template <typename RBM>
 using pcd1_trainer_t = persistent_cd_trainer<1, RBM>;
 
+/*!
+ * \brief FPCD-1 trainer for RBM
+ */
+template <typename RBM>
+using fpcd1_trainer_t = fast_persistent_cd_trainer<1, RBM>;
+
 } //end of dll namespace
 
 #endif
@@ -17,7 +17,10 @@
 #include "io.hpp"
 #include "dbn_trainer.hpp"
 #include "dbn_common.hpp"
+#include "workspace.hpp"
+#include "topk.hpp"
 #include "svm_common.hpp"
+#include "model_file.hpp"
 
 namespace dll {
 
@@ -39,6 +42,8 @@ struct conv_dbn final {
 
     using weight = typename rbm_type<0>::weight;
 
+    using workspace = dbn_workspace<this_type>; ///< The buffers used for inference
+
 #ifdef DLL_SVM_SUPPORT
     svm::model svm_model;               ///< The learned model
     svm::problem problem;               ///< libsvm is stupid, therefore, you cannot destroy the problem if you want to use the model...
@@ -75,28 +80,43 @@ struct conv_dbn final {
         store(os);
     }
 
-    void load(const std::string& file){
+    /*!
+     * \brief Load the network from the given file.
+     *
+     * \return false if the file does not contain a model of this network or
+     * if the model is corrupted
+     */
+    bool load(const std::string& file){
+        std::ifstream is(file, std::ifstream::binary);
+        return load(is);
+    }
+
+    /*!
+     * \brief Load only the weights of the Nth layer from the given file
+     */
+    template<std::size_t N>
+    bool load_layer(const std::string& file){
         std::ifstream is(file, std::ifstream::binary);
-        load(is);
+        return read_model_layer(is, N, layer<N>());
     }
 
     void store(std::ostream& os) const {
-        cpp::for_each(tuples, [&os](auto& rbm){
-            rbm.store(os);
-        });
+        write_model(os, tuples);
 
 #ifdef DLL_SVM_SUPPORT
         svm_store(*this, os);
 #endif //DLL_SVM_SUPPORT
     }
 
-    void load(std::istream& is){
-        cpp::for_each(tuples, [&is](auto& rbm){
-            rbm.load(is);
-        });
+    bool load(std::istream& is){
+        if(!read_model(is, tuples)){
+            return false;
+        }
 
 #ifdef DLL_SVM_SUPPORT
-        svm_load(*this, is);
+        return svm_load(*this, is);
+#else
+        return true;
 #endif //DLL_SVM_SUPPORT
     }
 
@@ -180,6 +200,18 @@ struct conv_dbn final {
         rbm.activate_hidden(next_a, next_s, rbm.v1, rbm.v1);
     }
 
+    template<typename RBM, typename Input, typename Workspace, cpp::enable_if_u<rbm_traits<RBM>::has_probabilistic_max_pooling()> = cpp::detail::dummy>
+    static void propagate(const RBM& rbm, const Input& input, Workspace& ws){
+        ws.buffers->v = input;
+        rbm.activate_pooling(ws.a, ws.s, ws.buffers->v, ws.buffers->v, ws.buffers->v_cv);
+    }
+
+    template<typename RBM, typename Input, typename Workspace, cpp::disable_if_u<rbm_traits<RBM>::has_probabilistic_max_pooling()> = cpp::detail::dummy>
+    static void propagate(const RBM& rbm, const Input& input, Workspace& ws){
+        ws.buffers->v = input;
+        rbm.activate_hidden(ws.a, ws.s, ws.buffers->v, ws.buffers->v, ws.buffers->v_cv);
+    }
+
     /*!
      * \brief Pretrain the network by training all layers in an unsupervised
      * manner.
@@ -255,50 +287,46 @@ struct conv_dbn final {
 
     /*{{{ Predict */
 
-    template<typename Sample, typename Output>
-    void activation_probabilities(const Sample& item_data, Output& result){
+    /*!
+     * \brief Propagate a sample through all the layers, using the buffers
+     * of the given workspace.
+     *
+     * \return the activation probabilities of the last layer (stored in the workspace)
+     */
+    template<typename Sample>
+    const etl::dyn_matrix<weight, 3>& forward(const Sample& item_data, workspace& ws) const {
         using visible_t = etl::dyn_matrix<weight, 3>;
-        using hidden_t = etl::dyn_matrix<weight, 3>;
-
-        visible_t item(rbm_type<0>::NC, rbm_type<0>::NV, rbm_type<0>::NV);
-
-        item = item_data;
-
-        auto input = std::cref(item);
-
-        cpp::for_each_i(tuples, [&input](std::size_t I, auto& rbm){
-            if(I != layers - 1){
-                using rbm_t = typename std::remove_reference<decltype(rbm)>::type;
 
-                constexpr const auto K = rbm_t::K;
-                constexpr const auto NO = this_type::rbm_t_no<rbm_t>();
+        ws.input = item_data;
 
-                static hidden_t next_a(K, NO, NO);
-                static hidden_t next_s(K, NO, NO);
+        auto input = std::cref(ws.input);
 
-                this_type::propagate(rbm, static_cast<const visible_t&>(input), next_a, next_s);
+        for_each_layer(tuples, ws.layers, [&input](std::size_t, const auto& rbm, auto& lws){
+            this_type::propagate(rbm, static_cast<const visible_t&>(input), lws);
 
-                input = std::cref(next_a);
-            }
+            input = std::cref(lws.a);
         });
 
-        constexpr const auto K = rbm_k<layers - 1>();
-        constexpr const auto NO = rbm_no<layers - 1>();
-
-        static hidden_t next_a(K, NO, NO);
-        static hidden_t next_s(K, NO, NO);
-
-        auto& last_rbm = layer<layers - 1>();
+        return ws.template layer<layers - 1>().a;
+    }
 
-        propagate(last_rbm, static_cast<const visible_t&>(input), next_a, next_s);
+    template<typename Sample, typename Output>
+    void activation_probabilities(const Sample& item_data, Output& result, workspace& ws) const {
+        const auto& output = forward(item_data, ws);
 
         for(std::size_t i = 0; i < output_size(); ++i){
-            result[i] = next_a[i];
+            result[i] = output[i];
         }
     }
 
+    template<typename Sample, typename Output>
+    void activation_probabilities(const Sample& item_data, Output& result) const {
+        workspace ws(*this);
+        activation_probabilities(item_data, result, ws);
+    }
+
     template<typename Sample>
-    etl::dyn_vector<weight> activation_probabilities(const Sample& item_data){
+    etl::dyn_vector<weight> activation_probabilities(const Sample& item_data) const {
         etl::dyn_vector<weight> result(output_size());
 
         activation_probabilities(item_data, result);
@@ -307,54 +335,26 @@ struct conv_dbn final {
     }
 
     template<typename Sample, typename Output>
-    void full_activation_probabilities(const Sample& item_data, Output& result){
-        using visible_t = etl::dyn_matrix<weight, 3>;
-        using hidden_t = etl::dyn_matrix<weight, 3>;
-
-        visible_t item(rbm_type<0>::NC, rbm_type<0>::NV, rbm_type<0>::NV);
+    void full_activation_probabilities(const Sample& item_data, Output& result, workspace& ws) const {
+        forward(item_data, ws);
 
         std::size_t i = 0;
 
-        item = item_data;
-
-        auto input = std::cref(item);
-
-        cpp::for_each_i(tuples, [&i, &input, &result](std::size_t I, auto& rbm){
-            if(I != layers - 1){
-                typedef typename std::remove_reference<decltype(rbm)>::type rbm_t;
-                constexpr const auto K = rbm_t::K;
-                constexpr const auto NO = this_type::rbm_t_no<rbm_t>();
-
-                static hidden_t next_a(K, NO, NO);
-                static hidden_t next_s(K, NO, NO);
-
-                this_type::propagate(rbm, static_cast<const visible_t&>(input), next_a, next_s);
-
-                for(auto& value : next_a){
-                    result[i++] = value;
-                }
-
-                input = std::cref(next_a);
+        for_each_layer(tuples, ws.layers, [&i, &result](std::size_t, const auto&, auto& lws){
+            for(auto& value : lws.a){
+                result[i++] = value;
             }
         });
+    }
 
-        constexpr const auto K = rbm_k<layers - 1>();
-        constexpr const auto NO = rbm_no<layers - 1>();
-
-        static hidden_t next_a(K, NO, NO);
-        static hidden_t next_s(K, NO, NO);
-
-        auto& last_rbm = layer<layers - 1>();
-
-        propagate(last_rbm, static_cast<const visible_t&>(input), next_a, next_s);
-
-        for(auto& value : next_a){
-            result[i++] = value;
-        }
+    template<typename Sample, typename Output>
+    void full_activation_probabilities(const Sample& item_data, Output& result) const {
+        workspace ws(*this);
+        full_activation_probabilities(item_data, result, ws);
     }
 
     template<typename Sample>
-    etl::dyn_vector<weight> full_activation_probabilities(const Sample& item_data){
+    etl::dyn_vector<weight> full_activation_probabilities(const Sample& item_data) const {
         etl::dyn_vector<weight> result(full_output_size());
 
         full_activation_probabilities(item_data, result);
@@ -363,7 +363,7 @@ struct conv_dbn final {
     }
 
     template<typename Weights>
-    size_t predict_label(const Weights& result){
+    size_t predict_label(const Weights& result) const {
         size_t label = 0;
         weight max = 0;
         for(size_t l = 0; l < result.size(); ++l){
@@ -378,10 +378,73 @@ struct conv_dbn final {
         return label;
     }
 
+    /*!
+     * \brief Predict the label of a sample, using the buffers of the given
+     * workspace. Several threads can predict concurrently with the same
+     * network, as long as each one uses its own workspace.
+     */
     template<typename Sample>
-    size_t predict(const Sample& item){
-        auto result = activation_probabilities(item);
-        return predict_label(result);;
+    size_t predict(const Sample& item, workspace& ws) const {
+        return predict_label(forward(item, ws));
+    }
+
+    template<typename Sample>
+    size_t predict(const Sample& item) const {
+        workspace ws(*this);
+        return predict(item, ws);
+    }
+
+    /*!
+     * \brief Compute the activation probabilities of the last layer for a
+     * batch of samples.
+     *
+     * Each row of inputs is a sample and each row of result receives the
+     * output of the corresponding sample. The samples are convolved one
+     * after another, reusing the same buffers.
+     */
+    template<typename Input, typename Output>
+    void activation_probabilities_batch(const Input& inputs, Output& result) const {
+        workspace ws(*this);
+
+        for(std::size_t i = 0; i < etl::rows(inputs); ++i){
+            const auto& output = forward(inputs(i), ws);
+
+            for(std::size_t j = 0; j < output_size(); ++j){
+                result(i, j) = output[j];
+            }
+        }
+    }
+
+    /*!
+     * \brief Predict the labels of a batch of samples.
+     *
+     * Each row of inputs is a sample, the label of the i-th sample is
+     * written in labels[i].
+     */
+    template<typename Input, typename Labels>
+    void predict_batch(const Input& inputs, Labels& labels) const {
+        workspace ws(*this);
+
+        for(std::size_t i = 0; i < etl::rows(inputs); ++i){
+            labels[i] = predict_label(forward(inputs(i), ws));
+        }
+    }
+
+    /*!
+     * \brief Predict the k best labels of a batch of samples, with their
+     * scores.
+     *
+     * Each row of inputs is a sample. The labels of the i-th sample are
+     * written, from the best to the worst, in indices[i * k .. (i + 1) * k)
+     * and their activation probabilities at the same positions in scores.
+     */
+    template<typename Input, typename Indices, typename Scores>
+    void predict_topk(const Input& inputs, std::size_t k, Indices& indices, Scores& scores) const {
+        workspace ws(*this);
+
+        for(std::size_t i = 0; i < etl::rows(inputs); ++i){
+            select_topk(forward(inputs(i), ws), output_size(), k, &indices[i * k], &scores[i * k]);
+        }
     }
 
     /*}}}*/
@@ -23,6 +23,8 @@
 #include "io.hpp"                 //Binary load/store functions
 #include "tmp.hpp"
 #include "checks.hpp"
+#include "random.hpp"             //Random streams
+#include "free_energy.hpp"        //Batched free energy
 
 namespace dll {
 
@@ -98,7 +100,17 @@ struct conv_rbm final : public standard_conv_rbm<conv_rbm<Desc>, Desc> {
     }
 
     template<typename H1, typename H2, typename V1, typename V2, typename VCV>
-    void activate_hidden(H1&& h_a, H2&& h_s, const V1& v_a, const V2&, VCV&& v_cv){
+    void activate_hidden(H1&& h_a, H2&& h_s, const V1& v_a, const V2& v_s, VCV&& v_cv) const {
+        activate_hidden(std::forward<H1>(h_a), std::forward<H2>(h_s), v_a, v_s, b, w, std::forward<VCV>(v_cv));
+    }
+
+    template<typename H1, typename H2, typename V1, typename V2, typename HCV>
+    void activate_visible(const H1& h_a, const H2& h_s, V1&& v_a, V2&& v_s, HCV&& h_cv) const {
+        activate_visible(h_a, h_s, std::forward<V1>(v_a), std::forward<V2>(v_s), c, w, std::forward<HCV>(h_cv));
+    }
+
+    template<typename H1, typename H2, typename V1, typename V2, typename B, typename W, typename VCV>
+    void activate_hidden(H1&& h_a, H2&& h_s, const V1& v_a, const V2&, const B& b, const W& w, VCV&& v_cv) const {
         using namespace etl;
 
         v_cv(NC) = 0;
@@ -113,16 +125,16 @@ struct conv_rbm final : public standard_conv_rbm<conv_rbm<Desc>, Desc> {
 
         if(hidden_unit == unit_type::BINARY){
             h_a = sigmoid(etl::rep<NH, NH>(b) + v_cv(NC));
-            h_s = bernoulli(h_a);
+            sample_bernoulli(h_s, h_a);
         } else if(hidden_unit == unit_type::RELU){
             h_a = max(etl::rep<NH, NH>(b) + v_cv(NC), 0.0);
-            h_s = logistic_noise(h_a);
+            sample_logistic_noise(h_s, h_a);
         } else if(hidden_unit == unit_type::RELU6){
             h_a = min(max(etl::rep<NH, NH>(b) + v_cv(NC), 0.0), 6.0);
-            h_s = ranged_noise(h_a, 6.0);
+            sample_ranged_noise(h_s, h_a, 6.0);
         } else if(hidden_unit == unit_type::RELU1){
             h_a = min(max(etl::rep<NH, NH>(b) + v_cv(NC), 0.0), 1.0);
-            h_s = ranged_noise(h_a, 1.0);
+            sample_ranged_noise(h_s, h_a, 1.0);
         } else {
             cpp_unreachable("Invalid path");
         }
@@ -131,10 +143,13 @@ struct conv_rbm final : public standard_conv_rbm<conv_rbm<Desc>, Desc> {
         nan_check_deep(h_s);
     }
 
-    template<typename H1, typename H2, typename V1, typename V2, typename HCV>
-    void activate_visible(const H1&, const H2& h_s, V1&& v_a, V2&& v_s, HCV&& h_cv){
+    template<typename H1, typename H2, typename V1, typename V2, typename Bias, typename W, typename HCV>
+    void activate_visible(const H1&, const H2& h_s, V1&& v_a, V2&& v_s, const Bias& c, const W& w, HCV&& h_cv) const {
         using namespace etl;
 
+        //One sampling pass, the channels use different units of the stream
+        const auto stream = next_random_stream();
+
         for(std::size_t channel = 0; channel < NC; ++channel){
             h_cv(K) = 0.0;
 
@@ -145,10 +160,10 @@ struct conv_rbm final : public standard_conv_rbm<conv_rbm<Desc>, Desc> {
 
             if(visible_unit == unit_type::BINARY){
                 v_a(channel) = sigmoid(c(channel) + h_cv(K));
-                v_s(channel) = bernoulli(v_a(channel));
+                sample_bernoulli(v_s(channel), v_a(channel), stream.shift(channel * NV * NV));
             } else if(visible_unit == unit_type::GAUSSIAN){
                 v_a(channel) = c(channel) + h_cv(K);
-                v_s(channel) = normal_noise(v_a(channel));
+                sample_normal_noise(v_s(channel), v_a(channel), stream.shift(channel * NV * NV));
             } else {
                 cpp_unreachable("Invalid path");
             }
@@ -177,7 +192,7 @@ struct conv_rbm final : public standard_conv_rbm<conv_rbm<Desc>, Desc> {
             return - etl::sum(c * etl::sum_r(v)) - etl::sum(b * etl::sum_r(h)) - etl::sum(h * v_cv(NC));
         } else if(desc::visible_unit == unit_type::GAUSSIAN && desc::hidden_unit == unit_type::BINARY){
             //Definition according to Honglak Lee / Mixed with Gaussian
-            //E(v,h) = - sum_k hk . (Wk*v) - sum_k bk sum_h hk - sum_v ((v - c) ^ 2 / 2)
+            //E(v,h) = - sum_k hk . (Wk*v) - sum_k bk sum_h hk + sum_v ((v - c) ^ 2 / 2)
 
             v_cv(NC) = 0;
 
@@ -189,7 +204,7 @@ struct conv_rbm final : public standard_conv_rbm<conv_rbm<Desc>, Desc> {
                 v_cv(NC) += v_cv(channel);
             }
 
-            return -sum(etl::pow(v - etl::rep<NV, NV>(c), 2) / 2.0) - etl::sum(b * etl::sum_r(h)) - etl::sum(h * v_cv(NC));
+            return sum(etl::pow(v - etl::rep<NV, NV>(c), 2) / 2.0) - etl::sum(b * etl::sum_r(h)) - etl::sum(h * v_cv(NC));
         } else {
             return 0.0;
         }
@@ -239,7 +254,7 @@ struct conv_rbm final : public standard_conv_rbm<conv_rbm<Desc>, Desc> {
 
             auto x = etl::rep<NH, NH>(b) + v_cv(NC);
 
-            return -sum(etl::pow(v - etl::rep<NV, NV>(c), 2) / 2.0) - etl::sum(etl::log(1.0 + etl::exp(x)));
+            return sum(etl::pow(v - etl::rep<NV, NV>(c), 2) / 2.0) - etl::sum(etl::log(1.0 + etl::exp(x)));
         } else {
             return 0.0;
         }
@@ -255,6 +270,83 @@ struct conv_rbm final : public standard_conv_rbm<conv_rbm<Desc>, Desc> {
     weight free_energy() const {
         return free_energy_impl(v1);
     }
+
+    /*!
+     * \brief Compute the free energy of each of the given samples.
+     *
+     * The samples are either the first dimension of an ETL matrix or a
+     * container of samples. energies[i] is set to the free energy of the
+     * ith sample.
+     */
+    template<typename Samples, typename Energies>
+    void free_energy_batch(const Samples& samples, Energies&& energies) const {
+        thread_pool<false> pool;
+        free_energy_batch(pool, samples, energies);
+    }
+
+    /*!
+     * \brief Compute the free energy of each of the given samples, the
+     * samples being distributed on the given thread pool.
+     *
+     * Contrary to free_energy(v), this does not use the buffers of the RBM,
+     * but buffers owned by each thread.
+     */
+    template<bool Parallel, typename Samples, typename Energies>
+    void free_energy_batch(thread_pool<Parallel>& pool, const Samples& samples, Energies&& energies) const {
+        constexpr const bool binary_visible = desc::visible_unit == unit_type::BINARY;
+        constexpr const bool gaussian_visible = desc::visible_unit == unit_type::GAUSSIAN;
+
+        const std::size_t n = detail::batch_samples(samples);
+
+        if(desc::hidden_unit != unit_type::BINARY || !(binary_visible || gaussian_visible)){
+            for(std::size_t i = 0; i < n; ++i){
+                energies[i] = 0.0;
+            }
+
+            return;
+        }
+
+        for_each_block(pool, n, 1, [&](std::size_t first, std::size_t last){
+            thread_local etl::dyn_matrix<weight, 3> v(NC, NV, NV);
+            thread_local etl::dyn_matrix<weight, 3> x(K, NH, NH);
+            thread_local etl::dyn_matrix<weight, 3> t(K, NH, NH);
+
+            for(std::size_t i = first; i < last; ++i){
+                v = detail::batch_sample(samples, i);
+
+                //x = sum over the channels of v(channel) * W(channel)
+                x = 0.0;
+
+                for(std::size_t channel = 0; channel < NC; ++channel){
+                    for(size_t k = 0; k < K; ++k){
+                        etl::convolve_2d_valid(v(channel), fflip(w(channel)(k)), t(k));
+                    }
+
+                    x += t;
+                }
+
+                weight visible = 0.0;
+
+                if(binary_visible){
+                    visible = -etl::sum(c * etl::sum_r(v));
+                } else {
+                    visible = etl::sum(etl::pow(v - etl::rep<NV, NV>(c), 2) / 2.0);
+                }
+
+                weight hidden = 0.0;
+
+                for(std::size_t k = 0; k < K; ++k){
+                    for(std::size_t p = 0; p < NH; ++p){
+                        for(std::size_t q = 0; q < NH; ++q){
+                            hidden += stable_softplus(b(k) + x(k, p, q));
+                        }
+                    }
+                }
+
+                energies[i] = visible - hidden;
+            }
+        });
+    }
 };
 
 } //end of dll namespace
@@ -24,6 +24,7 @@
 #include "io.hpp"                 //Binary load/store functions
 #include "tmp.hpp"
 #include "checks.hpp"
+#include "random.hpp"             //Random streams
 
 namespace dll {
 
@@ -109,7 +110,17 @@ struct conv_rbm_mp final : public standard_conv_rbm<conv_rbm_mp<Desc>, Desc> {
     }
 
     template<typename H1, typename H2, typename V1, typename V2, typename VCV>
-    void activate_hidden(H1&& h_a, H2&& h_s, const V1& v_a, const V2&, VCV&& v_cv){
+    void activate_hidden(H1&& h_a, H2&& h_s, const V1& v_a, const V2& v_s, VCV&& v_cv) const {
+        activate_hidden(std::forward<H1>(h_a), std::forward<H2>(h_s), v_a, v_s, b, w, std::forward<VCV>(v_cv));
+    }
+
+    template<typename H1, typename H2, typename V1, typename V2, typename HCV>
+    void activate_visible(const H1& h_a, const H2& h_s, V1&& v_a, V2&& v_s, HCV&& h_cv) const {
+        activate_visible(h_a, h_s, std::forward<V1>(v_a), std::forward<V2>(v_s), c, w, std::forward<HCV>(h_cv));
+    }
+
+    template<typename H1, typename H2, typename V1, typename V2, typename B, typename W, typename VCV>
+    void activate_hidden(H1&& h_a, H2&& h_s, const V1& v_a, const V2&, const B& b, const W& w, VCV&& v_cv) const {
         v_cv(NC) = 0;
 
         for(std::size_t channel = 0; channel < NC; ++channel){
@@ -122,16 +133,16 @@ struct conv_rbm_mp final : public standard_conv_rbm<conv_rbm_mp<Desc>, Desc> {
 
         if(hidden_unit == unit_type::BINARY){
             h_a = etl::p_max_pool_h<C, C>(etl::rep<NH, NH>(b) + v_cv(NC));
-            h_s = bernoulli(h_a);
+            sample_bernoulli(h_s, h_a);
         } else if(hidden_unit == unit_type::RELU){
             h_a = max(etl::rep<NH, NH>(b) + v_cv(NC), 0.0);
-            h_s = logistic_noise(h_a);
+            sample_logistic_noise(h_s, h_a);
         } else if(hidden_unit == unit_type::RELU6){
             h_a = min(max(etl::rep<NH, NH>(b) + v_cv(NC), 0.0), 6.0);
-            h_s = ranged_noise(h_a, 6.0);
+            sample_ranged_noise(h_s, h_a, 6.0);
         } else if(hidden_unit == unit_type::RELU1){
             h_a = min(max(etl::rep<NH, NH>(b) + v_cv(NC), 0.0), 1.0);
-            h_s = ranged_noise(h_a, 1.0);
+            sample_ranged_noise(h_s, h_a, 1.0);
         } else {
             cpp_unreachable("Invalid path");
         }
@@ -140,10 +151,13 @@ struct conv_rbm_mp final : public standard_conv_rbm<conv_rbm_mp<Desc>, Desc> {
         nan_check_deep(h_s);
     }
 
-    template<typename H1, typename H2, typename V1, typename V2, typename HCV>
-    void activate_visible(const H1&, const H2& h_s, V1&& v_a, V2&& v_s, HCV&& h_cv){
+    template<typename H1, typename H2, typename V1, typename V2, typename Bias, typename W, typename HCV>
+    void activate_visible(const H1&, const H2& h_s, V1&& v_a, V2&& v_s, const Bias& c, const W& w, HCV&& h_cv) const {
         using namespace etl;
 
+        //One sampling pass, the channels use different units of the stream
+        const auto stream = next_random_stream();
+
         for(std::size_t channel = 0; channel < NC; ++channel){
             h_cv(K) = 0.0;
 
@@ -154,10 +168,10 @@ struct conv_rbm_mp final : public standard_conv_rbm<conv_rbm_mp<Desc>, Desc> {
 
             if(visible_unit == unit_type::BINARY){
                 v_a(channel) = sigmoid(c(channel) + h_cv(K));
-                v_s(channel) = bernoulli(v_a(channel));
+                sample_bernoulli(v_s(channel), v_a(channel), stream.shift(channel * NV * NV));
             } else if(visible_unit == unit_type::GAUSSIAN){
                 v_a(channel) = c(channel) + h_cv(K);
-                v_s(channel) = normal_noise(v_a(channel));
+                sample_normal_noise(v_s(channel), v_a(channel), stream.shift(channel * NV * NV));
             } else {
                 cpp_unreachable("Invalid path");
             }
@@ -168,7 +182,12 @@ struct conv_rbm_mp final : public standard_conv_rbm<conv_rbm_mp<Desc>, Desc> {
     }
 
     template<typename P, typename V>
-    void activate_pooling(P& p_a, P& p_s, const V& v_a, const V&){
+    void activate_pooling(P& p_a, P& p_s, const V& v_a, const V& v_s){
+        activate_pooling(p_a, p_s, v_a, v_s, v_cv);
+    }
+
+    template<typename P, typename V, typename VCV>
+    void activate_pooling(P& p_a, P& p_s, const V& v_a, const V&, VCV&& v_cv) const {
         v_cv(NC) = 0;
 
         for(std::size_t channel = 0; channel < NC; ++channel){
@@ -181,7 +200,7 @@ struct conv_rbm_mp final : public standard_conv_rbm<conv_rbm_mp<Desc>, Desc> {
 
         if(pooling_unit == unit_type::BINARY){
             p_a = etl::p_max_pool_p<C, C>(etl::rep<NH, NH>(b) + v_cv(NC));
-            p_s = r_bernoulli(p_a);
+            sample_r_bernoulli(p_s, p_a);
         } else {
             cpp_unreachable("Invalid path");
         }
@@ -16,7 +16,10 @@
 #include "dbn_trainer.hpp"
 #include "conjugate_gradient.hpp"
 #include "dbn_common.hpp"
+#include "workspace.hpp"
+#include "topk.hpp"
 #include "svm_common.hpp"
+#include "model_file.hpp"
 
 namespace dll {
 
@@ -39,6 +42,9 @@ struct dbn final {
     //TODO Could be good to ensure that either a) all rbm have the same weight b) use the correct type for each rbm
     using weight = typename rbm_type<0>::weight;
 
+    using workspace = dbn_workspace<this_type>; ///< The buffers used for inference
+    using batch_workspace = dbn_batch_workspace<this_type>; ///< The buffers used for batched inference
+
     weight learning_rate = 0.77;
 
     weight initial_momentum = 0.5;      ///< The initial momentum
@@ -89,31 +95,54 @@ struct dbn final {
         store(os);
     }
 
-    void load(const std::string& file){
+    /*!
+     * \brief Load the network from the given file.
+     *
+     * \return false if the file does not contain a model of this network or
+     * if the model is corrupted
+     */
+    bool load(const std::string& file){
+        std::ifstream is(file, std::ifstream::binary);
+        return load(is);
+    }
+
+    /*!
+     * \brief Load only the weights of the Nth layer from the given file
+     */
+    template<std::size_t N>
+    bool load_layer(const std::string& file){
         std::ifstream is(file, std::ifstream::binary);
-        load(is);
+        return load_layer<N>(is);
     }
 
     void store(std::ostream& os) const {
-        cpp::for_each(tuples, [&os](auto& rbm){
-            rbm.store(os);
-        });
+        write_model(os, tuples);
 
 #ifdef DLL_SVM_SUPPORT
         svm_store(*this, os);
 #endif //DLL_SVM_SUPPORT
     }
 
-    void load(std::istream& is){
-        cpp::for_each(tuples, [&is](auto& rbm){
-            rbm.load(is);
-        });
+    bool load(std::istream& is){
+        if(!read_model(is, tuples)){
+            return false;
+        }
 
 #ifdef DLL_SVM_SUPPORT
-        svm_load(*this, is);
+        return svm_load(*this, is);
+#else
+        return true;
 #endif //DLL_SVM_SUPPORT
     }
 
+    /*!
+     * \brief Load only the weights of the Nth layer from the given stream
+     */
+    template<std::size_t N>
+    bool load_layer(std::istream& is){
+        return read_model_layer(is, N, layer<N>());
+    }
+
     template<std::size_t N>
     auto layer() -> typename std::add_lvalue_reference<rbm_type<N>>::type {
         return std::get<N>(tuples);
@@ -167,6 +196,24 @@ struct dbn final {
      */
     template<typename Iterator>
     void pretrain(Iterator first, Iterator last, std::size_t max_epochs){
+        if(rbm_traits<rbm_type<0>>::has_shuffle()){
+            //The first layer shuffles its inputs in place, it is trained on a
+            //copy of the samples in their own type, which are only views for
+            //a mapped dataset
+            std::vector<std::decay_t<decltype(*first)>> samples(first, last);
+            pretrain_samples(samples.begin(), samples.end(), max_epochs);
+        } else {
+            pretrain_samples(first, last, max_epochs);
+        }
+    }
+
+private:
+    /*!
+     * \brief Pretrain the network, the first layer being directly trained on
+     * the samples.
+     */
+    template<typename Iterator>
+    void pretrain_samples(Iterator first, Iterator last, std::size_t max_epochs){
         using training_t = std::vector<etl::dyn_vector<weight>>;
 
         using watcher_t = typename desc::template watcher_t<this_type>;
@@ -175,57 +222,70 @@ struct dbn final {
 
         watcher.pretraining_begin(*this);
 
-        //Convert data to an useful form
-        training_t data;
-        data.reserve(std::distance(first, last));
-
-        std::for_each(first, last, [&data](auto& sample){
-            data.emplace_back(sample);
-        });
+        const std::size_t n = std::distance(first, last);
 
+        //The inputs of the current layer and of the next layer
+        training_t input;
         training_t next_a;
         training_t next_s;
 
-        auto input = std::ref(data);
-
-        cpp::for_each_i(tuples, [&watcher, this, &input, &next_a, &next_s, max_epochs](std::size_t I, auto& rbm){
+        cpp::for_each_i(tuples, [&watcher, this, &first, &last, n, &input, &next_a, &next_s, max_epochs](std::size_t I, auto& rbm){
             typedef typename std::remove_reference<decltype(rbm)>::type rbm_t;
             constexpr const auto num_hidden = rbm_t::num_hidden;
 
-            auto input_size = static_cast<training_t&>(input).size();
+            watcher.template pretrain_layer<rbm_t>(*this, I, n);
 
-            watcher.template pretrain_layer<rbm_t>(*this, I, input_size);
-
-            rbm.template train<
-                    training_t,
-                    !watcher_t::ignore_sub,                                 //Enable the RBM Watcher or not
-                    typename dbn_detail::rbm_watcher_t<watcher_t>::type>    //Replace the RBM watcher if not void
-                (static_cast<training_t&>(input), max_epochs);
+            if(I == 0){
+                rbm.template train<
+                        Iterator&,
+                        !watcher_t::ignore_sub,                                 //Enable the RBM Watcher or not
+                        typename dbn_detail::rbm_watcher_t<watcher_t>::type>    //Replace the RBM watcher if not void
+                    (first, last, max_epochs);
+            } else {
+                rbm.template train<
+                        training_t,
+                        !watcher_t::ignore_sub,                                 //Enable the RBM Watcher or not
+                        typename dbn_detail::rbm_watcher_t<watcher_t>::type>    //Replace the RBM watcher if not void
+                    (input, max_epochs);
+            }
 
             //Get the activation probabilities for the next level
             if(I < layers - 1){
                 next_a.clear();
-                next_a.reserve(input_size);
+                next_a.reserve(n);
                 next_s.clear();
-                next_s.reserve(input_size);
+                next_s.reserve(n);
 
-                for(std::size_t i = 0; i < input_size; ++i){
+                for(std::size_t i = 0; i < n; ++i){
                     next_a.emplace_back(num_hidden);
                     next_s.emplace_back(num_hidden);
                 }
 
-                for(size_t i = 0; i < input_size; ++i){
-                    auto& input_i = static_cast<training_t&>(input)[i];
-                    rbm.activate_hidden(next_a[i], next_s[i], input_i, input_i);
+                if(I == 0){
+                    //The samples are converted one at a time
+                    etl::dyn_vector<weight> input_i(dll::num_visible(rbm));
+
+                    auto it = first;
+
+                    for(size_t i = 0; i < n; ++i, ++it){
+                        std::copy(it->begin(), it->end(), input_i.begin());
+                        rbm.activate_hidden(next_a[i], next_s[i], input_i, input_i);
+                    }
+                } else {
+                    for(size_t i = 0; i < n; ++i){
+                        rbm.activate_hidden(next_a[i], next_s[i], input[i], input[i]);
+                    }
                 }
 
-                input = std::ref(next_a);
+                std::swap(input, next_a);
             }
         });
 
         watcher.pretraining_end(*this);
     }
 
+public:
+
     /*}}}*/
 
     /*{{{ With labels */
@@ -301,55 +361,37 @@ struct dbn final {
     }
 
     template<typename TrainingItem>
-    size_t predict_labels(const TrainingItem& item_data, std::size_t labels){
+    size_t predict_labels(const TrainingItem& item_data, std::size_t labels, workspace& ws) const {
         cpp_assert(num_visible<layers - 1>() == num_hidden<layers - 2>() + labels, "There is no room for the labels units");
 
         using training_t = etl::dyn_vector<weight>;
 
-        training_t item(item_data);
+        ws.input = item_data;
 
-        etl::dyn_vector<weight> output_a(num_visible<layers - 1>());
-        etl::dyn_vector<weight> output_s(num_visible<layers - 1>());
-
-        auto input_ref = std::cref(item);
-
-        cpp::for_each_i(tuples, [labels,&input_ref,&output_a,&output_s](size_t I, auto& rbm){
-            typedef typename std::remove_reference<decltype(rbm)>::type rbm_t;
-            constexpr const auto num_hidden = rbm_t::num_hidden;
+        auto input_ref = std::cref(ws.input);
 
+        for_each_layer(tuples, ws.layers, [labels, &input_ref, &ws](std::size_t I, const auto& rbm, auto& lws){
             auto& input = static_cast<const training_t&>(input_ref);
 
+            rbm.activate_hidden(lws.a, lws.s, input, input, lws.t);
+
             if(I == layers - 1){
-                static etl::dyn_vector<weight> h1_a(num_hidden);
-                static etl::dyn_vector<weight> h1_s(num_hidden);
+                rbm.activate_visible(lws.a, lws.s, ws.visible_a, ws.visible_s, ws.vt);
+            } else if(I + 1 == layers - 1){
+                //The next layer is the last layer, append the label units
+                std::copy(lws.a.begin(), lws.a.end(), ws.joint.begin());
+                std::fill(ws.joint.begin() + lws.a.size(), ws.joint.end(), 0.1);
 
-                rbm.activate_hidden(h1_a, h1_s, input, input);
-                rbm.activate_visible(h1_a, h1_s, output_a, output_s);
+                input_ref = std::cref(ws.joint);
             } else {
-                static etl::dyn_vector<weight> next_a(num_hidden);
-                static etl::dyn_vector<weight> next_s(num_hidden);
-
-                rbm.activate_hidden(next_a, next_s, input, input);
-
-                //If the next layers is the last layer
-                if(I + 1 == layers - 1){
-                    static etl::dyn_vector<weight> big_next_a(num_hidden + labels);
-
-                    std::copy(next_a.begin(), next_a.end(), big_next_a.begin());
-                    std::fill(big_next_a.begin() + num_hidden, big_next_a.end(), 0.1);
-
-                    input_ref = std::cref(big_next_a);
-                } else {
-                    input_ref = std::cref(next_a);
-                }
-
+                input_ref = std::cref(lws.a);
             }
         });
 
         size_t label = 0;
         weight max = 0;
         for(size_t l = 0; l < labels; ++l){
-            auto value = output_a[num_visible<layers - 1>() - labels + l];
+            auto value = ws.visible_a[ws.visible_a.size() - labels + l];
 
             if(value > max){
                 max = value;
@@ -360,40 +402,57 @@ struct dbn final {
         return label;
     }
 
+    template<typename TrainingItem>
+    size_t predict_labels(const TrainingItem& item_data, std::size_t labels) const {
+        workspace ws(*this);
+        return predict_labels(item_data, labels, ws);
+    }
+
     /*}}}*/
 
     /*{{{ Predict */
 
-    template<typename Sample, typename Output>
-    void activation_probabilities(const Sample& item_data, Output& result){
+    /*!
+     * \brief Propagate a sample through all the layers, using the buffers
+     * of the given workspace.
+     *
+     * \return the activation probabilities of the last layer (stored in the workspace)
+     */
+    template<typename Sample>
+    const etl::dyn_vector<weight>& forward(const Sample& item_data, workspace& ws) const {
         using training_t = etl::dyn_vector<weight>;
-        training_t item(item_data);
 
-        auto input = std::cref(item);
+        ws.input = item_data;
 
-        cpp::for_each_i(tuples, [&item, &input, &result](std::size_t I, auto& rbm){
-            if(I != layers - 1){
-                typedef typename std::remove_reference<decltype(rbm)>::type rbm_t;
-                constexpr const auto num_hidden = rbm_t::num_hidden;
+        auto input = std::cref(ws.input);
 
-                static etl::dyn_vector<weight> next(num_hidden);
-                static etl::dyn_vector<weight> next_s(num_hidden);
+        for_each_layer(tuples, ws.layers, [&input](std::size_t, const auto& rbm, auto& lws){
+            //Only the probabilities are needed, the hidden units are not sampled
+            rbm.template activate_hidden<true, false>(lws.a, lws.s, static_cast<const training_t&>(input), static_cast<const training_t&>(input), lws.t);
 
-                rbm.activate_hidden(next, next_s, static_cast<const training_t&>(input), static_cast<const training_t&>(input));
-
-                input = std::cref(next);
-            }
+            input = std::cref(lws.a);
         });
 
-        constexpr const auto num_hidden = rbm_type<layers - 1>::num_hidden;
+        return ws.template layer<layers - 1>().a;
+    }
+
+    template<typename Sample, typename Output>
+    void activation_probabilities(const Sample& item_data, Output& result, workspace& ws) const {
+        const auto& output = forward(item_data, ws);
 
-        static etl::dyn_vector<weight> next_s(num_hidden);
+        for(std::size_t i = 0; i < output.size(); ++i){
+            result[i] = output[i];
+        }
+    }
 
-        layer<layers - 1>().activate_hidden(result, next_s, static_cast<const training_t&>(input), static_cast<const training_t&>(input));
+    template<typename Sample, typename Output>
+    void activation_probabilities(const Sample& item_data, Output& result) const {
+        workspace ws(*this);
+        activation_probabilities(item_data, result, ws);
     }
 
     template<typename Sample>
-    etl::dyn_vector<weight> activation_probabilities(const Sample& item_data){
+    etl::dyn_vector<weight> activation_probabilities(const Sample& item_data) const {
         etl::dyn_vector<weight> result(output_size());
 
         activation_probabilities(item_data, result);
@@ -402,46 +461,26 @@ struct dbn final {
     }
 
     template<typename Sample, typename Output>
-    void full_activation_probabilities(const Sample& item_data, Output& result){
-        using training_t = etl::dyn_vector<weight>;
-        training_t item(item_data);
+    void full_activation_probabilities(const Sample& item_data, Output& result, workspace& ws) const {
+        forward(item_data, ws);
 
         std::size_t i = 0;
 
-        auto input = std::cref(item);
-
-        cpp::for_each_i(tuples, [&i,&item, &input, &result](std::size_t I, auto& rbm){
-            if(I != layers - 1){
-                typedef typename std::remove_reference<decltype(rbm)>::type rbm_t;
-                constexpr const auto num_hidden = rbm_t::num_hidden;
-
-                static etl::dyn_vector<weight> next_a(num_hidden);
-                static etl::dyn_vector<weight> next_s(num_hidden);
-
-                rbm.activate_hidden(next_a, next_s, static_cast<const training_t&>(input), static_cast<const training_t&>(input));
-
-                for(auto& value : next_a){
-                    result[i++] = value;
-                }
-
-                input = std::cref(next_a);
+        for_each_layer(tuples, ws.layers, [&i, &result](std::size_t, const auto&, auto& lws){
+            for(auto& value : lws.a){
+                result[i++] = value;
             }
         });
+    }
 
-        constexpr const auto num_hidden = rbm_type<layers - 1>::num_hidden;
-
-        static etl::dyn_vector<weight> next_a(num_hidden);
-        static etl::dyn_vector<weight> next_s(num_hidden);
-
-        layer<layers - 1>().activate_hidden(next_a, next_s, static_cast<const training_t&>(input), static_cast<const training_t&>(input));
-
-        for(auto& value : next_a){
-            result[i++] = value;
-        }
+    template<typename Sample, typename Output>
+    void full_activation_probabilities(const Sample& item_data, Output& result) const {
+        workspace ws(*this);
+        full_activation_probabilities(item_data, result, ws);
     }
 
     template<typename Sample>
-    etl::dyn_vector<weight> full_activation_probabilities(const Sample& item_data){
+    etl::dyn_vector<weight> full_activation_probabilities(const Sample& item_data) const {
         etl::dyn_vector<weight> result(full_output_size());
 
         full_activation_probabilities(item_data, result);
@@ -450,7 +489,7 @@ struct dbn final {
     }
 
     template<typename Weights>
-    size_t predict_label(const Weights& result){
+    size_t predict_label(const Weights& result) const {
         size_t label = 0;
         weight max = 0;
         for(size_t l = 0; l < result.size(); ++l){
@@ -465,10 +504,143 @@ struct dbn final {
         return label;
     }
 
+    /*!
+     * \brief Predict the label of a sample, using the buffers of the given
+     * workspace. Several threads can predict concurrently with the same
+     * network, as long as each one uses its own workspace.
+     */
+    template<typename Sample>
+    size_t predict(const Sample& item, workspace& ws) const {
+        return predict_label(forward(item, ws));
+    }
+
     template<typename Sample>
-    size_t predict(const Sample& item){
-        auto result = activation_probabilities(item);
-        return predict_label(result);;
+    size_t predict(const Sample& item) const {
+        workspace ws(*this);
+        return predict(item, ws);
+    }
+
+    /*!
+     * \brief Propagate a batch of samples through all the layers but the
+     * last one, then call last(rbm, input, t) with the last layer, its
+     * input batch and a temporary for its matrix-matrix product.
+     *
+     * The first layer directly reads the inputs, the outputs of the other
+     * layers are stored in the given batch workspace.
+     */
+    template<typename Input, typename Last>
+    void batch_forward(const Input& inputs, batch_workspace& ws, Last&& last) const {
+        const std::size_t n = etl::rows(inputs);
+
+        if(!n){
+            return;
+        }
+
+        ws.resize(*this, n);
+
+        auto layer_forward = [&ws, &last](std::size_t I, const auto& rbm, const auto& in){
+            if(I == layers - 1){
+                last(rbm, in, ws.t[I]);
+            } else {
+                rbm.template batch_activate_hidden<true, false>(ws.a[I], ws.a[I], in, in, ws.t[I]);
+            }
+        };
+
+        for_each_layer(tuples, [&](std::size_t I, const auto& rbm){
+            if(I == 0){
+                layer_forward(I, rbm, inputs);
+            } else {
+                layer_forward(I, rbm, ws.a[I - 1]);
+            }
+        });
+    }
+
+    /*!
+     * \brief Compute the activation probabilities of the last layer for a
+     * batch of samples, using the buffers of the given batch workspace.
+     *
+     * Each row of inputs is a sample and each row of result receives the
+     * output of the corresponding sample. The whole batch goes through each
+     * layer at once, as a matrix-matrix multiplication.
+     */
+    template<typename Input, typename Output>
+    void activation_probabilities_batch(const Input& inputs, Output& result, batch_workspace& ws) const {
+        batch_forward(inputs, ws, [&result](const auto& rbm, const auto& in, auto& t){
+            rbm.template batch_activate_hidden<true, false>(result, result, in, in, t);
+        });
+    }
+
+    template<typename Input, typename Output>
+    void activation_probabilities_batch(const Input& inputs, Output& result) const {
+        batch_workspace ws;
+        activation_probabilities_batch(inputs, result, ws);
+    }
+
+    /*!
+     * \brief Predict the k best labels of a batch of samples, with their
+     * scores, using the buffers of the given batch workspace.
+     *
+     * Each row of inputs is a sample. The labels of the i-th sample are
+     * written, from the best to the worst, in indices[i * k .. (i + 1) * k)
+     * and their activation probabilities at the same positions in scores.
+     * The activation of the last layer is fused with the selection, the
+     * other output units are never activated.
+     */
+    template<typename Input, typename Indices, typename Scores>
+    void predict_topk(const Input& inputs, std::size_t k, Indices& indices, Scores& scores, batch_workspace& ws) const {
+        batch_forward(inputs, ws, [&indices, &scores, k](const auto& rbm, const auto& in, auto& t){
+            using rbm_t = std::decay_t<decltype(rbm)>;
+
+            //Only the pre-activations are computed for the whole batch
+            etl::mmul(in, rbm.w, t);
+
+            for(std::size_t i = 0; i < etl::rows(in); ++i){
+                activate_topk(rbm_t::hidden_unit, rbm.b, t(i), dll::num_hidden(rbm), k, &indices[i * k], &scores[i * k]);
+            }
+        });
+    }
+
+    template<typename Input, typename Indices, typename Scores>
+    void predict_topk(const Input& inputs, std::size_t k, Indices& indices, Scores& scores) const {
+        batch_workspace ws;
+        predict_topk(inputs, k, indices, scores, ws);
+    }
+
+    /*!
+     * \brief Predict the labels of a batch of samples, using the buffers of
+     * the given batch workspace.
+     *
+     * Each row of inputs is a sample, the label of the i-th sample is
+     * written in labels[i].
+     */
+    template<typename Input, typename Labels>
+    void predict_batch(const Input& inputs, Labels& labels, batch_workspace& ws) const {
+        const std::size_t n = etl::rows(inputs);
+
+        //The outputs are written in the buffer of the last layer
+        batch_forward(inputs, ws, [&ws](const auto& rbm, const auto& in, auto& t){
+            rbm.template batch_activate_hidden<true, false>(ws.a.back(), ws.a.back(), in, in, t);
+        });
+
+        for(std::size_t i = 0; i < n; ++i){
+            const auto& result = ws.a.back();
+
+            std::size_t label = 0;
+
+            for(std::size_t l = 1; l < output_size(); ++l){
+                if(result(i, l) > result(i, label)){
+                    label = l;
+                }
+            }
+
+            labels[i] = label;
+        }
+    }
+
+    template<typename Input, typename Labels>
+    void predict_batch(const Input& inputs, Labels& labels) const {
+        batch_workspace ws;
+        predict_batch(inputs, labels, ws);
     }
 
     /*}}}*/
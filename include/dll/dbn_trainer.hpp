@@ -51,30 +51,36 @@ struct dbn_trainer {
         //Get types for the batch
         using samples_t = std::vector<etl::dyn_vector<typename std::iterator_traits<Iterator>::value_type::value_type>>;
 
-        //Convert data to an useful form
-        samples_t data;
-        data.reserve(std::distance(first, last));
+        const std::size_t n = std::distance(first, last);
 
-        std::for_each(first, last, [&data](auto& sample){
-            data.emplace_back(sample);
-        });
+        //The samples are converted one batch at a time into the same buffers,
+        //so that the complete dataset never needs to be in memory
+        samples_t data;
+        data.reserve(batch_size);
 
-        //TODO Review this in order to convert data only one batch
-        //at a time to allow for datasets not in-memory
+        for(std::size_t i = 0; i < std::min(batch_size, n); ++i){
+            data.emplace_back(first->size());
+        }
 
         //Compute the number of batches
-        auto batches = data.size() / batch_size + (data.size() % batch_size == 0 ? 0 : 1);
+        auto batches = n / batch_size + (n % batch_size == 0 ? 0 : 1);
 
         typename dbn_t::weight error = 0.0;
 
         //Train for max_epochs epoch
         for(std::size_t epoch= 0; epoch < max_epochs; ++epoch){
+            auto it = first;
+
             //Train one mini-batch at a time
             for(std::size_t i = 0; i < batches; ++i){
                 auto start = i * batch_size;
-                auto end = std::min(start + batch_size, data.size());
+                auto end = std::min(start + batch_size, n);
+
+                for(std::size_t j = 0; j < end - start; ++j, ++it){
+                    std::copy(it->begin(), it->end(), data[j].begin());
+                }
 
-                auto data_batch = make_batch(data.begin() + start, data.begin() + end);
+                auto data_batch = make_batch(data.begin(), data.begin() + (end - start));
                 auto label_batch = make_batch(fake_labels.begin() + start, fake_labels.begin() + end);
 
                 trainer->train_batch(epoch, data_batch, label_batch);
@@ -95,31 +95,50 @@ struct dyn_rbm final : public standard_rbm<dyn_rbm<Desc>, Desc> {
 
     template<bool P = true, bool S = true, typename H1, typename H2, typename V>
     void activate_hidden(H1&& h_a, H2&& h_s, const V& v_a, const V& v_s) const {
-        static etl::dyn_matrix<weight> t(1UL, num_hidden);
-        base_type::template std_activate_hidden(std::forward<H1>(h_a), std::forward<H2>(h_s), v_a, v_s, b, w, t);
+        etl::dyn_matrix<weight> t(1UL, num_hidden);
+        base_type::template std_activate_hidden<P, S>(std::forward<H1>(h_a), std::forward<H2>(h_s), v_a, v_s, b, w, t);
     }
 
     template<bool P = true, bool S = true, typename H1, typename H2, typename V, typename B, typename W>
     void activate_hidden(H1&& h_a, H2&& h_s, const V& v_a, const V& v_s, const B& b, const W& w) const {
-        static etl::dyn_matrix<weight> t(1UL, num_hidden);
-        base_type::template std_activate_hidden(std::forward<H1>(h_a), std::forward<H2>(h_s), v_a, v_s, b, w, t);
+        etl::dyn_matrix<weight> t(1UL, num_hidden);
+        base_type::template std_activate_hidden<P, S>(std::forward<H1>(h_a), std::forward<H2>(h_s), v_a, v_s, b, w, t);
     }
 
     template<bool P = true, bool S = true, typename H1, typename H2, typename V, typename T>
     void activate_hidden(H1&& h_a, H2&& h_s, const V& v_a, const V& v_s, T&& t) const {
-        base_type::template std_activate_hidden(std::forward<H1>(h_a), std::forward<H2>(h_s), v_a, v_s, b, w, std::forward<T>(t));
+        base_type::template std_activate_hidden<P, S>(std::forward<H1>(h_a), std::forward<H2>(h_s), v_a, v_s, b, w, std::forward<T>(t));
     }
 
     template<bool P = true, bool S = true, typename H, typename V>
     void activate_visible(const H& h_a, const H& h_s, V&& v_a, V&& v_s) const {
-        static etl::dyn_matrix<weight> t(num_visible, 1UL);
-
-        base_type::template std_activate_visible(h_a, h_s, std::forward<V>(v_a), std::forward<V>(v_s), c, w, t);
+        etl::dyn_matrix<weight> t(num_visible, 1UL);
+        base_type::template std_activate_visible<P, S>(h_a, h_s, std::forward<V>(v_a), std::forward<V>(v_s), c, w, t);
     }
 
     template<bool P = true, bool S = true, typename H, typename V, typename T>
     void activate_visible(const H& h_a, const H& h_s, V&& v_a, V&& v_s, T&& t) const {
-        base_type::template std_activate_visible(h_a, h_s, std::forward<V>(v_a), std::forward<V>(v_s), c, w, std::forward<T>(t));
+        base_type::template std_activate_visible<P, S>(h_a, h_s, std::forward<V>(v_a), std::forward<V>(v_s), c, w, std::forward<T>(t));
+    }
+
+    template<bool P = true, bool S = true, typename H1, typename H2, typename V, typename T>
+    void batch_activate_hidden(H1&& h_a, H2&& h_s, const V& v_a, const V& v_s, T&& t) const {
+        base_type::template std_batch_activate_hidden<P, S>(std::forward<H1>(h_a), std::forward<H2>(h_s), v_a, v_s, b, w, std::forward<T>(t));
+    }
+
+    template<bool P = true, bool S = true, typename H1, typename H2, typename V1, typename V2, typename T>
+    void batch_activate_visible(const H1& h_a, const H2& h_s, V1&& v_a, V2&& v_s, T&& t) const {
+        base_type::template std_batch_activate_visible<P, S>(h_a, h_s, std::forward<V1>(v_a), std::forward<V2>(v_s), c, w, std::forward<T>(t));
+    }
+
+    template<bool P = true, bool S = true, typename H1, typename H2, typename V, typename B, typename W, typename T>
+    static void batch_activate_hidden(H1&& h_a, H2&& h_s, const V& v_a, const V& v_s, const B& b, const W& w, T&& t){
+        base_type::template std_batch_activate_hidden<P, S>(std::forward<H1>(h_a), std::forward<H2>(h_s), v_a, v_s, b, w, std::forward<T>(t));
+    }
+
+    template<bool P = true, bool S = true, typename H1, typename H2, typename V1, typename V2, typename C, typename W, typename T>
+    static void batch_activate_visible(const H1& h_a, const H2& h_s, V1&& v_a, V2&& v_s, const C& c, const W& w, T&& t){
+        base_type::template std_batch_activate_visible<P, S>(h_a, h_s, std::forward<V1>(v_a), std::forward<V2>(v_s), c, w, std::forward<T>(t));
     }
 };
 
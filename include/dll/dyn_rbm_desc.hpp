@@ -10,6 +10,7 @@
 
 #include "base_conf.hpp"
 #include "contrastive_divergence.hpp"
+#include "parallel_tempering.hpp"
 #include "watcher.hpp"
 #include "tmp.hpp"
 
@@ -32,6 +33,9 @@ struct dyn_rbm_desc {
     static constexpr const sparsity_method Sparsity = detail::get_value<sparsity<sparsity_method::NONE>, Parameters...>::value;
     static constexpr const bool Shuffle = detail::is_present<shuffle, Parameters...>::value;
     static constexpr const bool Free_Energy = detail::is_present<free_energy, Parameters...>::value;
+    static constexpr const std::size_t Chains = detail::get_value<pcd_chains<0>, Parameters...>::value;
+    static constexpr const bool Packed = detail::is_present<packed_states, Parameters...>::value;
+    static constexpr const bool SparseInput = detail::is_present<sparse_input, Parameters...>::value;
 
     /*! The type used to store the weights */
     using weight = typename detail::get_type<weight_type<float>, Parameters...>::type;
@@ -50,11 +54,14 @@ struct dyn_rbm_desc {
     //Make sure only valid types are passed to the configuration list
     static_assert(
         detail::is_valid<detail::tmp_list<momentum_id, visible_id, hidden_id, weight_decay_id, parallel_id,
-              init_weights_id, sparsity_id, trainer_id, weight_type_id, shuffle_id, free_energy_id>, Parameters...>::value,
+              init_weights_id, sparsity_id, trainer_id, weight_type_id, shuffle_id, free_energy_id, pcd_chains_id, packed_states_id, sparse_input_id>, Parameters...>::value,
         "Invalid parameters type");
 
     static_assert(Sparsity == sparsity_method::NONE || hidden_unit == unit_type::BINARY,
         "Sparsity only works with binary hidden units");
+
+    static_assert(!Packed || visible_unit == unit_type::BINARY || hidden_unit == unit_type::BINARY,
+        "Packed states need binary units");
 };
 
 } //end of dll namespace
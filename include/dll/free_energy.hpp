@@ -0,0 +1,94 @@
+//=======================================================================
+// Copyright (c) 2014 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file Batched free energy
+ *
+ * Helpers to compute the free energy of many samples at once. The samples
+ * are processed by blocks, in buffers owned by the current thread, which are
+ * only allocated the first time they are used. The blocks can be
+ * distributed on a thread pool.
+ */
+
+#ifndef DLL_FREE_ENERGY_HPP
+#define DLL_FREE_ENERGY_HPP
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include "cpp_utils/tmp.hpp"
+
+#include "etl/etl.hpp"
+
+#include "parallel.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Number of samples of a block of the batched free energy of dense RBMs
+ */
+constexpr const std::size_t free_energy_block = 64;
+
+namespace detail {
+
+template<typename Samples, cpp::enable_if_u<etl::is_etl_expr<Samples>::value> = cpp::detail::dummy>
+std::size_t batch_samples(const Samples& samples){
+    return etl::dim<0>(samples);
+}
+
+template<typename Samples, cpp::disable_if_u<etl::is_etl_expr<Samples>::value> = cpp::detail::dummy>
+std::size_t batch_samples(const Samples& samples){
+    return samples.size();
+}
+
+template<typename Samples, cpp::enable_if_u<etl::is_etl_expr<Samples>::value> = cpp::detail::dummy>
+decltype(auto) batch_sample(const Samples& samples, std::size_t i){
+    return samples(i);
+}
+
+template<typename Samples, cpp::disable_if_u<etl::is_etl_expr<Samples>::value> = cpp::detail::dummy>
+decltype(auto) batch_sample(const Samples& samples, std::size_t i){
+    return samples[i];
+}
+
+/*!
+ * \brief Buffers of one block of samples of a dense RBM
+ */
+template<typename Weight>
+struct free_energy_buffers {
+    const std::size_t nv;
+    const std::size_t nh;
+
+    etl::dyn_matrix<Weight> v; //The visible samples of the block (zero-padded)
+    etl::dyn_matrix<Weight> t; //The products of the samples with the weights
+
+    free_energy_buffers(std::size_t nv, std::size_t nh) : nv(nv), nh(nh), v(free_energy_block, nv), t(free_energy_block, nh) {
+        v = 0.0;
+    }
+};
+
+/*!
+ * \brief Return the block buffers of the current thread for a RBM with nv
+ * visible units and nh hidden units
+ */
+template<typename Weight>
+free_energy_buffers<Weight>& thread_free_energy_buffers(std::size_t nv, std::size_t nh){
+    thread_local std::unique_ptr<free_energy_buffers<Weight>> buffers;
+
+    if(!buffers || buffers->nv != nv || buffers->nh != nh){
+        buffers = std::make_unique<free_energy_buffers<Weight>>(nv, nh);
+    }
+
+    return *buffers;
+}
+
+} //end of namespace detail
+
+} //end of dll namespace
+
+#endif
@@ -0,0 +1,667 @@
+//=======================================================================
+// Copyright (c) 2014 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file Frozen networks for inference
+ *
+ * A frozen network only holds the weights and the hidden biases of a
+ * trained network, in a single contiguous blob whose blocks are aligned on
+ * cache lines. None of the training buffers and hyper parameters of the
+ * RBM are kept. The inference goes through two ping-pong buffers, sized
+ * once for the largest layer, whose use is planned when the network is
+ * frozen.
+ */
+
+#ifndef DLL_FROZEN_DBN_HPP
+#define DLL_FROZEN_DBN_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "cpp_utils/assert.hpp"
+#include "cpp_utils/tmp.hpp"
+
+#include "etl/etl.hpp"
+
+#include "math.hpp"
+#include "unit_type.hpp"
+#include "rbm_traits.hpp"
+#include "dbn_traits.hpp"
+#include "workspace.hpp"
+
+namespace dll {
+
+namespace detail {
+
+/*!
+ * \brief Contiguous storage of the parameters of a frozen network.
+ *
+ * The blocks are first reserved, then the storage is allocated at once.
+ * Each block starts on its own cache line.
+ */
+template<typename Weight>
+struct frozen_blob {
+    static constexpr const std::size_t alignment = 64;
+    static constexpr const std::size_t line_values = alignment / sizeof(Weight);
+
+    std::size_t size = 0;        //Number of reserved values
+    std::vector<Weight> storage; //Storage, with room for the alignment
+    Weight* base = nullptr;      //First aligned value of the storage
+
+    frozen_blob() = default;
+
+    frozen_blob(const frozen_blob& rhs) : size(rhs.size) {
+        allocate();
+        std::copy(rhs.base, rhs.base + size, base);
+    }
+
+    frozen_blob& operator=(const frozen_blob& rhs){
+        if(this != &rhs){
+            size = rhs.size;
+            allocate();
+            std::copy(rhs.base, rhs.base + size, base);
+        }
+
+        return *this;
+    }
+
+    //Moving the vector does not move its storage, base stays valid
+    frozen_blob(frozen_blob&& rhs) = default;
+    frozen_blob& operator=(frozen_blob&& rhs) = default;
+
+    /*!
+     * \brief Reserve a block of n values and return its offset
+     */
+    std::size_t reserve(std::size_t n){
+        auto offset = size;
+        size += ((n + line_values - 1) / line_values) * line_values;
+        return offset;
+    }
+
+    void allocate(){
+        storage.assign(size + line_values, static_cast<Weight>(0.0));
+
+        auto address = reinterpret_cast<std::uintptr_t>(storage.data());
+        base = reinterpret_cast<Weight*>((address + alignment - 1) & ~(alignment - 1));
+    }
+
+    Weight* data(std::size_t offset){
+        return base + offset;
+    }
+
+    const Weight* data(std::size_t offset) const {
+        return base + offset;
+    }
+};
+
+/*!
+ * \brief Apply the activation function of the given unit on n values, in place
+ */
+template<typename Weight>
+void frozen_activate(unit_type unit, Weight* h, std::size_t n){
+    switch(unit){
+        case unit_type::BINARY:
+            for(std::size_t j = 0; j < n; ++j){
+                h[j] = logistic_sigmoid(h[j]);
+            }
+            break;
+        case unit_type::RELU:
+            for(std::size_t j = 0; j < n; ++j){
+                h[j] = std::max(h[j], static_cast<Weight>(0.0));
+            }
+            break;
+        case unit_type::RELU6:
+            for(std::size_t j = 0; j < n; ++j){
+                h[j] = std::min(std::max(h[j], static_cast<Weight>(0.0)), static_cast<Weight>(6.0));
+            }
+            break;
+        case unit_type::RELU1:
+            for(std::size_t j = 0; j < n; ++j){
+                h[j] = std::min(std::max(h[j], static_cast<Weight>(0.0)), static_cast<Weight>(1.0));
+            }
+            break;
+        case unit_type::SOFTMAX:
+            {
+                const Weight max = *std::max_element(h, h + n);
+
+                Weight sum = 0.0;
+                for(std::size_t j = 0; j < n; ++j){
+                    h[j] = std::exp(h[j] - max);
+                    sum += h[j];
+                }
+
+                for(std::size_t j = 0; j < n; ++j){
+                    h[j] /= sum;
+                }
+            }
+            break;
+        default:
+            cpp_unreachable("Invalid hidden unit for inference");
+    }
+}
+
+/*!
+ * \brief Compute the activation of a dense layer with the given weights
+ * (NV x NH, row-major) and hidden biases
+ */
+template<typename Weight>
+void frozen_dense_activate(const Weight* w, const Weight* b, std::size_t NV, std::size_t NH, unit_type unit, const Weight* v, Weight* h){
+    std::copy(b, b + NH, h);
+
+    for(std::size_t i = 0; i < NV; ++i){
+        const Weight x = v[i];
+
+        //The inputs are often binary, the rows of the inactive units are skipped
+        if(x != 0.0){
+            const Weight* w_i = w + i * NH;
+
+            for(std::size_t j = 0; j < NH; ++j){
+                h[j] += x * w_i[j];
+            }
+        }
+    }
+
+    frozen_activate(unit, h, NH);
+}
+
+/*!
+ * \brief Indicates if the given unit type (read from a file) can be
+ * activated by frozen_activate
+ */
+inline bool is_frozen_unit(std::uint32_t unit){
+    return unit == static_cast<std::uint32_t>(unit_type::BINARY)
+        || unit == static_cast<std::uint32_t>(unit_type::RELU)
+        || unit == static_cast<std::uint32_t>(unit_type::RELU6)
+        || unit == static_cast<std::uint32_t>(unit_type::RELU1)
+        || unit == static_cast<std::uint32_t>(unit_type::SOFTMAX);
+}
+
+template<typename Weight>
+std::size_t frozen_argmax(const Weight* output, std::size_t n){
+    return std::max_element(output, output + n) - output;
+}
+
+template<typename RBM, cpp::enable_if_u<rbm_traits<RBM>::has_probabilistic_max_pooling()> = cpp::detail::dummy>
+constexpr std::size_t frozen_pooling(){
+    return RBM::C;
+}
+
+template<typename RBM, cpp::disable_if_u<rbm_traits<RBM>::has_probabilistic_max_pooling()> = cpp::detail::dummy>
+constexpr std::size_t frozen_pooling(){
+    return 0;
+}
+
+} //end of namespace detail
+
+/*!
+ * \brief The ping-pong buffers of the inference of an inference-only
+ * network
+ *
+ * A workspace must not be shared by several threads.
+ */
+template<typename Weight>
+struct ping_pong_workspace {
+    std::size_t size;            //Number of values of each buffer
+    std::vector<Weight> buffers;
+
+    template<typename DBN>
+    explicit ping_pong_workspace(const DBN& dbn) : size(dbn.buffer_size), buffers(2 * dbn.buffer_size) {
+        //Nothing else to init
+    }
+
+    Weight* buffer(std::size_t i){
+        return buffers.data() + i * size;
+    }
+};
+
+/*!
+ * \brief Common inference functions of the inference-only networks.
+ *
+ * A sample goes through the two ping-pong buffers of the workspace. The
+ * network DBN provides its plan (each layer indicating the buffers it reads
+ * and writes), input_size(), output_size() and activate(layer, v, h, ws),
+ * which computes the output h of a layer from its input v.
+ */
+template<typename DBN, typename Weight>
+struct inference_dbn {
+    using weight = Weight;
+
+    std::size_t buffer_size = 0; //Number of values of each ping-pong buffer
+
+    std::size_t layers() const {
+        return as_dbn().plan.size();
+    }
+
+    /*!
+     * \brief Propagate a sample through all the layers
+     *
+     * \return the activation probabilities of the last layer (stored in the workspace)
+     */
+    template<typename Sample, typename D = DBN>
+    const weight* forward(const Sample& item_data, typename D::workspace& ws) const {
+        const auto& dbn = as_dbn();
+
+        cpp_assert(static_cast<std::size_t>(item_data.size()) == dbn.input_size(), "Invalid sample size");
+
+        std::copy(item_data.begin(), item_data.end(), ws.buffer(dbn.plan.front().input));
+
+        for(auto& layer : dbn.plan){
+            dbn.activate(layer, ws.buffer(layer.input), ws.buffer(layer.output), ws);
+        }
+
+        return ws.buffer(dbn.plan.back().output);
+    }
+
+    template<typename Sample, typename Output, typename D = DBN>
+    void activation_probabilities(const Sample& item_data, Output& result, typename D::workspace& ws) const {
+        const auto* output = forward(item_data, ws);
+
+        for(std::size_t i = 0; i < as_dbn().output_size(); ++i){
+            result[i] = output[i];
+        }
+    }
+
+    template<typename Sample, typename Output>
+    void activation_probabilities(const Sample& item_data, Output& result) const {
+        typename DBN::workspace ws(as_dbn());
+        activation_probabilities(item_data, result, ws);
+    }
+
+    template<typename Sample>
+    etl::dyn_vector<weight> activation_probabilities(const Sample& item_data) const {
+        etl::dyn_vector<weight> result(as_dbn().output_size());
+
+        activation_probabilities(item_data, result);
+
+        return result;
+    }
+
+    template<typename Sample, typename D = DBN>
+    size_t predict(const Sample& item_data, typename D::workspace& ws) const {
+        return detail::frozen_argmax(forward(item_data, ws), as_dbn().output_size());
+    }
+
+    template<typename Sample>
+    size_t predict(const Sample& item_data) const {
+        typename DBN::workspace ws(as_dbn());
+        return predict(item_data, ws);
+    }
+
+protected:
+    /*!
+     * \brief Append a dense layer to the plan, the layer reads the output of
+     * the previous layer
+     */
+    template<typename Layer>
+    void push_layer(Layer layer){
+        auto& plan = static_cast<DBN&>(*this).plan;
+
+        layer.input = plan.size() % 2;
+        layer.output = (plan.size() + 1) % 2;
+
+        cpp_assert(plan.empty() || plan.back().num_hidden == layer.num_visible, "Only networks without label units are supported");
+
+        buffer_size = std::max(buffer_size, std::max(layer.num_visible, layer.num_hidden));
+
+        plan.push_back(layer);
+    }
+
+private:
+    const DBN& as_dbn() const {
+        return static_cast<const DBN&>(*this);
+    }
+};
+
+/*!
+ * \brief Inference-only copy of a dense DBN.
+ *
+ * The weights of each layer are stored row-major (num_visible x num_hidden)
+ * in the blob. All the inference functions are const, several threads can
+ * use the same frozen network, each with its own workspace.
+ */
+template<typename Weight = double>
+struct frozen_dbn : inference_dbn<frozen_dbn<Weight>, Weight> {
+    using base_type = inference_dbn<frozen_dbn<Weight>, Weight>;
+    using weight = Weight;
+
+    friend base_type;
+
+    /*!
+     * \brief The description of one layer and its place in the plan
+     */
+    struct layer_t {
+        std::size_t num_visible;
+        std::size_t num_hidden;
+        std::size_t w;         //Offset of the weights in the blob
+        std::size_t b;         //Offset of the hidden biases in the blob
+        unit_type hidden_unit;
+        std::size_t input;     //Ping-pong buffer read by the layer
+        std::size_t output;    //Ping-pong buffer written by the layer
+    };
+
+    using workspace = ping_pong_workspace<weight>; ///< The buffers used for inference
+
+    std::vector<layer_t> plan;
+    detail::frozen_blob<weight> blob;
+
+    /*!
+     * \brief Freeze the given network
+     */
+    template<typename DBN>
+    explicit frozen_dbn(const DBN& dbn){
+        static_assert(!dbn_traits<DBN>::is_convolutional(), "frozen_dbn only supports dense networks, use frozen_conv_dbn");
+
+        for_each_layer(dbn.tuples, [this](std::size_t, const auto& rbm){
+            using rbm_t = std::decay_t<decltype(rbm)>;
+
+            layer_t layer;
+            layer.num_visible = dll::num_visible(rbm);
+            layer.num_hidden = dll::num_hidden(rbm);
+            layer.w = blob.reserve(layer.num_visible * layer.num_hidden);
+            layer.b = blob.reserve(layer.num_hidden);
+            layer.hidden_unit = rbm_t::hidden_unit;
+
+            this->push_layer(layer);
+        });
+
+        blob.allocate();
+
+        for_each_layer(dbn.tuples, [this](std::size_t I, const auto& rbm){
+            std::copy(rbm.w.begin(), rbm.w.end(), blob.data(plan[I].w));
+            std::copy(rbm.b.begin(), rbm.b.end(), blob.data(plan[I].b));
+        });
+    }
+
+    /*!
+     * \brief Load a network of type DBN from the given file and freeze it.
+     *
+     * The full network only lives during the loading.
+     *
+     * \return the network or nullptr if the file does not contain a model
+     * of DBN or if the model is corrupted
+     */
+    template<typename DBN>
+    static std::unique_ptr<frozen_dbn> load(const std::string& file){
+        std::ifstream is(file, std::ifstream::binary);
+        return load<DBN>(is);
+    }
+
+    /*!
+     * \brief Load a network of type DBN from the given stream and freeze it.
+     *
+     * \return the network or nullptr if the stream does not contain a model
+     * of DBN or if the model is corrupted
+     */
+    template<typename DBN>
+    static std::unique_ptr<frozen_dbn> load(std::istream& is){
+        auto dbn = std::make_unique<DBN>();
+
+        if(!dbn->load(is)){
+            return nullptr;
+        }
+
+        return std::make_unique<frozen_dbn>(*dbn);
+    }
+
+    std::size_t input_size() const {
+        return plan.front().num_visible;
+    }
+
+    std::size_t output_size() const {
+        return plan.back().num_hidden;
+    }
+
+    /*!
+     * \brief Return the number of bytes used by the parameters
+     */
+    std::size_t memory_size() const {
+        return blob.storage.size() * sizeof(weight);
+    }
+
+private:
+    void activate(const layer_t& layer, const weight* v, weight* h, workspace&) const {
+        detail::frozen_dense_activate(blob.data(layer.w), blob.data(layer.b), layer.num_visible, layer.num_hidden, layer.hidden_unit, v, h);
+    }
+};
+
+/*!
+ * \brief Inference-only copy of a convolutional DBN.
+ *
+ * The weights of each layer are stored as (NC x K x NW x NW) in the blob.
+ * The layers with probabilistic max pooling output their pooling units.
+ */
+template<typename Weight = double>
+struct frozen_conv_dbn : inference_dbn<frozen_conv_dbn<Weight>, Weight> {
+    using base_type = inference_dbn<frozen_conv_dbn<Weight>, Weight>;
+    using weight = Weight;
+
+    friend base_type;
+
+    /*!
+     * \brief The description of one layer and its place in the plan
+     */
+    struct layer_t {
+        std::size_t NC;
+        std::size_t NV;
+        std::size_t K;
+        std::size_t NW;
+        std::size_t NH;
+        std::size_t C;         //Size of the pooling blocks, 0 without pooling
+        std::size_t w;         //Offset of the weights in the blob
+        std::size_t b;         //Offset of the hidden biases in the blob
+        unit_type hidden_unit;
+        std::size_t input;     //Ping-pong buffer read by the layer
+        std::size_t output;    //Ping-pong buffer written by the layer
+
+        std::size_t output_dim() const {
+            return C ? NH / C : NH;
+        }
+
+        std::size_t output_size() const {
+            return K * output_dim() * output_dim();
+        }
+    };
+
+    /*!
+     * \brief The ping-pong buffers of the inference, and the hidden units
+     * of the layers with pooling.
+     *
+     * A workspace must not be shared by several threads.
+     */
+    struct workspace : ping_pong_workspace<weight> {
+        std::vector<weight> hidden;
+
+        explicit workspace(const frozen_conv_dbn& dbn) : ping_pong_workspace<weight>(dbn), hidden(dbn.hidden_size) {
+            //Nothing else to init
+        }
+    };
+
+    std::vector<layer_t> plan;
+    detail::frozen_blob<weight> blob;
+    std::size_t hidden_size = 0; //Number of hidden units of the largest layer with pooling
+
+    /*!
+     * \brief Freeze the given network
+     */
+    template<typename DBN>
+    explicit frozen_conv_dbn(const DBN& dbn){
+        static_assert(dbn_traits<DBN>::is_convolutional(), "frozen_conv_dbn only supports convolutional networks, use frozen_dbn");
+
+        for_each_layer(dbn.tuples, [this](std::size_t I, const auto& rbm){
+            using rbm_t = std::decay_t<decltype(rbm)>;
+
+            layer_t layer;
+            layer.NC = rbm_t::NC;
+            layer.NV = rbm_t::NV;
+            layer.K = rbm_t::K;
+            layer.NW = rbm_t::NW;
+            layer.NH = rbm_t::NH;
+            layer.C = detail::frozen_pooling<rbm_t>();
+            layer.w = blob.reserve(layer.NC * layer.K * layer.NW * layer.NW);
+            layer.b = blob.reserve(layer.K);
+            layer.hidden_unit = rbm_t::hidden_unit;
+            layer.input = I % 2;
+            layer.output = (I + 1) % 2;
+
+            this->buffer_size = std::max(this->buffer_size, std::max(layer.NC * layer.NV * layer.NV, layer.output_size()));
+
+            if(layer.C){
+                hidden_size = std::max(hidden_size, layer.K * layer.NH * layer.NH);
+            }
+
+            plan.push_back(layer);
+        });
+
+        blob.allocate();
+
+        for_each_layer(dbn.tuples, [this](std::size_t I, const auto& rbm){
+            std::copy(rbm.w.begin(), rbm.w.end(), blob.data(plan[I].w));
+            std::copy(rbm.b.begin(), rbm.b.end(), blob.data(plan[I].b));
+        });
+    }
+
+    /*!
+     * \brief Load a network of type DBN from the given file and freeze it.
+     *
+     * The full network only lives during the loading.
+     *
+     * \return the network or nullptr if the file does not contain a model
+     * of DBN or if the model is corrupted
+     */
+    template<typename DBN>
+    static std::unique_ptr<frozen_conv_dbn> load(const std::string& file){
+        std::ifstream is(file, std::ifstream::binary);
+        return load<DBN>(is);
+    }
+
+    /*!
+     * \brief Load a network of type DBN from the given stream and freeze it.
+     *
+     * \return the network or nullptr if the stream does not contain a model
+     * of DBN or if the model is corrupted
+     */
+    template<typename DBN>
+    static std::unique_ptr<frozen_conv_dbn> load(std::istream& is){
+        auto dbn = std::make_unique<DBN>();
+
+        if(!dbn->load(is)){
+            return nullptr;
+        }
+
+        return std::make_unique<frozen_conv_dbn>(*dbn);
+    }
+
+    std::size_t input_size() const {
+        return plan.front().NC * plan.front().NV * plan.front().NV;
+    }
+
+    std::size_t output_size() const {
+        return plan.back().output_size();
+    }
+
+    /*!
+     * \brief Return the number of bytes used by the parameters
+     */
+    std::size_t memory_size() const {
+        return blob.storage.size() * sizeof(weight);
+    }
+
+private:
+    void activate(const layer_t& layer, const weight* v, weight* output, workspace& ws) const {
+        weight* hidden = ws.hidden.data();
+
+        const weight* w = blob.data(layer.w);
+        const weight* b = blob.data(layer.b);
+
+        const std::size_t NV = layer.NV;
+        const std::size_t NW = layer.NW;
+        const std::size_t NH = layer.NH;
+
+        //With pooling, the hidden units are only an intermediate result
+        weight* h = layer.C ? hidden : output;
+
+        for(std::size_t k = 0; k < layer.K; ++k){
+            weight* h_k = h + k * NH * NH;
+
+            std::fill(h_k, h_k + NH * NH, b[k]);
+
+            //Valid correlation with the filters, summed over the channels
+            for(std::size_t channel = 0; channel < layer.NC; ++channel){
+                const weight* v_c = v + channel * NV * NV;
+                const weight* w_ck = w + (channel * layer.K + k) * NW * NW;
+
+                for(std::size_t a = 0; a < NW; ++a){
+                    for(std::size_t c = 0; c < NW; ++c){
+                        const weight w_ac = w_ck[a * NW + c];
+
+                        for(std::size_t i = 0; i < NH; ++i){
+                            const weight* v_row = v_c + (i + a) * NV + c;
+                            weight* h_row = h_k + i * NH;
+
+                            for(std::size_t j = 0; j < NH; ++j){
+                                h_row[j] += w_ac * v_row[j];
+                            }
+                        }
+                    }
+                }
+            }
+        }
+
+        if(!layer.C){
+            detail::frozen_activate(layer.hidden_unit, h, layer.K * NH * NH);
+            return;
+        }
+
+        //Probabilistic max pooling of the binary pooling units
+        const std::size_t C = layer.C;
+        const std::size_t NP = NH / C;
+
+        for(std::size_t k = 0; k < layer.K; ++k){
+            const weight* h_k = h + k * NH * NH;
+            weight* p_k = output + k * NP * NP;
+
+            for(std::size_t i = 0; i < NP; ++i){
+                for(std::size_t j = 0; j < NP; ++j){
+                    weight p = 0.0;
+
+                    for(std::size_t ii = i * C; ii < (i + 1) * C; ++ii){
+                        for(std::size_t jj = j * C; jj < (j + 1) * C; ++jj){
+                            p += std::exp(h_k[ii * NH + jj]);
+                        }
+                    }
+
+                    p_k[i * NP + j] = 1.0 / (1.0 + p);
+                }
+            }
+        }
+    }
+};
+
+/*!
+ * \brief Freeze a dense network
+ */
+template<typename DBN, cpp::disable_if_u<dbn_traits<DBN>::is_convolutional()> = cpp::detail::dummy>
+frozen_dbn<typename DBN::weight> freeze(const DBN& dbn){
+    return frozen_dbn<typename DBN::weight>(dbn);
+}
+
+/*!
+ * \brief Freeze a convolutional network
+ */
+template<typename DBN, cpp::enable_if_u<dbn_traits<DBN>::is_convolutional()> = cpp::detail::dummy>
+frozen_conv_dbn<typename DBN::weight> freeze(const DBN& dbn){
+    return frozen_conv_dbn<typename DBN::weight>(dbn);
+}
+
+} //end of dll namespace
+
+#endif
@@ -0,0 +1,98 @@
+//=======================================================================
+// Copyright (c) 2014 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file Fused activation and sampling kernels
+ *
+ * The activation of binary units is done in a single sweep over the
+ * result of the vector-matrix (or matrix-matrix) multiplication: bias,
+ * sigmoid, uniform random number and threshold. The uniform numbers are
+ * generated from the counter-based random streams, eight Philox blocks at
+ * a time, one per 32-bit lane of a SIMD register.
+ */
+
+#ifndef DLL_FUSED_SAMPLING_HPP
+#define DLL_FUSED_SAMPLING_HPP
+
+#include "etl/etl.hpp"
+
+#include "math.hpp"
+#include "random.hpp"           //Random streams
+#include "checks.hpp"           //NaN checks
+
+namespace dll {
+
+/*!
+ * \brief Compute a = sigmoid(beta * (bias + x)) and s ~ Bernoulli(a) in a
+ * single sweep.
+ *
+ * x is the result of the multiplication by the weights and beta is the
+ * inverse temperature of the units. If P is false, the probabilities are
+ * not stored and a is not accessed.
+ */
+template<bool P, typename A, typename S, typename B, typename X>
+void tempered_sigmoid_bernoulli(A&& a, S&& s, const B& bias, const X& x, double beta, const random_stream& stream){
+    using weight = typename std::decay_t<S>::value_type;
+
+    //Number of uniforms generated at once (eight Philox blocks of four words)
+    constexpr const std::size_t L = 32;
+
+    alignas(32) float u[L];
+
+    const std::size_t n = etl::size(s);
+
+    std::size_t j = 0;
+
+    for(; j + L <= n; j += L){
+        stream.uniforms<L>(j, u);
+
+        for(std::size_t l = 0; l < L; ++l){
+            const weight p = logistic_sigmoid(static_cast<weight>(beta * (bias[j + l] + x[j + l])));
+
+            nan_check(p);
+
+            if(P){
+                a[j + l] = p;
+            }
+
+            s[j + l] = u[l] < p ? 1.0 : 0.0;
+        }
+    }
+
+    if(j < n){
+        stream.uniforms<L>(j, u);
+
+        for(std::size_t l = 0; j < n; ++j, ++l){
+            const weight p = logistic_sigmoid(static_cast<weight>(beta * (bias[j] + x[j])));
+
+            nan_check(p);
+
+            if(P){
+                a[j] = p;
+            }
+
+            s[j] = u[l] < p ? 1.0 : 0.0;
+        }
+    }
+}
+
+/*!
+ * \brief Compute a = sigmoid(bias + x) and s ~ Bernoulli(a) in a single sweep.
+ */
+template<bool P, typename A, typename S, typename B, typename X>
+void fused_sigmoid_bernoulli(A&& a, S&& s, const B& bias, const X& x, const random_stream& stream){
+    tempered_sigmoid_bernoulli<P>(std::forward<A>(a), std::forward<S>(s), bias, x, 1.0, stream);
+}
+
+template<bool P, typename A, typename S, typename B, typename X>
+void fused_sigmoid_bernoulli(A&& a, S&& s, const B& bias, const X& x){
+    fused_sigmoid_bernoulli<P>(std::forward<A>(a), std::forward<S>(s), bias, x, next_random_stream());
+}
+
+} //end of dll namespace
+
+#endif
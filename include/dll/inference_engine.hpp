@@ -0,0 +1,262 @@
+//=======================================================================
+// Copyright (c) 2014 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file Inference engine with dynamic batching
+ *
+ * The engine accepts single-sample requests from any number of threads and
+ * groups them into batches, which are run through the batched forward pass
+ * of the network. A batch is started as soon as it is full or as soon as
+ * its oldest request has waited for the configured delay.
+ */
+
+#ifndef DLL_INFERENCE_ENGINE_HPP
+#define DLL_INFERENCE_ENGINE_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "cpp_utils/assert.hpp"
+
+#include "etl/etl.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Serve the predictions of a network with dynamic batching.
+ *
+ * The network must not be modified while the engine is alive.
+ */
+template<typename DBN>
+struct inference_engine {
+    using dbn_t = DBN;
+    using weight = typename dbn_t::weight;
+    using clock = std::chrono::steady_clock;
+
+    using output_t = etl::dyn_vector<weight>;
+
+private:
+    /*!
+     * \brief A pending request, only one of its promises is set
+     */
+    struct request {
+        etl::dyn_vector<weight> input;
+        clock::time_point arrival;
+        std::unique_ptr<std::promise<output_t>> probabilities; //Set for activation_probabilities
+        std::unique_ptr<std::promise<std::size_t>> label;      //Set for predict
+    };
+
+    const dbn_t& dbn;
+
+    const std::size_t max_batch;                //The maximum number of samples in a batch
+    const std::chrono::microseconds max_delay;  //The maximum time a request waits for its batch
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<request> queue;
+    std::vector<etl::dyn_vector<weight>> spare_inputs; //The inputs of the served requests, reused by the next ones
+    bool stop = false;
+
+    //The buffers of the batches, only used by the worker thread
+    typename dbn_t::batch_workspace ws;
+    etl::dyn_matrix<weight> inputs;
+    etl::dyn_matrix<weight> outputs;
+
+    std::thread worker;
+
+public:
+    inference_engine(const dbn_t& dbn, std::size_t max_batch = 64, std::chrono::microseconds max_delay = std::chrono::microseconds(2000))
+            : dbn(dbn), max_batch(max_batch), max_delay(max_delay),
+              inputs(max_batch, dbn.input_size(), static_cast<weight>(0.0)), outputs(max_batch, dbn.output_size()) {
+        cpp_assert(max_batch > 0, "The batches must contain at least one sample");
+
+        worker = std::thread([this](){ run(); });
+    }
+
+    inference_engine(const inference_engine&) = delete;
+    inference_engine& operator=(const inference_engine&) = delete;
+
+    /*!
+     * \brief Stop the engine, the pending requests are still served.
+     */
+    ~inference_engine(){
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+
+        cv.notify_one();
+        worker.join();
+    }
+
+    /*!
+     * \brief Compute the activation probabilities of the last layer for the given sample
+     */
+    template<typename Sample>
+    std::future<output_t> activation_probabilities(const Sample& sample){
+        auto promise = std::make_unique<std::promise<output_t>>();
+        auto future = promise->get_future();
+
+        submit(sample, std::move(promise), nullptr);
+
+        return future;
+    }
+
+    /*!
+     * \brief Predict the label of the given sample
+     */
+    template<typename Sample>
+    std::future<std::size_t> predict(const Sample& sample){
+        auto promise = std::make_unique<std::promise<std::size_t>>();
+        auto future = promise->get_future();
+
+        submit(sample, nullptr, std::move(promise));
+
+        return future;
+    }
+
+private:
+    template<typename Sample>
+    void submit(const Sample& sample, std::unique_ptr<std::promise<output_t>> probabilities, std::unique_ptr<std::promise<std::size_t>> label){
+        bool full;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+
+            request r{{}, clock::now(), std::move(probabilities), std::move(label)};
+
+            if(spare_inputs.empty()){
+                r.input = etl::dyn_vector<weight>(sample);
+            } else {
+                r.input = std::move(spare_inputs.back());
+                spare_inputs.pop_back();
+
+                std::copy(sample.begin(), sample.end(), r.input.begin());
+            }
+
+            queue.push_back(std::move(r));
+            full = queue.size() == 1 || queue.size() >= max_batch;
+        }
+
+        //The worker only needs to be woken up for the first request of a
+        //batch (to start the deadline) or when the batch is full
+        if(full){
+            cv.notify_one();
+        }
+    }
+
+    void run(){
+        std::vector<request> batch;
+
+        while(true){
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+
+                cv.wait(lock, [this](){ return stop || !queue.empty(); });
+
+                if(queue.empty()){
+                    return;
+                }
+
+                //Wait for a full batch, but not longer than the deadline of the oldest request
+                const auto deadline = queue.front().arrival + max_delay;
+                cv.wait_until(lock, deadline, [this](){ return stop || queue.size() >= max_batch; });
+
+                const std::size_t n = std::min(max_batch, queue.size());
+
+                batch.clear();
+
+                for(std::size_t i = 0; i < n; ++i){
+                    batch.push_back(std::move(queue.front()));
+                    queue.pop_front();
+                }
+            }
+
+            serve(batch);
+        }
+    }
+
+    /*!
+     * \brief Run a batch through the network, with the buffers of the
+     * worker. The batch always has max_batch rows, the rows after the
+     * requests still hold previous samples and their outputs are ignored.
+     */
+    void serve(std::vector<request>& batch){
+        const std::size_t n = batch.size();
+
+        try {
+            for(std::size_t i = 0; i < n; ++i){
+                inputs(i) = batch[i].input;
+            }
+
+            dbn.activation_probabilities_batch(inputs, outputs, ws);
+        } catch (...) {
+            for(auto& r : batch){
+                if(r.label){
+                    r.label->set_exception(std::current_exception());
+                } else {
+                    r.probabilities->set_exception(std::current_exception());
+                }
+            }
+
+            recycle(batch);
+
+            return;
+        }
+
+        const auto output_size = dbn.output_size();
+
+        for(std::size_t i = 0; i < n; ++i){
+            auto& r = batch[i];
+
+            if(r.label){
+                std::size_t label = 0;
+
+                for(std::size_t l = 1; l < output_size; ++l){
+                    if(outputs(i, l) > outputs(i, label)){
+                        label = l;
+                    }
+                }
+
+                r.label->set_value(label);
+            } else {
+                output_t result(output_size);
+
+                for(std::size_t j = 0; j < output_size; ++j){
+                    result[j] = outputs(i, j);
+                }
+
+                r.probabilities->set_value(std::move(result));
+            }
+        }
+
+        recycle(batch);
+    }
+
+    /*!
+     * \brief Give the inputs of the served requests back to the next ones
+     */
+    void recycle(std::vector<request>& batch){
+        std::lock_guard<std::mutex> lock(mutex);
+
+        for(auto& r : batch){
+            spare_inputs.push_back(std::move(r.input));
+        }
+    }
+};
+
+} //end of dll namespace
+
+#endif
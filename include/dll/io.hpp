@@ -9,9 +9,58 @@
 #define DLL_IO_HPP
 
 #include <fstream>
+#include <algorithm>
+#include <type_traits>
+
+#include "cpp_utils/tmp.hpp"
 
 namespace dll {
 
+namespace detail {
+
+template<typename... T>
+struct void_type {
+    using type = void;
+};
+
+/*!
+ * \brief Indicates if the container directly exposes its contiguous
+ * storage with memory_start() (ETL containers)
+ */
+template<typename Container, typename Enable = void>
+struct has_memory_start : std::false_type {};
+
+template<typename Container>
+struct has_memory_start<Container, typename void_type<decltype(std::declval<Container&>().memory_start())>::type> : std::true_type {};
+
+/*!
+ * \brief Indicates if the container directly exposes its contiguous
+ * storage with data() (standard containers)
+ */
+template<typename Container, typename Enable = void>
+struct has_data : std::false_type {};
+
+template<typename Container>
+struct has_data<Container, typename void_type<decltype(std::declval<Container&>().data())>::type> : std::true_type {};
+
+template<typename Container, cpp::enable_if_u<has_memory_start<Container>::value> = cpp::detail::dummy>
+auto contiguous_storage(Container& c){
+    return c.memory_start();
+}
+
+template<typename Container, cpp::enable_if_u<!has_memory_start<Container>::value && has_data<Container>::value> = cpp::detail::dummy>
+auto contiguous_storage(Container& c){
+    return c.data();
+}
+
+template<typename Container>
+using is_contiguous = std::integral_constant<bool, has_memory_start<Container>::value || has_data<Container>::value>;
+
+//Number of values copied at once through the stack buffer of the non-contiguous containers
+constexpr const std::size_t io_chunk = 1024;
+
+} //end of namespace detail
+
 //Binary I/O utility functions
 
 template<typename T>
@@ -19,11 +68,38 @@ void binary_write(std::ostream& os, const T& v){
     os.write(reinterpret_cast<const char*>(&v), sizeof(v));
 }
 
-template<typename Container>
+//The whole storage of contiguous containers is written with a single call
+
+template<typename Container, cpp::enable_if_u<detail::is_contiguous<const Container>::value> = cpp::detail::dummy>
 void binary_write_all(std::ostream& os, const Container& c){
+    using value_type = std::decay_t<decltype(*detail::contiguous_storage(c))>;
+
+    static_assert(std::is_trivially_copyable<value_type>::value, "Only trivially copyable values can be written");
+
+    os.write(reinterpret_cast<const char*>(detail::contiguous_storage(c)), c.size() * sizeof(value_type));
+}
+
+//The other containers are written by chunks through a stack buffer
+
+template<typename Container, cpp::disable_if_u<detail::is_contiguous<const Container>::value> = cpp::detail::dummy>
+void binary_write_all(std::ostream& os, const Container& c){
+    using value_type = std::decay_t<decltype(*c.begin())>;
+
+    static_assert(std::is_trivially_copyable<value_type>::value, "Only trivially copyable values can be written");
+
+    value_type buffer[detail::io_chunk];
+    std::size_t n = 0;
+
     for(auto& v : c){
-        binary_write(os, v);
+        buffer[n++] = v;
+
+        if(n == detail::io_chunk){
+            os.write(reinterpret_cast<const char*>(buffer), n * sizeof(value_type));
+            n = 0;
+        }
     }
+
+    os.write(reinterpret_cast<const char*>(buffer), n * sizeof(value_type));
 }
 
 template<typename T>
@@ -31,13 +107,40 @@ void binary_load(std::istream& is, T& v){
     is.read(reinterpret_cast<char*>(&v), sizeof(v));
 }
 
-template<typename Container>
+//The values are directly read into the storage of contiguous containers
+
+template<typename Container, cpp::enable_if_u<detail::is_contiguous<Container>::value> = cpp::detail::dummy>
 void binary_load_all(std::istream& is, Container& c){
-    for(auto& v : c){
-        binary_load(is, v);
+    using value_type = std::decay_t<decltype(*detail::contiguous_storage(c))>;
+
+    static_assert(std::is_trivially_copyable<value_type>::value, "Only trivially copyable values can be read");
+
+    is.read(reinterpret_cast<char*>(detail::contiguous_storage(c)), c.size() * sizeof(value_type));
+}
+
+template<typename Container, cpp::disable_if_u<detail::is_contiguous<Container>::value> = cpp::detail::dummy>
+void binary_load_all(std::istream& is, Container& c){
+    using value_type = std::decay_t<decltype(*c.begin())>;
+
+    static_assert(std::is_trivially_copyable<value_type>::value, "Only trivially copyable values can be read");
+
+    value_type buffer[detail::io_chunk];
+
+    auto it = c.begin();
+    auto end = c.end();
+
+    while(it != end){
+        auto first = it;
+        std::size_t n = 0;
+
+        for(; it != end && n < detail::io_chunk; ++it, ++n){}
+
+        is.read(reinterpret_cast<char*>(buffer), n * sizeof(value_type));
+
+        std::copy(buffer, buffer + n, first);
     }
 }
 
 } //end of dll namespace
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,285 @@
+//=======================================================================
+// Copyright (c) 2014 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file Memory-mapped datasets
+ *
+ * A dataset file starts with a header, followed by the values of all the
+ * samples, contiguous and row-major, starting on a new page, and then by the
+ * labels of the samples (32-bit unsigned integers), if any. The values are
+ * stored with the type chosen when the file is written (float, double or
+ * uint8).
+ *
+ * A mapped dataset exposes each sample as a light view on the pages of the
+ * file mapped read-only in memory, so it can be directly given to the
+ * training functions. Only the views are in memory, the pages of the samples
+ * are read from the disk when they are used and can be dropped by the system
+ * at any time.
+ */
+
+#ifndef DLL_MAPPED_DATASET_HPP
+#define DLL_MAPPED_DATASET_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "cpp_utils/assert.hpp"
+
+#include "io.hpp"
+#include "mapped_file.hpp"
+#include "model_file.hpp"
+
+namespace dll {
+
+constexpr const std::uint32_t dataset_magic = 0x444C4C44;   ///< "DLLD"
+constexpr const std::uint32_t dataset_version = 1;          ///< Version of the format
+
+/*!
+ * \brief The header of a dataset file
+ */
+struct dataset_header {
+    std::uint32_t magic;            ///< Must be dataset_magic
+    std::uint32_t version;          ///< Version of the format
+    std::uint32_t dtype;            ///< The type of the values (weight_dtype)
+    std::uint32_t labels;           ///< 1 if the samples are labelled, 0 otherwise
+    std::uint64_t samples;          ///< Number of samples
+    std::uint64_t features;         ///< Number of values of each sample
+    std::uint64_t data_offset;      ///< The offset of the values, from the beginning of the file
+    std::uint64_t labels_offset;    ///< The offset of the labels, from the beginning of the file
+};
+
+static_assert(sizeof(dataset_header) == 48, "dataset_header must not be padded");
+
+/*!
+ * \brief A read-only view on n contiguous values
+ */
+template<typename T>
+struct mapped_range {
+    using value_type = T;
+    using iterator = const T*;
+    using const_iterator = const T*;
+
+    const T* first = nullptr;
+    std::size_t n = 0;
+
+    mapped_range() = default;
+
+    mapped_range(const T* first, std::size_t n) : first(first), n(n) {
+        //Nothing else to init
+    }
+
+    const T* begin() const {
+        return first;
+    }
+
+    const T* end() const {
+        return first + n;
+    }
+
+    const T* data() const {
+        return first;
+    }
+
+    std::size_t size() const {
+        return n;
+    }
+
+    bool empty() const {
+        return n == 0;
+    }
+
+    const T& operator[](std::size_t i) const {
+        cpp_assert(i < n, "Out of bounds access");
+        return first[i];
+    }
+};
+
+namespace detail {
+
+inline std::uint64_t align_to(std::uint64_t offset, std::uint64_t alignment){
+    return (offset + alignment - 1) / alignment * alignment;
+}
+
+template<typename T, typename Iterator, typename LIterator>
+bool write_dataset(const std::string& file, Iterator first, Iterator last, LIterator lfirst, LIterator llast, bool labels){
+    dataset_header header;
+    header.magic = dataset_magic;
+    header.version = dataset_version;
+    header.dtype = static_cast<std::uint32_t>(dtype_of<T>());
+    header.labels = labels ? 1 : 0;
+    header.samples = std::distance(first, last);
+    header.features = first == last ? 0 : first->size();
+    header.data_offset = align_to(sizeof(dataset_header), model_alignment);
+    header.labels_offset = align_to(header.data_offset + header.samples * header.features * sizeof(T), sizeof(std::uint64_t));
+
+    if(labels && static_cast<std::uint64_t>(std::distance(lfirst, llast)) != header.samples){
+        return false;
+    }
+
+    if(std::any_of(first, last, [&header](auto& sample){ return static_cast<std::uint64_t>(sample.size()) != header.features; })){
+        return false;
+    }
+
+    std::ofstream os(file, std::ofstream::binary);
+
+    if(!os){
+        return false;
+    }
+
+    binary_write(os, header);
+    write_padding(os, header.data_offset - sizeof(dataset_header));
+
+    //The samples are converted one at a time
+    std::vector<T> row(header.features);
+
+    for(; first != last; ++first){
+        std::transform(first->begin(), first->end(), row.begin(), [](auto v){ return static_cast<T>(v); });
+        binary_write_all(os, row);
+    }
+
+    if(labels){
+        write_padding(os, header.labels_offset - (header.data_offset + header.samples * header.features * sizeof(T)));
+
+        for(; lfirst != llast; ++lfirst){
+            binary_write(os, static_cast<std::uint32_t>(*lfirst));
+        }
+    }
+
+    return static_cast<bool>(os);
+}
+
+} //end of namespace detail
+
+/*!
+ * \brief Write the given samples in a dataset file, their values being
+ * converted to T.
+ *
+ * \return false if the samples do not have the same size or if the file
+ * cannot be written
+ */
+template<typename T, typename Samples>
+bool write_dataset(const std::string& file, const Samples& samples){
+    const std::uint32_t* no_labels = nullptr;
+    return detail::write_dataset<T>(file, samples.begin(), samples.end(), no_labels, no_labels, false);
+}
+
+/*!
+ * \brief Write the given samples and their labels in a dataset file, the
+ * values being converted to T.
+ *
+ * \return false if the samples do not have the same size, if there is not one
+ * label per sample or if the file cannot be written
+ */
+template<typename T, typename Samples, typename Labels>
+bool write_dataset(const std::string& file, const Samples& samples, const Labels& labels){
+    return detail::write_dataset<T>(file, samples.begin(), samples.end(), labels.begin(), labels.end(), true);
+}
+
+/*!
+ * \brief A dataset file mapped read-only in memory.
+ *
+ * samples contains one view per sample and can be directly used for
+ * training (rbm::train, dbn::pretrain, dbn::fine_tune, ...). Shuffling the
+ * samples only shuffles the views, the file is never modified. The views
+ * are only valid as long as the dataset is alive.
+ */
+template<typename T>
+struct mapped_dataset {
+    using value_type = T;
+    using sample_t = mapped_range<T>;
+
+    mapped_file file;
+    std::vector<sample_t> samples;          ///< The views on the samples
+    mapped_range<std::uint32_t> labels;     ///< The labels (empty if the samples are not labelled)
+
+    /*!
+     * \brief Map the dataset in the given file.
+     *
+     * \return the dataset or nullptr if the file does not contain a dataset
+     * with values of type T
+     */
+    static std::unique_ptr<mapped_dataset> open(const std::string& path){
+        std::unique_ptr<mapped_dataset> dataset(new mapped_dataset(mapped_file(path)));
+
+        if(!dataset->file.is_open() || !dataset->bind()){
+            return nullptr;
+        }
+
+        return dataset;
+    }
+
+    std::size_t size() const {
+        return samples.size();
+    }
+
+    std::size_t features() const {
+        return samples.empty() ? 0 : samples.front().size();
+    }
+
+    bool has_labels() const {
+        return !labels.empty();
+    }
+
+private:
+    explicit mapped_dataset(mapped_file&& file) : file(std::move(file)) {
+        //The samples are bound later
+    }
+
+    /*!
+     * \brief Bind the views to the values of the mapped file
+     */
+    bool bind(){
+        if(file.size() < sizeof(dataset_header)){
+            return false;
+        }
+
+        dataset_header header;
+        std::copy(file.data(), file.data() + sizeof(header), reinterpret_cast<char*>(&header));
+
+        if(header.magic != dataset_magic || header.version != dataset_version
+                || header.dtype != static_cast<std::uint32_t>(detail::dtype_of<T>())
+                || header.data_offset % alignof(T) || header.data_offset > file.size()){
+            return false;
+        }
+
+        //Check the sizes without overflowing
+        const std::uint64_t capacity = (file.size() - header.data_offset) / sizeof(T);
+
+        //Samples without values are not allowed, they would not bound the number of samples
+        if(header.features ? header.samples > capacity / header.features : header.samples != 0){
+            return false;
+        }
+
+        if(header.labels){
+            if(header.labels_offset % alignof(std::uint32_t) || header.labels_offset > file.size()
+                    || header.samples > (file.size() - header.labels_offset) / sizeof(std::uint32_t)){
+                return false;
+            }
+
+            labels = mapped_range<std::uint32_t>(reinterpret_cast<const std::uint32_t*>(file.data() + header.labels_offset), header.samples);
+        }
+
+        const T* values = reinterpret_cast<const T*>(file.data() + header.data_offset);
+
+        samples.reserve(header.samples);
+
+        for(std::size_t i = 0; i < header.samples; ++i){
+            samples.emplace_back(values + i * header.features, header.features);
+        }
+
+        return true;
+    }
+};
+
+} //end of dll namespace
+
+#endif
@@ -0,0 +1,182 @@
+//=======================================================================
+// Copyright (c) 2014 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file Memory-mapped networks for inference
+ *
+ * A mapped network reads its weights directly from the pages of a model
+ * file mapped read-only in memory. Nothing is copied when the network is
+ * opened, the pages are only read from the disk when they are first used,
+ * and all the processes mapping the same file share the same physical
+ * pages through the page cache.
+ */
+
+#ifndef DLL_MAPPED_DBN_HPP
+#define DLL_MAPPED_DBN_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "cpp_utils/assert.hpp"
+
+#include "etl/etl.hpp"
+
+#include "mapped_file.hpp"
+#include "model_file.hpp"
+#include "frozen_dbn.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Inference-only dense DBN whose weights are read from a mapped
+ * model file.
+ *
+ * The model can be written by dbn or dyn_dbn, the dimensions of the layers
+ * are read from the file. The weights must be of type Weight. As for
+ * frozen_dbn, all the inference functions are const and each thread needs
+ * its own workspace.
+ */
+template<typename Weight = float>
+struct mapped_dbn : inference_dbn<mapped_dbn<Weight>, Weight> {
+    using base_type = inference_dbn<mapped_dbn<Weight>, Weight>;
+    using weight = Weight;
+
+    friend base_type;
+
+    /*!
+     * \brief The description of one layer and its place in the plan
+     */
+    struct layer_t {
+        std::size_t num_visible;
+        std::size_t num_hidden;
+        const weight* w;       //Weights, in the mapped file
+        const weight* b;       //Hidden biases, in the mapped file
+        unit_type hidden_unit;
+        std::size_t input;     //Ping-pong buffer read by the layer
+        std::size_t output;    //Ping-pong buffer written by the layer
+    };
+
+    using workspace = ping_pong_workspace<weight>; ///< The buffers used for inference
+
+    mapped_file file;
+    std::vector<layer_t> plan;
+
+    /*!
+     * \brief Map the model in the given file.
+     *
+     * If verify is true, the checksums of the weights are checked, which
+     * reads all the pages of the weights.
+     *
+     * \return the network or nullptr if the file does not contain a dense
+     * network with weights of type Weight
+     */
+    static std::unique_ptr<mapped_dbn> open(const std::string& path, bool verify = false){
+        std::unique_ptr<mapped_dbn> dbn(new mapped_dbn(mapped_file(path)));
+
+        if(!dbn->file.is_open() || !dbn->bind(verify)){
+            return nullptr;
+        }
+
+        return dbn;
+    }
+
+    std::size_t input_size() const {
+        return plan.front().num_visible;
+    }
+
+    std::size_t output_size() const {
+        return plan.back().num_hidden;
+    }
+
+private:
+    explicit mapped_dbn(mapped_file&& file) : file(std::move(file)) {
+        //The layers are bound later
+    }
+
+    void activate(const layer_t& layer, const weight* v, weight* h, workspace&) const {
+        detail::frozen_dense_activate(layer.w, layer.b, layer.num_visible, layer.num_hidden, layer.hidden_unit, v, h);
+    }
+
+    /*!
+     * \brief Bind the layers to the weights of the mapped file
+     */
+    bool bind(bool verify){
+        if(file.size() < sizeof(model_header)){
+            return false;
+        }
+
+        model_header header;
+        std::copy(file.data(), file.data() + sizeof(header), reinterpret_cast<char*>(&header));
+
+        if(header.magic != model_magic || header.version != model_version || header.alignment != model_alignment
+                || !header.layers || file.size() < detail::headers_size(header.layers)){
+            return false;
+        }
+
+        const char* records = file.data() + sizeof(model_header);
+
+        for(std::size_t l = 0; l < header.layers; ++l){
+            layer_header record;
+            std::copy(records + l * sizeof(record), records + (l + 1) * sizeof(record), reinterpret_cast<char*>(&record));
+
+            if(record.kind != static_cast<std::uint32_t>(layer_kind::DENSE)
+                    || record.dtype != static_cast<std::uint32_t>(detail::dtype_of<weight>())
+                    || !detail::is_frozen_unit(record.hidden_unit)){
+                return false;
+            }
+
+            //Check the sizes without overflowing, the weights must fit in the file
+            if(!record.dims[0] || !record.dims[1] || record.dims[1] > file.size() / sizeof(weight) / record.dims[0]
+                    || record.offset > file.size() || record.size > file.size() - record.offset){
+                return false;
+            }
+
+            layer_t layer;
+            layer.num_visible = record.dims[0];
+            layer.num_hidden = record.dims[1];
+            layer.hidden_unit = static_cast<unit_type>(record.hidden_unit);
+
+            const std::size_t values = layer.num_visible * layer.num_hidden + layer.num_hidden + layer.num_visible;
+
+            if(record.size != values * sizeof(weight)
+                    || record.offset % alignof(weight)
+                    || (!plan.empty() && plan.back().num_hidden != layer.num_visible)){
+                return false;
+            }
+
+            layer.w = reinterpret_cast<const weight*>(file.data() + record.offset);
+            layer.b = layer.w + layer.num_visible * layer.num_hidden;
+
+            if(verify){
+                //Same chaining as when the checksum was computed from w, b and c
+                const std::size_t w_size = layer.num_visible * layer.num_hidden * sizeof(weight);
+                const std::size_t b_size = layer.num_hidden * sizeof(weight);
+
+                const char* data = file.data() + record.offset;
+
+                auto h = detail::checksum(data, w_size, detail::checksum_seed);
+                h = detail::checksum(data + w_size, b_size, h);
+                h = detail::checksum(data + w_size + b_size, record.size - w_size - b_size, h);
+
+                if(h != record.checksum){
+                    return false;
+                }
+            }
+
+            this->push_layer(layer);
+        }
+
+        return true;
+    }
+};
+
+} //end of dll namespace
+
+#endif
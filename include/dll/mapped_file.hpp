@@ -0,0 +1,100 @@
+//=======================================================================
+// Copyright (c) 2014 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+#ifndef DLL_MAPPED_FILE_HPP
+#define DLL_MAPPED_FILE_HPP
+
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace dll {
+
+/*!
+ * \brief A file mapped read-only in memory
+ */
+struct mapped_file {
+    const char* address = nullptr;
+    std::size_t length = 0;
+
+    mapped_file() = default;
+
+    explicit mapped_file(const std::string& file){
+        int fd = ::open(file.c_str(), O_RDONLY);
+
+        if(fd < 0){
+            return;
+        }
+
+        struct stat st;
+
+        if(::fstat(fd, &st) == 0 && st.st_size > 0){
+            void* mapping = ::mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+
+            if(mapping != MAP_FAILED){
+                address = static_cast<const char*>(mapping);
+                length = st.st_size;
+            }
+        }
+
+        //The mapping stays valid after the file is closed
+        ::close(fd);
+    }
+
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    mapped_file(mapped_file&& rhs) : address(rhs.address), length(rhs.length) {
+        rhs.address = nullptr;
+        rhs.length = 0;
+    }
+
+    mapped_file& operator=(mapped_file&& rhs){
+        if(this != &rhs){
+            unmap();
+
+            address = rhs.address;
+            length = rhs.length;
+
+            rhs.address = nullptr;
+            rhs.length = 0;
+        }
+
+        return *this;
+    }
+
+    ~mapped_file(){
+        unmap();
+    }
+
+    bool is_open() const {
+        return address != nullptr;
+    }
+
+    const char* data() const {
+        return address;
+    }
+
+    std::size_t size() const {
+        return length;
+    }
+
+private:
+    void unmap(){
+        if(address){
+            ::munmap(const_cast<char*>(address), length);
+            address = nullptr;
+        }
+    }
+};
+
+} //end of dll namespace
+
+#endif
@@ -9,6 +9,7 @@
 #define DLL_MATH_HPP
 
 #include <cmath>
+#include <algorithm>
 
 namespace dll {
 
@@ -22,6 +23,12 @@ constexpr W softplus(W x){
     return std::log(1.0 + std::exp(x));
 }
 
+//log(1 + e^x), without overflow for large x
+template<typename W>
+W stable_softplus(W x){
+    return std::max(x, static_cast<W>(0.0)) + std::log1p(std::exp(-std::abs(x)));
+}
+
 } //end of dll namespace
 
 #endif
\ No newline at end of file
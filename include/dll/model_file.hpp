@@ -0,0 +1,398 @@
+//=======================================================================
+// Copyright (c) 2014 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file Model files
+ *
+ * A model file starts with a header describing each of its layers (shape,
+ * weight type, unit types, position and checksum of the weights), followed
+ * by the weights of each layer (w, b then c), each starting on a new page.
+ * The offsets are relative to the beginning of the model, so a single layer
+ * can be read without reading the others, or directly mapped in memory.
+ */
+
+#ifndef DLL_MODEL_FILE_HPP
+#define DLL_MODEL_FILE_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <vector>
+#include <tuple>
+#include <iostream>
+
+#include "cpp_utils/tuple_utils.hpp"
+
+#include "etl/etl.hpp"
+
+#include "io.hpp"
+#include "rbm_traits.hpp"
+#include "unit_type.hpp"
+
+namespace dll {
+
+constexpr const std::uint32_t model_magic = 0x4D4C4C44;   ///< "DLLM"
+constexpr const std::uint32_t model_version = 1;          ///< Version of the format
+constexpr const std::uint32_t model_alignment = 4096;     ///< Alignment of the weights of the layers (a page)
+constexpr const std::uint32_t model_max_layers = 1024;    ///< Maximum number of layers of a model
+
+/*!
+ * \brief The kind of a layer of a model
+ */
+enum class layer_kind : std::uint32_t {
+    DENSE = 0,          ///< Dense RBM (NV, NH)
+    CONVOLUTIONAL = 1   ///< Convolutional RBM (NV, NH, NC, K)
+};
+
+/*!
+ * \brief The type of the weights of a layer (or of the values of a dataset)
+ */
+enum class weight_dtype : std::uint32_t {
+    UNKNOWN = 0,
+    FLOAT = 1,
+    DOUBLE = 2,
+    UINT8 = 3
+};
+
+/*!
+ * \brief The header of a model file
+ */
+struct model_header {
+    std::uint32_t magic;        ///< Must be model_magic
+    std::uint32_t version;      ///< Version of the format
+    std::uint32_t layers;       ///< Number of layers
+    std::uint32_t alignment;    ///< Alignment of the weights of the layers
+};
+
+/*!
+ * \brief The description of a layer of a model file
+ */
+struct layer_header {
+    std::uint32_t kind;         ///< The kind of layer (layer_kind)
+    std::uint32_t dtype;        ///< The type of the weights (weight_dtype)
+    std::uint32_t visible_unit; ///< The type of the visible units (unit_type)
+    std::uint32_t hidden_unit;  ///< The type of the hidden units (unit_type)
+    std::uint64_t dims[4];      ///< The dimensions of the layer, depending on its kind
+    std::uint64_t offset;       ///< The offset of the weights, from the beginning of the model
+    std::uint64_t size;         ///< The size of the weights, in bytes
+    std::uint64_t checksum;     ///< The checksum of the weights
+};
+
+static_assert(sizeof(model_header) == 16, "model_header must not be padded");
+static_assert(sizeof(layer_header) == 72, "layer_header must not be padded");
+
+namespace detail {
+
+template<typename Weight>
+constexpr weight_dtype dtype_of(){
+    return std::is_same<Weight, float>::value ? weight_dtype::FLOAT
+        :  std::is_same<Weight, double>::value ? weight_dtype::DOUBLE
+        :  std::is_same<Weight, std::uint8_t>::value ? weight_dtype::UINT8
+        :  weight_dtype::UNKNOWN;
+}
+
+template<typename RBM, cpp::enable_if_u<rbm_traits<RBM>::is_convolutional()> = cpp::detail::dummy>
+void layer_dimensions(const RBM& /*rbm*/, layer_header& header){
+    header.kind = static_cast<std::uint32_t>(layer_kind::CONVOLUTIONAL);
+    header.dims[0] = RBM::NV;
+    header.dims[1] = RBM::NH;
+    header.dims[2] = RBM::NC;
+    header.dims[3] = RBM::K;
+}
+
+template<typename RBM, cpp::disable_if_u<rbm_traits<RBM>::is_convolutional()> = cpp::detail::dummy>
+void layer_dimensions(const RBM& rbm, layer_header& header){
+    header.kind = static_cast<std::uint32_t>(layer_kind::DENSE);
+    header.dims[0] = num_visible(rbm);
+    header.dims[1] = num_hidden(rbm);
+    header.dims[2] = 0;
+    header.dims[3] = 0;
+}
+
+constexpr const std::uint64_t checksum_seed = 0xcbf29ce484222325ULL;
+constexpr const std::uint64_t checksum_prime = 0x100000001b3ULL;
+
+/*!
+ * \brief Update the checksum h with n bytes of data, by 64-bit words
+ */
+inline std::uint64_t checksum(const char* data, std::size_t n, std::uint64_t h){
+    std::size_t i = 0;
+
+    for(; i + sizeof(std::uint64_t) <= n; i += sizeof(std::uint64_t)){
+        std::uint64_t word;
+        std::memcpy(&word, data + i, sizeof(word));
+        h = (h ^ word) * checksum_prime;
+    }
+
+    for(; i < n; ++i){
+        h = (h ^ static_cast<unsigned char>(data[i])) * checksum_prime;
+    }
+
+    return h;
+}
+
+template<typename Container, cpp::enable_if_u<is_contiguous<const Container>::value> = cpp::detail::dummy>
+std::uint64_t checksum_all(const Container& c, std::uint64_t h){
+    using value_type = std::decay_t<decltype(*contiguous_storage(c))>;
+    return checksum(reinterpret_cast<const char*>(contiguous_storage(c)), c.size() * sizeof(value_type), h);
+}
+
+//The chunks are multiple of 8 bytes, the result is the same as for a contiguous container
+template<typename Container, cpp::disable_if_u<is_contiguous<const Container>::value> = cpp::detail::dummy>
+std::uint64_t checksum_all(const Container& c, std::uint64_t h){
+    using value_type = std::decay_t<decltype(*c.begin())>;
+
+    value_type buffer[io_chunk];
+    std::size_t n = 0;
+
+    for(auto& v : c){
+        buffer[n++] = v;
+
+        if(n == io_chunk){
+            h = checksum(reinterpret_cast<const char*>(buffer), n * sizeof(value_type), h);
+            n = 0;
+        }
+    }
+
+    return checksum(reinterpret_cast<const char*>(buffer), n * sizeof(value_type), h);
+}
+
+template<typename RBM>
+std::uint64_t layer_checksum(const RBM& rbm){
+    return checksum_all(rbm.c, checksum_all(rbm.b, checksum_all(rbm.w, checksum_seed)));
+}
+
+/*!
+ * \brief Read the stored weights directly into the layer
+ */
+template<typename RBM>
+void load_layer(std::istream& is, RBM& rbm){
+    binary_load_all(is, rbm.w);
+    binary_load_all(is, rbm.b);
+    binary_load_all(is, rbm.c);
+}
+
+inline std::uint64_t align_offset(std::uint64_t offset){
+    return (offset + model_alignment - 1) / model_alignment * model_alignment;
+}
+
+inline std::uint64_t headers_size(std::size_t layers){
+    return sizeof(model_header) + layers * sizeof(layer_header);
+}
+
+inline void write_padding(std::ostream& os, std::uint64_t n){
+    static const char zeros[model_alignment] = {};
+    os.write(zeros, n);
+}
+
+} //end of namespace detail
+
+/*!
+ * \brief Return the description of the given layer (without its position and
+ * checksum)
+ */
+template<typename RBM>
+layer_header describe_layer(const RBM& rbm){
+    using weight = typename RBM::weight;
+
+    layer_header header;
+
+    detail::layer_dimensions(rbm, header);
+
+    header.dtype = static_cast<std::uint32_t>(detail::dtype_of<weight>());
+    header.visible_unit = static_cast<std::uint32_t>(RBM::desc::visible_unit);
+    header.hidden_unit = static_cast<std::uint32_t>(RBM::desc::hidden_unit);
+    header.offset = 0;
+    header.size = (etl::size(rbm.w) + etl::size(rbm.b) + etl::size(rbm.c)) * sizeof(weight);
+    header.checksum = 0;
+
+    return header;
+}
+
+/*!
+ * \brief Indicates if the layer described by header can be loaded into the
+ * given RBM
+ */
+template<typename RBM>
+bool is_compatible(const layer_header& header, const RBM& rbm){
+    auto expected = describe_layer(rbm);
+
+    return header.kind == expected.kind
+        && header.dtype == expected.dtype
+        && header.visible_unit == expected.visible_unit
+        && header.hidden_unit == expected.hidden_unit
+        && std::equal(std::begin(header.dims), std::end(header.dims), std::begin(expected.dims))
+        && header.size == expected.size;
+}
+
+/*!
+ * \brief Read the header of a model and the descriptions of its layers.
+ *
+ * \return false if the stream does not contain a supported model
+ */
+inline bool read_model_headers(std::istream& is, std::vector<layer_header>& layers){
+    model_header header;
+    binary_load(is, header);
+
+    //The number of layers is checked before anything is allocated
+    if(!is || header.magic != model_magic || header.version != model_version
+            || header.alignment != model_alignment || header.layers > model_max_layers){
+        return false;
+    }
+
+    layers.clear();
+
+    for(std::size_t l = 0; l < header.layers; ++l){
+        layer_header layer;
+        binary_load(is, layer);
+
+        if(!is){
+            return false;
+        }
+
+        layers.push_back(layer);
+    }
+
+    return true;
+}
+
+/*!
+ * \brief Write the given layers (a tuple of RBMs) as a model
+ */
+template<typename Layers>
+void write_model(std::ostream& os, const Layers& layers){
+    std::vector<layer_header> headers;
+
+    cpp::for_each(layers, [&headers](auto& rbm){
+        headers.push_back(describe_layer(rbm));
+        headers.back().checksum = detail::layer_checksum(rbm);
+    });
+
+    std::uint64_t offset = detail::headers_size(headers.size());
+
+    for(auto& header : headers){
+        header.offset = detail::align_offset(offset);
+        offset = header.offset + header.size;
+    }
+
+    binary_write(os, model_header{model_magic, model_version, static_cast<std::uint32_t>(headers.size()), model_alignment});
+
+    for(auto& header : headers){
+        binary_write(os, header);
+    }
+
+    std::uint64_t position = detail::headers_size(headers.size());
+    std::size_t l = 0;
+
+    cpp::for_each(layers, [&os, &headers, &position, &l](auto& rbm){
+        detail::write_padding(os, headers[l].offset - position);
+
+        binary_write_all(os, rbm.w);
+        binary_write_all(os, rbm.b);
+        binary_write_all(os, rbm.c);
+
+        position = headers[l].offset + headers[l].size;
+        ++l;
+    });
+}
+
+/*!
+ * \brief Read the weights of a layer, the stream being at the beginning of
+ * its weights. The header must be compatible with the RBM.
+ *
+ * The weights are read directly into the RBM and the checksum is then
+ * computed on the weights of the RBM.
+ *
+ * \return false if the weights cannot be read or if their checksum does not
+ * match, in which case the weights of the RBM are not valid
+ */
+template<typename RBM>
+bool read_layer(std::istream& is, const layer_header& header, RBM& rbm){
+    detail::load_layer(is, rbm);
+
+    return is && detail::layer_checksum(rbm) == header.checksum;
+}
+
+/*!
+ * \brief Read a model into the given layers (a tuple of RBMs), in one pass
+ * over the stream.
+ *
+ * All the headers are checked before any weight is read, nothing is written
+ * into the layers if the model does not have the same layers. The weights
+ * of each layer are then read directly into it and their checksum verified.
+ *
+ * \return false if the model cannot be loaded or is corrupted, in which case
+ * the weights of the layers are not valid if the headers were valid
+ */
+template<typename Layers>
+bool read_model(std::istream& is, Layers& layers){
+    std::vector<layer_header> headers;
+
+    if(!read_model_headers(is, headers) || headers.size() != std::tuple_size<Layers>::value){
+        return false;
+    }
+
+    bool valid = true;
+    std::uint64_t position = detail::headers_size(headers.size());
+    std::size_t l = 0;
+
+    //The weights of the layers must follow each other in the stream
+
+    cpp::for_each(layers, [&headers, &valid, &position, &l](auto& rbm){
+        auto& header = headers[l++];
+
+        valid = valid && is_compatible(header, rbm) && header.offset >= position;
+        position = header.offset + header.size;
+    });
+
+    if(!valid){
+        return false;
+    }
+
+    position = detail::headers_size(headers.size());
+    l = 0;
+
+    cpp::for_each(layers, [&is, &headers, &valid, &position, &l](auto& rbm){
+        auto& header = headers[l++];
+
+        if(valid){
+            is.ignore(static_cast<std::streamsize>(header.offset - position));
+
+            valid = read_layer(is, header, rbm);
+            position = header.offset + header.size;
+        }
+    });
+
+    return valid;
+}
+
+/*!
+ * \brief Read only the ith layer of a model into the given RBM, by seeking
+ * directly to its weights.
+ *
+ * \return false if the layer does not exist, cannot be loaded into the RBM
+ * or is corrupted
+ */
+template<typename RBM>
+bool read_model_layer(std::istream& is, std::size_t i, RBM& rbm){
+    auto start = is.tellg();
+
+    std::vector<layer_header> headers;
+
+    if(!read_model_headers(is, headers) || i >= headers.size() || !is_compatible(headers[i], rbm)){
+        return false;
+    }
+
+    is.seekg(start + static_cast<std::streamoff>(headers[i].offset));
+
+    return read_layer(is, headers[i], rbm);
+}
+
+} //end of dll namespace
+
+#endif
@@ -8,6 +8,10 @@
 #ifndef DLL_PARALLEL_HPP
 #define DLL_PARALLEL_HPP
 
+#include <algorithm>
+#include <thread>
+#include <vector>
+
 #include "cpp_utils/parallel.hpp"             //Parallel
 
 namespace dll {
@@ -15,11 +19,40 @@ namespace dll {
 template<bool Parallel>
 struct thread_pool {
     //Does not do anythin by default
+
+    thread_pool() = default;
+
+    explicit thread_pool(std::size_t /*threads*/){}
+
+    /*!
+     * \brief Return the number of workers of the pool
+     */
+    std::size_t size() const {
+        return 1;
+    }
 };
 
 template<>
 struct thread_pool<true> : cpp::default_thread_pool<> {
     //Simply inherits from default thread pool
+
+    std::size_t workers = std::thread::hardware_concurrency(); ///< The number of threads of the pool
+
+    thread_pool() = default;
+
+    /*!
+     * \brief Construct a pool with the given number of threads (0 for one
+     * per hardware thread)
+     */
+    explicit thread_pool(std::size_t threads) : cpp::default_thread_pool<>(threads ? threads : std::thread::hardware_concurrency()),
+            workers(threads ? threads : std::thread::hardware_concurrency()) {}
+
+    /*!
+     * \brief Return the number of workers of the pool
+     */
+    std::size_t size() const {
+        return std::max(workers, std::size_t(1));
+    }
 };
 
 template<typename Container, typename Functor>
@@ -60,6 +93,35 @@ void maybe_parallel_foreach_pair_i(thread_pool<false>& /*thread_pool*/, Iterator
     }
 }
 
+/*!
+ * \brief Call fun(first, last) on each block of the n elements
+ */
+template<typename Functor>
+void for_each_block(thread_pool<false>& /*pool*/, std::size_t n, std::size_t block, Functor&& fun){
+    for(std::size_t first = 0; first < n; first += block){
+        fun(first, std::min(n, first + block));
+    }
+}
+
+/*!
+ * \brief Call fun(first, last) on each block of the n elements, the blocks
+ * being distributed on the thread pool
+ */
+template<typename Functor>
+void for_each_block(thread_pool<true>& pool, std::size_t n, std::size_t block, Functor&& fun){
+    thread_local std::vector<std::size_t> starts;
+
+    starts.clear();
+
+    for(std::size_t first = 0; first < n; first += block){
+        starts.push_back(first);
+    }
+
+    parallel_foreach_i(pool, starts, [&fun, n, block](std::size_t first, std::size_t /*b*/){
+        fun(first, std::min(n, first + block));
+    });
+}
+
 } //end of dll namespace
 
 #endif
@@ -0,0 +1,245 @@
+//=======================================================================
+// Copyright (c) 2014 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file Parallel Tempering trainer
+ *
+ * The negative samples are taken from M persistent Gibbs chains run at
+ * different inverse temperatures, from 1 (the model distribution) down to
+ * 1/M. After the Gibbs step of each batch, before the parameters are
+ * updated, adjacent temperatures exchange their states with a Metropolis
+ * test, so that the well-mixing hot chains feed the cold one.
+ */
+
+#ifndef DLL_PARALLEL_TEMPERING_HPP
+#define DLL_PARALLEL_TEMPERING_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "etl/etl.hpp"
+
+#include "contrastive_divergence.hpp"
+#include "fused_sampling.hpp"
+#include "random.hpp"
+
+namespace dll {
+
+/*!
+ * \brief The state of the chains of one temperature
+ */
+template<typename RBM>
+struct tempered_replica {
+    using rbm_t = RBM;
+    using weight = typename rbm_t::weight;
+
+    weight beta; //Inverse temperature
+
+    etl::dyn_matrix<weight> v_a;
+    etl::dyn_matrix<weight> v_s;
+    etl::dyn_matrix<weight> h_a;
+    etl::dyn_matrix<weight> h_s;
+
+    etl::dyn_matrix<weight> vt; //Temporary for visible activations
+    etl::dyn_matrix<weight> ht; //Temporary for hidden activations
+
+    std::vector<weight> energy; //Energy of the current state of each chain
+
+    tempered_replica(const rbm_t& rbm, std::size_t n, weight beta) :
+            beta(beta),
+            v_a(n, num_visible(rbm)), v_s(n, num_visible(rbm)),
+            h_a(n, num_hidden(rbm)), h_s(n, num_hidden(rbm)),
+            vt(n, num_visible(rbm)), ht(n, num_hidden(rbm)),
+            energy(n, static_cast<weight>(0.0)) {
+        //Nothing else to init
+    }
+
+    /*!
+     * \brief Advance all the chains by one Gibbs step (h -> v -> h) at the
+     * temperature of the replica.
+     *
+     * The weights are only read, they are shared by all the replicas.
+     */
+    void gibbs_step(const rbm_t& rbm){
+        const auto v_stream = next_random_stream();
+
+        etl::mmul(h_s, etl::transpose(rbm.w), vt);
+
+        for(std::size_t i = 0; i < etl::rows(v_s); ++i){
+            tempered_sigmoid_bernoulli<true>(v_a(i), v_s(i), rbm.c, vt(i), beta, v_stream.row(i));
+        }
+
+        const auto h_stream = next_random_stream();
+
+        etl::mmul(v_s, rbm.w, ht);
+
+        for(std::size_t i = 0; i < etl::rows(h_s); ++i){
+            tempered_sigmoid_bernoulli<true>(h_a(i), h_s(i), rbm.b, ht(i), beta, h_stream.row(i));
+
+            //E(v,h) = -c.v - b.h - v.W.h (ht still contains v.W)
+            energy[i] = -etl::dot(rbm.c, v_s(i)) - etl::dot(rbm.b, h_s(i)) - etl::dot(ht(i), h_s(i));
+        }
+    }
+
+    /*!
+     * \brief Exchange the state of the chain i with the one of the chain i of rhs
+     */
+    void exchange(tempered_replica& rhs, std::size_t i){
+        std::swap_ranges(v_s(i).begin(), v_s(i).end(), rhs.v_s(i).begin());
+        std::swap_ranges(h_s(i).begin(), h_s(i).end(), rhs.h_s(i).begin());
+
+        std::swap(energy[i], rhs.energy[i]);
+    }
+};
+
+/*!
+ * \brief Parallel Tempering trainer for RBM.
+ *
+ * M replicas of batch_size persistent chains are run at the inverse
+ * temperatures 1, 1 - 1/M, ..., 1/M. Each replica is advanced on its own
+ * worker of the thread pool. The gradients are computed from the chains of
+ * the first replica (inverse temperature 1). Only binary units are
+ * supported.
+ */
+template<std::size_t M, typename RBM>
+struct parallel_tempering_trainer : base_cd_trainer<RBM> {
+    static_assert(M > 1, "Parallel Tempering needs at least two temperatures");
+    static_assert(!rbm_traits<RBM>::is_convolutional(), "Parallel Tempering is not supported for convolutional RBM");
+    static_assert(RBM::visible_unit == unit_type::BINARY && RBM::hidden_unit == unit_type::BINARY,
+        "Parallel Tempering is only supported for binary units");
+
+    typedef RBM rbm_t;
+    typedef typename rbm_t::weight weight;
+
+    //Offset between the random streams of two replicas (larger than any epoch)
+    static constexpr const std::size_t replica_stride = std::size_t(1) << 40;
+
+    rbm_t& rbm;
+
+    std::vector<tempered_replica<rbm_t>> replicas;
+
+    thread_pool<true> replica_pool; //One worker per temperature
+
+    std::size_t exchanges = 0; //Number of accepted exchanges between adjacent temperatures
+
+    parallel_tempering_trainer(rbm_t& rbm) : base_cd_trainer<RBM>(rbm), rbm(rbm), replica_pool(M) {
+        for(std::size_t m = 0; m < M; ++m){
+            replicas.emplace_back(rbm, get_batch_size(rbm), static_cast<weight>(1.0) - static_cast<weight>(m) / M);
+        }
+    }
+
+    /*!
+     * \brief Exchange the states of adjacent temperatures with a Metropolis test
+     */
+    void exchange_replicas(){
+        const auto stream = next_random_stream();
+        const std::size_t n = replicas[0].energy.size();
+
+        for(std::size_t m = 0; m + 1 < M; ++m){
+            auto& cold = replicas[m];
+            auto& hot = replicas[m + 1];
+
+            for(std::size_t i = 0; i < n; ++i){
+                const weight log_ratio = (cold.beta - hot.beta) * (cold.energy[i] - hot.energy[i]);
+
+                if(log_ratio >= 0.0 || stream.uniform(m * n + i) < std::exp(log_ratio)){
+                    cold.exchange(hot, i);
+                    ++exchanges;
+                }
+            }
+        }
+    }
+
+    template<typename T>
+    void train_batch(const dll::batch<T>& input_batch, const dll::batch<T>& expected_batch, rbm_training_context& context){
+        using namespace etl;
+
+        auto& t = *this;
+
+        seed_random_streams(context.seed, context.epoch, context.sample);
+
+        //Copy input/expected for computations
+        maybe_parallel_foreach_pair_i(t.pool, input_batch.begin(), input_batch.end(), expected_batch.begin(), expected_batch.end(),
+                [&t](const auto& input, const auto& expected, std::size_t i)
+        {
+            t.v1(i) = input;
+            t.vf(i) = expected;
+        });
+
+        //Positive phase
+        rbm.template batch_activate_hidden<true, true>(t.h1_a, t.h1_s, t.v1, t.v1, t.ht);
+
+        //Reconstruction, only used to monitor the training
+        rbm.template batch_activate_visible<true, false>(t.h1_a, t.h1_s, t.v2_a, t.v2_s, t.vt);
+
+        if(!t.init){
+            //All the chains start from the data
+            for(auto& replica : replicas){
+                replica.h_s = t.h1_s;
+            }
+
+            t.init = true;
+        }
+
+        //Negative phase, one replica per worker
+
+        maybe_parallel_foreach_i(replica_pool, replicas, [&](const auto&, std::size_t m){
+            seed_random_streams(context.seed, context.epoch, context.sample + (m + 1) * replica_stride);
+
+            replicas[m].gibbs_step(rbm);
+        });
+
+        auto& model = replicas[0];
+
+        context.reconstruction_error += mean((t.vf - t.v2_a) * (t.vf - t.v2_a));
+
+        //Compute the gradients
+
+        etl::mmul(etl::transpose(t.vf), t.h1_a, t.w_grad);
+        etl::mmul(etl::transpose(model.v_a), model.h_a, t.w_neg);
+
+        t.w_grad = (t.w_grad - t.w_neg) / static_cast<weight>(etl::rows(t.vf));
+        t.b_grad = mean_l(t.h1_a - model.h_a);
+        t.c_grad = mean_l(t.vf - model.v_a);
+
+        nan_check_deep_3(t.w_grad, t.b_grad, t.c_grad);
+
+        //Compute the mean activation probabilities
+        t.q_global_batch = mean(model.h_a);
+
+        if(rbm_traits<rbm_t>::sparsity_method() == sparsity_method::LOCAL_TARGET){
+            t.q_local_batch = mean_l(model.h_a);
+        }
+
+        //Accumulate the sparsity
+        context.sparsity += t.q_global_batch;
+
+        //The energies were computed by the Gibbs step with the current
+        //parameters, the exchanges must be done before the update
+        seed_random_streams(context.seed, context.epoch, context.sample + (M + 1) * replica_stride);
+
+        exchange_replicas();
+
+        //Update the weights and biases based on the gradients
+        t.update(rbm);
+    }
+
+    static std::string name(){
+        return "Parallel Tempering";
+    }
+};
+
+/*!
+ * \brief Parallel Tempering trainer with 4 temperatures for RBM
+ */
+template <typename RBM>
+using pt4_trainer_t = parallel_tempering_trainer<4, RBM>;
+
+} //end of dll namespace
+
+#endif
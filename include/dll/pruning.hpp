@@ -0,0 +1,457 @@
+//=======================================================================
+// Copyright (c) 2014 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file Magnitude pruning of dense DBN
+ *
+ * The small weights of a trained network are removed, either below a
+ * threshold or beyond the k largest weights of each hidden unit. The pruned
+ * network stores the remaining weights of each hidden unit in compressed
+ * sparse columns (CSC), the forward pass only goes through them.
+ */
+
+#ifndef DLL_PRUNING_HPP
+#define DLL_PRUNING_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "cpp_utils/assert.hpp"
+#include "cpp_utils/tuple_utils.hpp"
+
+#include "etl/etl.hpp"
+
+#include "frozen_dbn.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Keep the weights whose magnitude is at least the threshold
+ */
+struct magnitude_pruning {
+    double threshold;
+
+    explicit magnitude_pruning(double threshold) : threshold(threshold) {}
+
+    /*!
+     * \brief Return the (sorted) rows of the weights kept in the column j of w
+     */
+    template<typename W>
+    std::vector<std::size_t> kept(const W& w, std::size_t j) const {
+        std::vector<std::size_t> rows;
+
+        for(std::size_t i = 0; i < etl::rows(w); ++i){
+            if(w(i, j) != 0.0 && std::abs(w(i, j)) >= threshold){
+                rows.push_back(i);
+            }
+        }
+
+        return rows;
+    }
+};
+
+/*!
+ * \brief Keep the k weights of largest magnitude of each hidden unit
+ */
+struct top_k_pruning {
+    std::size_t k;
+
+    explicit top_k_pruning(std::size_t k) : k(k) {}
+
+    /*!
+     * \brief Return the (sorted) rows of the weights kept in the column j of w
+     */
+    template<typename W>
+    std::vector<std::size_t> kept(const W& w, std::size_t j) const {
+        std::vector<std::size_t> rows;
+
+        for(std::size_t i = 0; i < etl::rows(w); ++i){
+            if(w(i, j) != 0.0){
+                rows.push_back(i);
+            }
+        }
+
+        if(rows.size() > k){
+            std::nth_element(rows.begin(), rows.begin() + k, rows.end(), [&w, j](std::size_t lhs, std::size_t rhs){
+                return std::abs(w(lhs, j)) > std::abs(w(rhs, j));
+            });
+
+            rows.resize(k);
+            std::sort(rows.begin(), rows.end());
+        }
+
+        return rows;
+    }
+};
+
+/*!
+ * \brief Zero the weights of the given RBM that are not kept by the policy
+ *
+ * \return the number of weights that have been zeroed
+ */
+template<typename RBM, typename Policy>
+std::size_t prune(RBM& rbm, const Policy& policy){
+    static_assert(!rbm_traits<RBM>::is_convolutional(), "Only dense RBM can be pruned");
+
+    std::size_t pruned = 0;
+
+    for(std::size_t j = 0; j < num_hidden(rbm); ++j){
+        auto rows = policy.kept(rbm.w, j);
+        auto it = rows.begin();
+
+        for(std::size_t i = 0; i < num_visible(rbm); ++i){
+            if(it != rows.end() && *it == i){
+                ++it;
+            } else if(rbm.w(i, j) != 0.0){
+                rbm.w(i, j) = 0.0;
+                ++pruned;
+            }
+        }
+    }
+
+    return pruned;
+}
+
+/*!
+ * \brief Zero the weights of all the layers of the given DBN that are not
+ * kept by the policy
+ *
+ * \return the number of weights that have been zeroed
+ */
+template<typename DBN, typename Policy>
+std::size_t prune_dbn(DBN& dbn, const Policy& policy){
+    std::size_t pruned = 0;
+
+    cpp::for_each(dbn.tuples, [&pruned, &policy](auto& rbm){
+        pruned += prune(rbm, policy);
+    });
+
+    return pruned;
+}
+
+/*!
+ * \brief Inference-only copy of a pruned dense DBN.
+ *
+ * Only the non-zero weights are stored, column by column: the weights of
+ * the hidden unit j of a layer are values[start[j] .. start[j + 1]) and
+ * their visible units are rows[start[j] .. start[j + 1]). All the
+ * inference functions are const.
+ */
+template<typename Weight = double>
+struct pruned_dbn : inference_dbn<pruned_dbn<Weight>, Weight> {
+    using base_type = inference_dbn<pruned_dbn<Weight>, Weight>;
+    using weight = Weight;
+
+    friend base_type;
+
+    /*!
+     * \brief The description of one layer
+     */
+    struct layer_t {
+        std::size_t num_visible;
+        std::size_t num_hidden;
+        std::size_t start;     //Offset of the column starts of the layer
+        std::size_t b;         //Offset of the hidden biases of the layer
+        unit_type hidden_unit;
+        std::size_t input;     //Ping-pong buffer read by the layer
+        std::size_t output;    //Ping-pong buffer written by the layer
+    };
+
+    using workspace = ping_pong_workspace<weight>; ///< The buffers used for inference
+
+    /*!
+     * \brief The buffers used for batched inference.
+     *
+     * The two ping-pong buffers hold the batch unit by unit (transposed).
+     * They only grow, so reusing a workspace for batches of the same size
+     * does not allocate. A batch workspace must not be shared by several
+     * threads.
+     */
+    struct batch_workspace {
+        std::size_t size;            //Number of units of each buffer
+        std::size_t n = 0;           //Number of samples of the current batch
+        std::vector<weight> buffers;
+        std::vector<weight> sample;  //The units of one sample, for the softmax
+
+        explicit batch_workspace(const pruned_dbn& dbn) : size(dbn.buffer_size), sample(dbn.buffer_size) {
+            //Nothing else to init
+        }
+
+        /*!
+         * \brief Prepare the buffers for a batch of n samples
+         */
+        void resize(std::size_t n){
+            this->n = n;
+            buffers.resize(2 * size * n);
+        }
+
+        weight* buffer(std::size_t i){
+            return buffers.data() + i * size * n;
+        }
+    };
+
+    std::vector<layer_t> plan;
+    std::vector<std::size_t> starts;  //Start of each column, followed by the end of the last one, for each layer
+    std::vector<std::uint32_t> rows;  //Visible unit of each weight
+    std::vector<weight> values;       //Non-zero weights
+    std::vector<weight> biases;       //Hidden biases
+    std::size_t dense_weights = 0;    //Number of weights before pruning
+
+    /*!
+     * \brief Copy the non-zero weights of the given network
+     */
+    template<typename DBN>
+    explicit pruned_dbn(const DBN& dbn){
+        build(dbn, [](const auto& w, std::size_t j){
+            std::vector<std::size_t> kept;
+
+            for(std::size_t i = 0; i < etl::rows(w); ++i){
+                if(w(i, j) != 0.0){
+                    kept.push_back(i);
+                }
+            }
+
+            return kept;
+        });
+    }
+
+    /*!
+     * \brief Copy the weights of the given network that are kept by the
+     * policy. The network itself is not modified.
+     */
+    template<typename DBN, typename Policy>
+    pruned_dbn(const DBN& dbn, const Policy& policy){
+        build(dbn, [&policy](const auto& w, std::size_t j){
+            return policy.kept(w, j);
+        });
+    }
+
+    /*!
+     * \brief Load a network of type DBN from the given file and prune it
+     *
+     * \return the network or nullptr if the file does not contain a model
+     * of DBN or if the model is corrupted
+     */
+    template<typename DBN, typename Policy>
+    static std::unique_ptr<pruned_dbn> load(const std::string& file, const Policy& policy){
+        auto dbn = std::make_unique<DBN>();
+
+        if(!dbn->load(file)){
+            return nullptr;
+        }
+
+        return std::make_unique<pruned_dbn>(*dbn, policy);
+    }
+
+    std::size_t input_size() const {
+        return plan.front().num_visible;
+    }
+
+    std::size_t output_size() const {
+        return plan.back().num_hidden;
+    }
+
+    /*!
+     * \brief Return the ratio of weights kept after pruning
+     */
+    double density() const {
+        return values.size() / static_cast<double>(dense_weights);
+    }
+
+    /*!
+     * \brief Return the number of bytes used by the parameters
+     */
+    std::size_t memory_size() const {
+        return starts.size() * sizeof(std::size_t) + rows.size() * sizeof(std::uint32_t)
+            + (values.size() + biases.size()) * sizeof(weight);
+    }
+
+    /*!
+     * \brief Compute the activation probabilities of the last layer for a
+     * batch of samples, using the buffers of the given batch workspace.
+     *
+     * Each row of inputs is a sample and each row of result receives the
+     * output of the corresponding sample.
+     */
+    template<typename Input, typename Output>
+    void activation_probabilities_batch(const Input& inputs, Output& result, batch_workspace& ws) const {
+        const std::size_t n = etl::rows(inputs);
+        const weight* output = batch_forward(inputs, ws);
+
+        for(std::size_t s = 0; s < n; ++s){
+            for(std::size_t j = 0; j < output_size(); ++j){
+                result(s, j) = output[j * n + s];
+            }
+        }
+    }
+
+    template<typename Input, typename Output>
+    void activation_probabilities_batch(const Input& inputs, Output& result) const {
+        batch_workspace ws(*this);
+        activation_probabilities_batch(inputs, result, ws);
+    }
+
+    /*!
+     * \brief Predict the labels of a batch of samples, using the buffers of
+     * the given batch workspace.
+     *
+     * Each row of inputs is a sample, the label of the i-th sample is
+     * written in labels[i].
+     */
+    template<typename Input, typename Labels>
+    void predict_batch(const Input& inputs, Labels& labels, batch_workspace& ws) const {
+        const std::size_t n = etl::rows(inputs);
+        const weight* output = batch_forward(inputs, ws);
+
+        for(std::size_t s = 0; s < n; ++s){
+            std::size_t label = 0;
+
+            for(std::size_t l = 1; l < output_size(); ++l){
+                if(output[l * n + s] > output[label * n + s]){
+                    label = l;
+                }
+            }
+
+            labels[s] = label;
+        }
+    }
+
+    template<typename Input, typename Labels>
+    void predict_batch(const Input& inputs, Labels& labels) const {
+        batch_workspace ws(*this);
+        predict_batch(inputs, labels, ws);
+    }
+
+private:
+    /*!
+     * \brief Propagate a batch of samples through all the layers.
+     *
+     * The batch is stored unit by unit (transposed) between the layers, so
+     * that each sparse column is read once for the whole batch.
+     *
+     * \return the transposed activation probabilities of the last layer
+     * (stored in the workspace)
+     */
+    template<typename Input>
+    const weight* batch_forward(const Input& inputs, batch_workspace& ws) const {
+        const std::size_t n = etl::rows(inputs);
+
+        ws.resize(n);
+
+        weight* v = ws.buffer(plan.front().input);
+
+        for(std::size_t s = 0; s < n; ++s){
+            for(std::size_t i = 0; i < input_size(); ++i){
+                v[i * n + s] = inputs(s, i);
+            }
+        }
+
+        for(auto& layer : plan){
+            v = ws.buffer(layer.input);
+            weight* h = ws.buffer(layer.output);
+
+            const std::size_t* start = starts.data() + layer.start;
+            const weight* b = biases.data() + layer.b;
+
+            //SpMM, one sparse column per hidden unit
+            for(std::size_t j = 0; j < layer.num_hidden; ++j){
+                weight* h_j = h + j * n;
+
+                std::fill(h_j, h_j + n, b[j]);
+
+                for(std::size_t k = start[j]; k < start[j + 1]; ++k){
+                    const weight x = values[k];
+                    const weight* v_i = v + rows[k] * n;
+
+                    for(std::size_t s = 0; s < n; ++s){
+                        h_j[s] += x * v_i[s];
+                    }
+                }
+            }
+
+            if(layer.hidden_unit == unit_type::SOFTMAX){
+                //The softmax is computed over the units of each sample
+                weight* sample = ws.sample.data();
+
+                for(std::size_t s = 0; s < n; ++s){
+                    for(std::size_t j = 0; j < layer.num_hidden; ++j){
+                        sample[j] = h[j * n + s];
+                    }
+
+                    detail::frozen_activate(layer.hidden_unit, sample, layer.num_hidden);
+
+                    for(std::size_t j = 0; j < layer.num_hidden; ++j){
+                        h[j * n + s] = sample[j];
+                    }
+                }
+            } else {
+                detail::frozen_activate(layer.hidden_unit, h, layer.num_hidden * n);
+            }
+        }
+
+        return ws.buffer(plan.back().output);
+    }
+
+    void activate(const layer_t& layer, const weight* v, weight* h, workspace&) const {
+        const std::size_t* start = starts.data() + layer.start;
+        const weight* b = biases.data() + layer.b;
+
+        //SpMV, one sparse column per hidden unit
+        for(std::size_t j = 0; j < layer.num_hidden; ++j){
+            weight x = b[j];
+
+            for(std::size_t k = start[j]; k < start[j + 1]; ++k){
+                x += values[k] * v[rows[k]];
+            }
+
+            h[j] = x;
+        }
+
+        detail::frozen_activate(layer.hidden_unit, h, layer.num_hidden);
+    }
+
+    template<typename DBN, typename Kept>
+    void build(const DBN& dbn, Kept&& kept){
+        static_assert(!dbn_traits<DBN>::is_convolutional(), "pruned_dbn only supports dense networks");
+
+        for_each_layer(dbn.tuples, [this, &kept](std::size_t, const auto& rbm){
+            using rbm_t = std::decay_t<decltype(rbm)>;
+
+            layer_t layer;
+            layer.num_visible = dll::num_visible(rbm);
+            layer.num_hidden = dll::num_hidden(rbm);
+            layer.start = starts.size();
+            layer.b = biases.size();
+            layer.hidden_unit = rbm_t::hidden_unit;
+
+            for(std::size_t j = 0; j < layer.num_hidden; ++j){
+                starts.push_back(values.size());
+
+                for(auto i : kept(rbm.w, j)){
+                    rows.push_back(static_cast<std::uint32_t>(i));
+                    values.push_back(rbm.w(i, j));
+                }
+
+                biases.push_back(rbm.b(j));
+            }
+
+            starts.push_back(values.size());
+
+            dense_weights += layer.num_visible * layer.num_hidden;
+
+            this->push_layer(layer);
+        });
+    }
+};
+
+} //end of dll namespace
+
+#endif
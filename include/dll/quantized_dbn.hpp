@@ -0,0 +1,290 @@
+//=======================================================================
+// Copyright (c) 2014 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file Int8 quantized inference for dense DBN
+ *
+ * The weights of each hidden unit (each column of W) are quantized to int8
+ * with their own scale. The inputs of each layer are quantized to int8 with
+ * one scale per sample. The products are accumulated in int32 and then
+ * dequantized before the bias and the activation function are applied.
+ */
+
+#ifndef DLL_QUANTIZED_DBN_HPP
+#define DLL_QUANTIZED_DBN_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "cpp_utils/assert.hpp"
+
+#include "etl/etl.hpp"
+
+#include "frozen_dbn.hpp"
+
+namespace dll {
+
+namespace detail {
+
+/*!
+ * \brief Compute the dot product of n int8 values of a and b.
+ *
+ * With AVX512-VNNI, a must have been shifted by 128 (see
+ * quantized_unsigned_input). n must be a multiple of 64, the vectors are
+ * padded with zeroes and b is aligned on 64 bytes.
+ */
+inline std::int32_t quantized_dot(const std::int8_t* a, const std::int8_t* b, std::size_t n){
+#if defined(__AVX512VNNI__) && defined(__AVX512VL__)
+    __m256i acc = _mm256_setzero_si256();
+
+    for(std::size_t i = 0; i < n; i += 32){
+        auto va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+        auto vb = _mm256_load_si256(reinterpret_cast<const __m256i*>(b + i));
+        acc = _mm256_dpbusd_epi32(acc, va, vb);
+    }
+
+    __m128i s = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+    s = _mm_hadd_epi32(s, s);
+    s = _mm_hadd_epi32(s, s);
+    return _mm_cvtsi128_si32(s);
+#elif defined(__AVX2__)
+    __m256i acc = _mm256_setzero_si256();
+
+    for(std::size_t i = 0; i < n; i += 16){
+        auto va = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i)));
+        auto vb = _mm256_cvtepi8_epi16(_mm_load_si128(reinterpret_cast<const __m128i*>(b + i)));
+        acc = _mm256_add_epi32(acc, _mm256_madd_epi16(va, vb));
+    }
+
+    __m128i s = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+    s = _mm_hadd_epi32(s, s);
+    s = _mm_hadd_epi32(s, s);
+    return _mm_cvtsi128_si32(s);
+#else
+    std::int32_t acc = 0;
+
+    for(std::size_t i = 0; i < n; ++i){
+        acc += static_cast<std::int32_t>(a[i]) * static_cast<std::int32_t>(b[i]);
+    }
+
+    return acc;
+#endif
+}
+
+//VNNI only multiplies unsigned bytes by signed bytes, the inputs are then
+//shifted to unsigned (x + 128) and the dot products are corrected by 128
+//times the sum of the weights
+#if defined(__AVX512VNNI__) && defined(__AVX512VL__)
+constexpr const bool quantized_unsigned_input = true;
+#else
+constexpr const bool quantized_unsigned_input = false;
+#endif
+
+} //end of namespace detail
+
+/*!
+ * \brief Int8 quantized copy of a dense DBN for inference.
+ *
+ * The weights of the hidden unit j of a layer are stored as a row of int8,
+ * padded to a multiple of 64 values, with the scale of the row. The biases
+ * stay in floating point. All the inference functions are const, several
+ * threads can use the same network, each with its own workspace.
+ */
+template<typename Weight = double>
+struct quantized_dbn : inference_dbn<quantized_dbn<Weight>, Weight> {
+    using base_type = inference_dbn<quantized_dbn<Weight>, Weight>;
+    using weight = Weight;
+
+    friend base_type;
+
+    static constexpr const std::size_t row_alignment = 64;
+
+    /*!
+     * \brief The description of one layer
+     */
+    struct layer_t {
+        std::size_t num_visible;
+        std::size_t num_hidden;
+        std::size_t stride;    //Number of int8 values of each row
+        std::size_t w;         //Offset of the int8 weights (num_hidden x stride)
+        std::size_t scale;     //Offset of the scales of the rows
+        std::size_t b;         //Offset of the hidden biases
+        std::size_t sum;       //Offset of the sums of the rows
+        unit_type hidden_unit;
+        std::size_t input;     //Ping-pong buffer read by the layer
+        std::size_t output;    //Ping-pong buffer written by the layer
+    };
+
+    /*!
+     * \brief The buffers of the inference
+     *
+     * A workspace must not be shared by several threads.
+     */
+    struct workspace : ping_pong_workspace<weight> {
+        detail::frozen_blob<std::int8_t> input; //Quantized input of the current layer
+
+        explicit workspace(const quantized_dbn& dbn) : ping_pong_workspace<weight>(dbn) {
+            input.reserve(dbn.input_stride);
+            input.allocate();
+        }
+    };
+
+    std::vector<layer_t> plan;
+    detail::frozen_blob<std::int8_t> weights; //Quantized weights
+    detail::frozen_blob<weight> params;       //Scales and biases
+    std::vector<std::int32_t> sums;           //Sums of the quantized rows
+    std::size_t input_stride = 0;             //Largest stride of the layers
+
+    /*!
+     * \brief Quantize the given network
+     */
+    template<typename DBN>
+    explicit quantized_dbn(const DBN& dbn){
+        static_assert(!dbn_traits<DBN>::is_convolutional(), "quantized_dbn only supports dense networks");
+
+        for_each_layer(dbn.tuples, [this](std::size_t, const auto& rbm){
+            using rbm_t = std::decay_t<decltype(rbm)>;
+
+            layer_t layer;
+            layer.num_visible = dll::num_visible(rbm);
+            layer.num_hidden = dll::num_hidden(rbm);
+            layer.stride = ((layer.num_visible + row_alignment - 1) / row_alignment) * row_alignment;
+            layer.w = weights.reserve(layer.num_hidden * layer.stride);
+            layer.scale = params.reserve(layer.num_hidden);
+            layer.b = params.reserve(layer.num_hidden);
+            layer.sum = sums.size();
+            layer.hidden_unit = rbm_t::hidden_unit;
+
+            sums.resize(sums.size() + layer.num_hidden);
+
+            input_stride = std::max(input_stride, layer.stride);
+
+            this->push_layer(layer);
+        });
+
+        weights.allocate();
+        params.allocate();
+
+        for_each_layer(dbn.tuples, [this](std::size_t I, const auto& rbm){
+            quantize(plan[I], rbm.w, rbm.b);
+        });
+    }
+
+    /*!
+     * \brief Load a network of type DBN from the given file and quantize it.
+     *
+     * The full network only lives during the loading.
+     *
+     * \return the network or nullptr if the file does not contain a model
+     * of DBN or if the model is corrupted
+     */
+    template<typename DBN>
+    static std::unique_ptr<quantized_dbn> load(const std::string& file){
+        auto dbn = std::make_unique<DBN>();
+
+        if(!dbn->load(file)){
+            return nullptr;
+        }
+
+        return std::make_unique<quantized_dbn>(*dbn);
+    }
+
+    std::size_t input_size() const {
+        return plan.front().num_visible;
+    }
+
+    std::size_t output_size() const {
+        return plan.back().num_hidden;
+    }
+
+    /*!
+     * \brief Return the number of bytes used by the parameters
+     */
+    std::size_t memory_size() const {
+        return weights.storage.size() + params.storage.size() * sizeof(weight) + sums.size() * sizeof(std::int32_t);
+    }
+
+private:
+    template<typename W, typename B>
+    void quantize(const layer_t& layer, const W& w, const B& b){
+        for(std::size_t j = 0; j < layer.num_hidden; ++j){
+            weight max = 0.0;
+
+            for(std::size_t i = 0; i < layer.num_visible; ++i){
+                max = std::max(max, static_cast<weight>(std::abs(w(i, j))));
+            }
+
+            const weight scale = max > 0.0 ? max / 127.0 : 1.0;
+
+            std::int8_t* row = weights.data(layer.w + j * layer.stride);
+            std::int32_t sum = 0;
+
+            for(std::size_t i = 0; i < layer.num_visible; ++i){
+                row[i] = static_cast<std::int8_t>(std::lround(w(i, j) / scale));
+                sum += row[i];
+            }
+
+            params.data(layer.scale)[j] = scale;
+            params.data(layer.b)[j] = b[j];
+            sums[layer.sum + j] = sum;
+        }
+    }
+
+    void activate(const layer_t& layer, const weight* v, weight* h, workspace& ws) const {
+        std::int8_t* x = ws.input.data(0); //Quantized input
+
+        const weight* scale = params.data(layer.scale);
+        const weight* b = params.data(layer.b);
+
+        //Quantize the input with a single scale
+        weight max = 0.0;
+
+        for(std::size_t i = 0; i < layer.num_visible; ++i){
+            max = std::max(max, std::abs(v[i]));
+        }
+
+        const weight x_scale = max > 0.0 ? max / 127.0 : 1.0;
+
+        for(std::size_t i = 0; i < layer.num_visible; ++i){
+            x[i] = static_cast<std::int8_t>(std::lround(v[i] / x_scale));
+        }
+
+        std::fill(x + layer.num_visible, x + layer.stride, 0);
+
+        if(detail::quantized_unsigned_input){
+            for(std::size_t i = 0; i < layer.stride; ++i){
+                x[i] = static_cast<std::int8_t>(static_cast<std::uint8_t>(x[i]) ^ 0x80);
+            }
+        }
+
+        for(std::size_t j = 0; j < layer.num_hidden; ++j){
+            const std::int8_t* row = weights.data(layer.w + j * layer.stride);
+
+            std::int32_t acc = detail::quantized_dot(x, row, layer.stride);
+
+            if(detail::quantized_unsigned_input){
+                acc -= 128 * sums[layer.sum + j];
+            }
+
+            h[j] = b[j] + static_cast<weight>(acc) * x_scale * scale[j];
+        }
+
+        detail::frozen_activate(layer.hidden_unit, h, layer.num_hidden);
+    }
+};
+
+} //end of dll namespace
+
+#endif
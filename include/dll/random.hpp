@@ -0,0 +1,403 @@
+//=======================================================================
+// Copyright (c) 2014 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file Counter-based random streams
+ *
+ * All the random numbers used for sampling are computed with the
+ * Philox4x32-10 generator, keyed by (seed, epoch) and indexed by
+ * (sample, draw, unit). There is no shared generator state: each thread
+ * only keeps the position of its current stream. The values drawn for a
+ * given sample do not depend on which thread processes it.
+ */
+
+#ifndef DLL_RANDOM_HPP
+#define DLL_RANDOM_HPP
+
+#include <cstdint>
+#include <cmath>
+#include <array>
+#include <random>
+
+#include "etl/etl.hpp"
+
+#include "math.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Compute one block of four 32-bit random words with Philox4x32-10.
+ */
+inline std::array<std::uint32_t, 4> philox4x32(std::array<std::uint32_t, 4> ctr, std::array<std::uint32_t, 2> key){
+    for(std::size_t round = 0; round < 10; ++round){
+        const std::uint64_t p0 = std::uint64_t(0xD2511F53) * ctr[0];
+        const std::uint64_t p1 = std::uint64_t(0xCD9E8D57) * ctr[2];
+
+        ctr = {{
+            static_cast<std::uint32_t>(p1 >> 32) ^ ctr[1] ^ key[0],
+            static_cast<std::uint32_t>(p1),
+            static_cast<std::uint32_t>(p0 >> 32) ^ ctr[3] ^ key[1],
+            static_cast<std::uint32_t>(p0)}};
+
+        key[0] += 0x9E3779B9;
+        key[1] += 0xBB67AE85;
+    }
+
+    return ctr;
+}
+
+/*!
+ * \brief Compute W blocks of Philox4x32-10 at once.
+ *
+ * The words are stored by lane: c[k][w] is the k-th word of the w-th block.
+ * Each round is computed on all the blocks together, with no dependency
+ * between the lanes, so that the rounds can be vectorized. The result of
+ * each block is the same as with philox4x32.
+ */
+template<std::size_t W>
+void philox4x32_lanes(std::uint32_t (&c)[4][W], std::array<std::uint32_t, 2> key){
+    for(std::size_t round = 0; round < 10; ++round){
+        for(std::size_t w = 0; w < W; ++w){
+            const std::uint64_t p0 = std::uint64_t(0xD2511F53) * c[0][w];
+            const std::uint64_t p1 = std::uint64_t(0xCD9E8D57) * c[2][w];
+
+            const std::uint32_t c1 = c[1][w];
+            const std::uint32_t c3 = c[3][w];
+
+            c[0][w] = static_cast<std::uint32_t>(p1 >> 32) ^ c1 ^ key[0];
+            c[1][w] = static_cast<std::uint32_t>(p1);
+            c[2][w] = static_cast<std::uint32_t>(p0 >> 32) ^ c3 ^ key[1];
+            c[3][w] = static_cast<std::uint32_t>(p0);
+        }
+
+        key[0] += 0x9E3779B9;
+        key[1] += 0xBB67AE85;
+    }
+}
+
+/*!
+ * \brief Convert a random word to a uniform value in [0,1)
+ */
+inline float to_uniform(std::uint32_t x){
+    return static_cast<float>(x >> 8) * (1.0f / 16777216.0f);
+}
+
+/*!
+ * \brief Convert a random word to a uniform value in (0,1]
+ */
+inline double to_uniform_open(std::uint32_t x){
+    return (static_cast<double>(x) + 1.0) * (1.0 / 4294967296.0);
+}
+
+constexpr const std::uint32_t random_normal_kind = 0x80000000U; ///< Separates the blocks of the normal values from the uniform ones
+
+/*!
+ * \brief A stream of random numbers for one sampling pass.
+ *
+ * The value for a unit is a pure function of (seed, epoch, sample, draw, unit).
+ */
+struct random_stream {
+    std::uint32_t seed;
+    std::uint32_t epoch;
+    std::uint32_t draw;
+    std::uint64_t sample;
+    std::uint64_t unit_offset = 0;
+
+    /*!
+     * \brief Return the stream of the i-th sample after the current one
+     */
+    random_stream row(std::size_t i) const {
+        auto stream = *this;
+        stream.sample += i;
+        return stream;
+    }
+
+    /*!
+     * \brief Return a stream whose units are shifted by the given offset
+     */
+    random_stream shift(std::size_t units) const {
+        auto stream = *this;
+        stream.unit_offset += units;
+        return stream;
+    }
+
+    std::array<std::uint32_t, 4> block(std::uint64_t b, std::uint32_t kind = 0) const {
+        return philox4x32(
+            {{static_cast<std::uint32_t>(b), draw ^ kind, static_cast<std::uint32_t>(sample), static_cast<std::uint32_t>(sample >> 32)}},
+            {{seed, epoch}});
+    }
+
+    /*!
+     * \brief Uniform value in [0,1) for the given unit
+     */
+    float uniform(std::size_t unit) const {
+        const auto u = unit + unit_offset;
+        return to_uniform(block(u / 4)[u % 4]);
+    }
+
+    /*!
+     * \brief Fill out with the uniform values of the units [unit, unit + L)
+     *
+     * When the units start on a block, the L / 4 blocks are computed
+     * together, one per lane (see philox4x32_lanes).
+     */
+    template<std::size_t L>
+    void uniforms(std::size_t unit, float* out) const {
+        static_assert(L % 4 == 0, "The uniforms are generated by blocks of four");
+
+        constexpr const std::size_t W = L / 4;
+
+        const auto first = unit + unit_offset;
+
+        if(first % 4 == 0){
+            std::uint32_t c[4][W];
+
+            for(std::size_t w = 0; w < W; ++w){
+                c[0][w] = static_cast<std::uint32_t>(first / 4 + w);
+                c[1][w] = draw;
+                c[2][w] = static_cast<std::uint32_t>(sample);
+                c[3][w] = static_cast<std::uint32_t>(sample >> 32);
+            }
+
+            philox4x32_lanes<W>(c, {{seed, epoch}});
+
+            for(std::size_t w = 0; w < W; ++w){
+                for(std::size_t k = 0; k < 4; ++k){
+                    out[4 * w + k] = to_uniform(c[k][w]);
+                }
+            }
+        } else {
+            //Each block still gives the values of four units
+            std::array<std::uint32_t, 4> words;
+
+            for(std::size_t l = 0; l < L; ++l){
+                const auto u = first + l;
+
+                if(l == 0 || u % 4 == 0){
+                    words = block(u / 4);
+                }
+
+                out[l] = to_uniform(words[u % 4]);
+            }
+        }
+    }
+
+    /*!
+     * \brief Standard normal value for the given unit (Box-Muller)
+     *
+     * Each block gives two pairs of uniform values, and each pair gives the
+     * two outputs of the transform (cos and sin), so one block holds the
+     * values of four units.
+     */
+    double normal(std::size_t unit) const {
+        const auto u = unit + unit_offset;
+        const auto words = block(u / 4, random_normal_kind);
+        const auto k = u % 4 - u % 2; //First word of the pair of the unit
+
+        const double r = std::sqrt(-2.0 * std::log(to_uniform_open(words[k])));
+        const double theta = 6.283185307179586 * to_uniform_open(words[k + 1]);
+
+        return u % 2 ? r * std::sin(theta) : r * std::cos(theta);
+    }
+
+    /*!
+     * \brief Fill out with the standard normal values of the units
+     * [unit, unit + L), computing each block and each transform once
+     */
+    template<std::size_t L>
+    void normals(std::size_t unit, double* out) const {
+        const auto first = unit + unit_offset;
+
+        double z[4];
+
+        for(std::size_t l = 0; l < L; ++l){
+            const auto u = first + l;
+
+            if(l == 0 || u % 4 == 0){
+                const auto words = block(u / 4, random_normal_kind);
+
+                for(std::size_t k = 0; k < 4; k += 2){
+                    const double r = std::sqrt(-2.0 * std::log(to_uniform_open(words[k])));
+                    const double theta = 6.283185307179586 * to_uniform_open(words[k + 1]);
+
+                    z[k] = r * std::cos(theta);
+                    z[k + 1] = r * std::sin(theta);
+                }
+            }
+
+            out[l] = z[u % 4];
+        }
+    }
+};
+
+/*!
+ * \brief Position of the random streams of a thread
+ */
+struct random_state {
+    std::uint32_t seed;
+    std::uint32_t epoch = 0;
+    std::uint64_t sample = 0;
+    std::uint32_t draw = 0;
+
+    random_state() : seed(std::random_device()()) {}
+};
+
+/*!
+ * \brief Return the random state of the current thread
+ */
+inline random_state& local_random_state(){
+    static thread_local random_state state;
+    return state;
+}
+
+/*!
+ * \brief Position the random streams of the current thread.
+ *
+ * This must be called by each worker thread before sampling the
+ * given sample (or batch of samples starting at the given sample).
+ */
+inline void seed_random_streams(std::uint32_t seed, std::size_t epoch, std::size_t sample){
+    auto& state = local_random_state();
+
+    state.seed = seed;
+    state.epoch = static_cast<std::uint32_t>(epoch);
+    state.sample = sample;
+    state.draw = 0;
+}
+
+/*!
+ * \brief Return the stream for the next sampling pass of the current thread
+ */
+inline random_stream next_random_stream(){
+    auto& state = local_random_state();
+    return {state.seed, state.epoch, state.draw++, state.sample};
+}
+
+namespace detail {
+
+//Number of random values generated at once by the sampling functions
+constexpr const std::size_t sampling_block = 32;
+
+/*!
+ * \brief Call fun(j, u) with the uniform value u of each unit j in [0, n)
+ */
+template<typename Functor>
+void for_each_uniform(const random_stream& stream, std::size_t n, Functor&& fun){
+    alignas(32) float u[sampling_block];
+
+    for(std::size_t j = 0; j < n; j += sampling_block){
+        stream.uniforms<sampling_block>(j, u);
+
+        for(std::size_t l = 0; l < sampling_block && j + l < n; ++l){
+            fun(j + l, u[l]);
+        }
+    }
+}
+
+/*!
+ * \brief Call fun(j, z) with the standard normal value z of each unit j in
+ * [0, n)
+ */
+template<typename Functor>
+void for_each_normal(const random_stream& stream, std::size_t n, Functor&& fun){
+    double z[sampling_block];
+
+    for(std::size_t j = 0; j < n; j += sampling_block){
+        stream.normals<sampling_block>(j, z);
+
+        for(std::size_t l = 0; l < sampling_block && j + l < n; ++l){
+            fun(j + l, z[l]);
+        }
+    }
+}
+
+} //end of namespace detail
+
+//Sampling functions
+//The destination is written from the values of the source (which can be
+//any ETL expression) using the given stream
+
+/*!
+ * \brief dst = 1 with probability src, 0 otherwise
+ */
+template<typename D, typename E>
+void sample_bernoulli(D&& dst, const E& src, const random_stream& stream){
+    detail::for_each_uniform(stream, etl::size(dst), [&](std::size_t j, float u){
+        dst[j] = u < src[j] ? 1.0 : 0.0;
+    });
+}
+
+/*!
+ * \brief dst = 0 with probability src, 1 otherwise
+ */
+template<typename D, typename E>
+void sample_r_bernoulli(D&& dst, const E& src, const random_stream& stream){
+    detail::for_each_uniform(stream, etl::size(dst), [&](std::size_t j, float u){
+        dst[j] = u < src[j] ? 0.0 : 1.0;
+    });
+}
+
+/*!
+ * \brief dst = src + N(0,1)
+ */
+template<typename D, typename E>
+void sample_normal_noise(D&& dst, const E& src, const random_stream& stream){
+    detail::for_each_normal(stream, etl::size(dst), [&](std::size_t j, double z){
+        dst[j] = src[j] + z;
+    });
+}
+
+/*!
+ * \brief dst = src + N(0, sigmoid(src))
+ */
+template<typename D, typename E>
+void sample_logistic_noise(D&& dst, const E& src, const random_stream& stream){
+    detail::for_each_normal(stream, etl::size(dst), [&](std::size_t j, double z){
+        const double x = src[j];
+        dst[j] = x + logistic_sigmoid(x) * z;
+    });
+}
+
+/*!
+ * \brief dst = src + N(0,1), the bounds 0 and max being left untouched
+ */
+template<typename D, typename E, typename T>
+void sample_ranged_noise(D&& dst, const E& src, T max, const random_stream& stream){
+    detail::for_each_normal(stream, etl::size(dst), [&](std::size_t j, double z){
+        const double x = src[j];
+        dst[j] = (x == 0.0 || x == max) ? x : x + z;
+    });
+}
+
+template<typename D, typename E>
+void sample_bernoulli(D&& dst, const E& src){
+    sample_bernoulli(std::forward<D>(dst), src, next_random_stream());
+}
+
+template<typename D, typename E>
+void sample_r_bernoulli(D&& dst, const E& src){
+    sample_r_bernoulli(std::forward<D>(dst), src, next_random_stream());
+}
+
+template<typename D, typename E>
+void sample_normal_noise(D&& dst, const E& src){
+    sample_normal_noise(std::forward<D>(dst), src, next_random_stream());
+}
+
+template<typename D, typename E>
+void sample_logistic_noise(D&& dst, const E& src){
+    sample_logistic_noise(std::forward<D>(dst), src, next_random_stream());
+}
+
+template<typename D, typename E, typename T>
+void sample_ranged_noise(D&& dst, const E& src, T max){
+    sample_ranged_noise(std::forward<D>(dst), src, max, next_random_stream());
+}
+
+} //end of dll namespace
+
+#endif
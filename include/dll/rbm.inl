@@ -84,7 +84,7 @@ struct rbm final : public standard_rbm<rbm<Desc>, Desc> {
 
     template<bool P = true, bool S = true, typename H1, typename H2, typename V>
     void activate_hidden(H1&& h_a, H2&& h_s, const V& v_a, const V& v_s) const {
-        static etl::fast_matrix<weight, 1, num_hidden> t;
+        etl::fast_matrix<weight, 1, num_hidden> t;
         base_type::template std_activate_hidden<P, S>(std::forward<H1>(h_a), std::forward<H2>(h_s), v_a, v_s, b, w, t);
     }
 
@@ -95,13 +95,13 @@ struct rbm final : public standard_rbm<rbm<Desc>, Desc> {
 
     template<bool P = true, bool S = true, typename H1, typename H2, typename V, typename B, typename W>
     static void activate_hidden(H1&& h_a, H2&& h_s, const V& v_a, const V& v_s, const B& b, const W& w){
-        static etl::fast_matrix<weight, 1, num_hidden> t;
+        etl::fast_matrix<weight, 1, num_hidden> t;
         base_type::template std_activate_hidden<P, S>(std::forward<H1>(h_a), std::forward<H2>(h_s), v_a, v_s, b, w, t);
     }
 
     template<bool P = true, bool S = true, typename H, typename V>
     void activate_visible(const H& h_a, const H& h_s, V&& v_a, V&& v_s) const {
-        static etl::fast_matrix<weight, num_visible, 1> t;
+        etl::fast_matrix<weight, num_visible, 1> t;
         base_type::template std_activate_visible<P, S>(h_a, h_s, std::forward<V>(v_a), std::forward<V>(v_s), c, w, t);
     }
 
@@ -110,17 +110,35 @@ struct rbm final : public standard_rbm<rbm<Desc>, Desc> {
         base_type::template std_activate_visible<P, S>(h_a, h_s, std::forward<V>(v_a), std::forward<V>(v_s), c, w, std::forward<T>(t));
     }
 
+    template<bool P = true, bool S = true, typename H1, typename H2, typename V, typename T>
+    void batch_activate_hidden(H1&& h_a, H2&& h_s, const V& v_a, const V& v_s, T&& t) const {
+        base_type::template std_batch_activate_hidden<P, S>(std::forward<H1>(h_a), std::forward<H2>(h_s), v_a, v_s, b, w, std::forward<T>(t));
+    }
+
+    template<bool P = true, bool S = true, typename H1, typename H2, typename V1, typename V2, typename T>
+    void batch_activate_visible(const H1& h_a, const H2& h_s, V1&& v_a, V2&& v_s, T&& t) const {
+        base_type::template std_batch_activate_visible<P, S>(h_a, h_s, std::forward<V1>(v_a), std::forward<V2>(v_s), c, w, std::forward<T>(t));
+    }
+
+    template<bool P = true, bool S = true, typename H1, typename H2, typename V, typename B, typename W, typename T>
+    static void batch_activate_hidden(H1&& h_a, H2&& h_s, const V& v_a, const V& v_s, const B& b, const W& w, T&& t){
+        base_type::template std_batch_activate_hidden<P, S>(std::forward<H1>(h_a), std::forward<H2>(h_s), v_a, v_s, b, w, std::forward<T>(t));
+    }
+
+    template<bool P = true, bool S = true, typename H1, typename H2, typename V1, typename V2, typename C, typename W, typename T>
+    static void batch_activate_visible(const H1& h_a, const H2& h_s, V1&& v_a, V2&& v_s, const C& c, const W& w, T&& t){
+        base_type::template std_batch_activate_visible<P, S>(h_a, h_s, std::forward<V1>(v_a), std::forward<V2>(v_s), c, w, std::forward<T>(t));
+    }
+
     template<typename Sample, typename Output>
-    void activation_probabilities(const Sample& item_data, Output& result){
+    void activation_probabilities(const Sample& item_data, Output& result) const {
         etl::dyn_vector<weight> item(item_data);
 
-        static etl::dyn_vector<weight> next_s(num_hidden);
-
-        activate_hidden(result, next_s, item, item);
+        activate_hidden<true, false>(result, result, item, item);
     }
 
     template<typename Sample>
-    etl::dyn_vector<weight> activation_probabilities(const Sample& item_data){
+    etl::dyn_vector<weight> activation_probabilities(const Sample& item_data) const {
         etl::dyn_vector<weight> result(output_size());
 
         activation_probabilities(item_data, result);
@@ -8,10 +8,12 @@
 #ifndef DLL_RBM_BASE_HPP
 #define DLL_RBM_BASE_HPP
 
+#include <cstdint>
 #include <iostream>
 #include <fstream>
 
 #include "io.hpp"
+#include "model_file.hpp"     //Model files
 #include "rbm_trainer_fwd.hpp"
 
 namespace dll {
@@ -37,6 +39,8 @@ struct rbm_base {
 
     weight momentum = 0;                ///< The current momentum
 
+    weight fast_decay = 0.95;           ///< The decay of the fast weights of FPCD after each update
+
     weight l1_weight_cost = 0.0002;     ///< The weight cost for L1 weight decay
     weight l2_weight_cost = 0.0002;     ///< The weight cost for L2 weight decay
 
@@ -47,6 +51,10 @@ struct rbm_base {
     weight pbias = 0.002;
     weight pbias_lambda = 5;
 
+    std::uint32_t seed = 0;             ///< The seed of the random streams and of the shuffling (0 for a random seed)
+    std::size_t threads = 0;            ///< The number of threads of the parallel training (0 for one per hardware thread)
+    std::size_t parallel_chunks = 16;   ///< The number of chunks of a batch in parallel training (the result only depends on it)
+
     //No copying
 
 #ifdef __clang__
@@ -105,12 +113,18 @@ struct rbm_base {
         store(os, *static_cast<const parent_t*>(this));
     }
 
-    void load(const std::string& file){
-        load(file, *static_cast<parent_t*>(this));
+    /*!
+     * \brief Load the RBM from the given file.
+     *
+     * \return false if the file does not contain a model of this RBM or if
+     * the model is corrupted
+     */
+    bool load(const std::string& file){
+        return load(file, *static_cast<parent_t*>(this));
     }
 
-    void load(std::istream& is){
-        load(is, *static_cast<parent_t*>(this));
+    bool load(std::istream& is){
+        return load(is, *static_cast<parent_t*>(this));
     }
 
 private:
@@ -119,18 +133,17 @@ private:
     //to put the fields in standard_rbm, therefore, it is necessary to use template
     //functions to implement the details
 
+    //A RBM is stored as a model with a single layer
+
     template<typename RBM>
     static void store(std::ostream& os, const RBM& rbm){
-        binary_write_all(os, rbm.w);
-        binary_write_all(os, rbm.b);
-        binary_write_all(os, rbm.c);
+        write_model(os, std::tie(rbm));
     }
 
     template<typename RBM>
-    static void load(std::istream& is, RBM& rbm){
-        binary_load_all(is, rbm.w);
-        binary_load_all(is, rbm.b);
-        binary_load_all(is, rbm.c);
+    static bool load(std::istream& is, RBM& rbm){
+        auto layers = std::tie(rbm);
+        return read_model(is, layers);
     }
 
     template<typename RBM>
@@ -140,9 +153,9 @@ private:
     }
 
     template<typename RBM>
-    static void load(const std::string& file, RBM& rbm){
+    static bool load(const std::string& file, RBM& rbm){
         std::ifstream is(file, std::ifstream::binary);
-        load(is, rbm);
+        return load(is, rbm);
     }
 };
 
@@ -9,6 +9,8 @@
 #define DLL_RBM_TRAINER_HPP
 
 #include <memory>
+#include <random>
+#include <cstdint>
 
 #include "cpp_utils/algorithm.hpp"
 
@@ -86,16 +88,18 @@ struct rbm_trainer {
 
         typename rbm_t::weight last_error = 0.0;
 
+        //All the random numbers of the training are derived from this seed
+        const std::uint32_t seed = rbm.seed ? rbm.seed : std::random_device()();
+
+        std::mt19937_64 shuffle_engine(seed);
+
         //Train for max_epochs epoch
         for(std::size_t epoch= 0; epoch < max_epochs; ++epoch){
             if(rbm_traits<rbm_t>::has_shuffle()){
-                std::random_device rd;
-                std::mt19937_64 g(rd());
-
                 if(Denoising){
-                    cpp::parallel_shuffle(input_first, input_last, expected_first, expected_last, g);
+                    cpp::parallel_shuffle(input_first, input_last, expected_first, expected_last, shuffle_engine);
                 } else {
-                    std::shuffle(input_first, input_last, g);
+                    std::shuffle(input_first, input_last, shuffle_engine);
                 }
             }
 
@@ -109,10 +113,15 @@ struct rbm_trainer {
             //Create a new context for this epoch
             rbm_training_context context;
 
+            context.seed = seed;
+            context.epoch = epoch;
+
             while(iit != end){
                 auto istart = iit;
                 auto estart = eit;
 
+                context.sample = samples;
+
                 std::size_t i = 0;
                 while(iit != end && i < batch_size){
                     ++iit;
@@ -8,6 +8,9 @@
 #ifndef DLL_RBM_TRAINING_CONTEXT_HPP
 #define DLL_RBM_TRAINING_CONTEXT_HPP
 
+#include <cstdint>
+#include <cstddef>
+
 namespace dll {
 
 /*!
@@ -21,6 +24,10 @@ struct rbm_training_context {
     double reconstruction_error = 0.0;  ///< The mean reconstruction error
     double free_energy = 0.0;           ///< The mean free energy
     double sparsity = 0.0;              ///< The mean sparsity
+
+    std::uint32_t seed = 0;             ///< The seed of the random streams
+    std::size_t epoch = 0;              ///< The current epoch
+    std::size_t sample = 0;             ///< The index, in the epoch, of the first sample of the current batch
 };
 
 } //end of dll namespace
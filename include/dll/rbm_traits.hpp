@@ -8,6 +8,8 @@
 #ifndef DLL_RBM_TRAITS_HPP
 #define DLL_RBM_TRAITS_HPP
 
+#include <algorithm>
+
 #include "tmp.hpp"
 #include "decay_type.hpp"
 #include "sparsity_method.hpp"
@@ -39,6 +41,9 @@ struct rbm_traits {
     HAS_STATIC_FIELD(Bias, has_bias_field)
     HAS_STATIC_FIELD(Shuffle, has_shuffle_field)
     HAS_STATIC_FIELD(Free_Energy, has_free_energy_field)
+    HAS_STATIC_FIELD(Chains, has_chains_field)
+    HAS_STATIC_FIELD(Packed, has_packed_field)
+    HAS_STATIC_FIELD(SparseInput, has_sparse_input_field)
 
     /*!
      * \brief Indicates if the RBM is convolutional
@@ -161,6 +166,45 @@ struct rbm_traits {
         return false;
     }
 
+    /*!
+     * \brief Return the configured number of persistent chains (0 if tied to the batch size)
+     */
+    template<typename R = RBM, cpp::enable_if_u<has_chains_field<typename R::desc>::value> = cpp::detail::dummy>
+    static constexpr std::size_t pcd_chains(){
+        return rbm_t::desc::Chains;
+    }
+
+    template<typename R = RBM, cpp::disable_if_u<has_chains_field<typename R::desc>::value> = cpp::detail::dummy>
+    static constexpr std::size_t pcd_chains(){
+        return 0;
+    }
+
+    /*!
+     * \brief Indicates if the binary states are packed for the products with the weights
+     */
+    template<typename R = RBM, cpp::enable_if_u<has_packed_field<typename R::desc>::value> = cpp::detail::dummy>
+    static constexpr bool packed_states(){
+        return rbm_t::desc::Packed;
+    }
+
+    template<typename R = RBM, cpp::disable_if_u<has_packed_field<typename R::desc>::value> = cpp::detail::dummy>
+    static constexpr bool packed_states(){
+        return false;
+    }
+
+    /*!
+     * \brief Indicates if the sparse products are used for mostly-zero visible inputs
+     */
+    template<typename R = RBM, cpp::enable_if_u<has_sparse_input_field<typename R::desc>::value> = cpp::detail::dummy>
+    static constexpr bool sparse_input(){
+        return rbm_t::desc::SparseInput;
+    }
+
+    template<typename R = RBM, cpp::disable_if_u<has_sparse_input_field<typename R::desc>::value> = cpp::detail::dummy>
+    static constexpr bool sparse_input(){
+        return false;
+    }
+
     template<typename R = RBM, cpp::enable_if_u<has_free_energy_field<typename R::desc>::value> = cpp::detail::dummy>
     static constexpr bool free_energy(){
         return rbm_t::desc::Free_Energy;
@@ -182,6 +226,16 @@ constexpr std::size_t get_batch_size(const RBM&){
     return rbm_traits<RBM>::batch_size();
 }
 
+/*!
+ * \brief Return the number of persistent chains of PCD. There are always at
+ * least as many chains as samples in a batch, the batch size of dynamic
+ * RBMs is only known at runtime.
+ */
+template<typename RBM>
+std::size_t get_pcd_chains(const RBM& rbm){
+    return std::max(rbm_traits<RBM>::pcd_chains(), get_batch_size(rbm));
+}
+
 template<typename RBM, cpp::enable_if_u<rbm_traits<RBM>::is_dynamic()> = cpp::detail::dummy>
 std::size_t num_visible(const RBM& rbm){
     return rbm.num_visible;
@@ -0,0 +1,224 @@
+//=======================================================================
+// Copyright (c) 2014 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file Sparse visible inputs
+ *
+ * Mostly-zero inputs are stored as the list of their non-zero units. The
+ * products with the weights then only accumulate the rows of the weights
+ * of these units.
+ */
+
+#ifndef DLL_SPARSE_INPUT_HPP
+#define DLL_SPARSE_INPUT_HPP
+
+#include <vector>
+
+#include "etl/etl.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Maximum density of an input for which the sparse product is used
+ * instead of the dense one
+ */
+constexpr const double sparse_density = 0.25;
+
+/*!
+ * \brief Return the maximum number of non-zero values of a sparse input of size n
+ */
+constexpr std::size_t sparse_max_nnz(std::size_t n){
+    return static_cast<std::size_t>(n * sparse_density);
+}
+
+/*!
+ * \brief A sparse vector, as the list of its non-zero values
+ */
+template<typename Weight>
+struct sparse_vector {
+    using weight = Weight;
+
+    std::vector<std::size_t> indices; //Indices of the non-zero values
+    std::vector<weight> values;       //Non-zero values
+    std::size_t n = 0;                //Size of the vector
+
+    sparse_vector() = default;
+
+    template<typename V>
+    explicit sparse_vector(const V& v){
+        gather(v, etl::size(v));
+    }
+
+    /*!
+     * \brief Gather the non-zero values of v.
+     *
+     * \return false if v has more than max_nnz non-zero values, in which
+     * case the sparse vector is not usable
+     */
+    template<typename V>
+    bool gather(const V& v, std::size_t max_nnz){
+        n = etl::size(v);
+
+        indices.clear();
+        values.clear();
+
+        for(std::size_t i = 0; i < n; ++i){
+            if(v[i] != 0.0){
+                if(indices.size() == max_nnz){
+                    return false;
+                }
+
+                indices.push_back(i);
+                values.push_back(v[i]);
+            }
+        }
+
+        return true;
+    }
+
+    std::size_t size() const {
+        return n;
+    }
+
+    std::size_t non_zeros() const {
+        return indices.size();
+    }
+};
+
+/*!
+ * \brief A batch of sparse vectors, in CSR format
+ */
+template<typename Weight>
+struct sparse_matrix {
+    using weight = Weight;
+
+    std::vector<std::size_t> row_start; //Index of the first value of each row (and end of the last one)
+    std::vector<std::size_t> indices;   //Columns of the non-zero values
+    std::vector<weight> values;         //Non-zero values
+    std::size_t n = 0;                  //Number of columns
+
+    sparse_matrix() = default;
+
+    /*!
+     * \brief Build the sparse version of the given dense batch (one sample per row)
+     */
+    template<typename M>
+    explicit sparse_matrix(const M& m){
+        gather(m, etl::size(m));
+    }
+
+    /*!
+     * \brief Gather the non-zero values of the dense batch m (one sample
+     * per row).
+     *
+     * \return false if m has more than max_nnz non-zero values in total, in
+     * which case the sparse matrix is not usable
+     */
+    template<typename M>
+    bool gather(const M& m, std::size_t max_nnz){
+        n = etl::columns(m);
+
+        row_start.clear();
+        indices.clear();
+        values.clear();
+
+        row_start.push_back(0);
+
+        for(std::size_t i = 0; i < etl::rows(m); ++i){
+            for(std::size_t j = 0; j < n; ++j){
+                if(m(i, j) != 0.0){
+                    if(indices.size() == max_nnz){
+                        return false;
+                    }
+
+                    indices.push_back(j);
+                    values.push_back(m(i, j));
+                }
+            }
+
+            row_start.push_back(indices.size());
+        }
+
+        return true;
+    }
+
+    std::size_t rows() const {
+        return row_start.size() - 1;
+    }
+
+    std::size_t columns() const {
+        return n;
+    }
+};
+
+/*!
+ * \brief Return the sparse buffer of the current thread
+ */
+template<typename Weight>
+sparse_vector<Weight>& thread_sparse_vector(){
+    thread_local sparse_vector<Weight> v;
+    return v;
+}
+
+/*!
+ * \brief Return the sparse batch buffer of the current thread
+ */
+template<typename Weight>
+sparse_matrix<Weight>& thread_sparse_matrix(){
+    thread_local sparse_matrix<Weight> m;
+    return m;
+}
+
+/*!
+ * \brief Compute t = v * w, by accumulating the rows of w of the non-zero
+ * values of v
+ */
+template<typename Weight, typename W, typename T>
+void sparse_vmmul(const sparse_vector<Weight>& v, const W& w, T&& t){
+    const std::size_t columns = etl::columns(w);
+
+    for(std::size_t j = 0; j < columns; ++j){
+        t[j] = 0.0;
+    }
+
+    for(std::size_t k = 0; k < v.indices.size(); ++k){
+        const auto i = v.indices[k];
+        const auto x = v.values[k];
+
+        for(std::size_t j = 0; j < columns; ++j){
+            t[j] += x * w(i, j);
+        }
+    }
+}
+
+/*!
+ * \brief Compute t = m * w, row by row, by accumulating the rows of w of
+ * the non-zero values of m
+ */
+template<typename Weight, typename W, typename T>
+void sparse_mmul(const sparse_matrix<Weight>& m, const W& w, T&& t){
+    const std::size_t columns = etl::columns(w);
+
+    for(std::size_t r = 0; r < m.rows(); ++r){
+        for(std::size_t j = 0; j < columns; ++j){
+            t(r, j) = 0.0;
+        }
+
+        for(std::size_t k = m.row_start[r]; k < m.row_start[r + 1]; ++k){
+            const auto i = m.indices[k];
+            const auto x = m.values[k];
+
+            for(std::size_t j = 0; j < columns; ++j){
+                t(r, j) += x * w(i, j);
+            }
+        }
+    }
+}
+
+} //end of dll namespace
+
+#endif
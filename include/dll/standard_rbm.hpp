@@ -24,6 +24,11 @@
 #include "math.hpp"
 #include "io.hpp"
 #include "checks.hpp"           //NaN checks
+#include "fused_sampling.hpp"   //Fused activation/sampling kernels
+#include "bit_states.hpp"       //Packed binary states
+#include "sparse_input.hpp"     //Sparse visible inputs
+#include "free_energy.hpp"      //Batched free energy
+#include "rbm_traits.hpp"
 
 namespace dll {
 
@@ -71,6 +76,27 @@ struct standard_rbm : public rbm_base<Parent, Desc> {
         return free_energy(rbm, rbm.v1);
     }
 
+    /*!
+     * \brief Compute the free energy of each of the given samples.
+     *
+     * The samples are either the rows of an ETL matrix or a container of
+     * samples. energies[i] is set to the free energy of the ith sample.
+     */
+    template<typename Samples, typename Energies>
+    void free_energy_batch(const Samples& samples, Energies&& energies) const {
+        thread_pool<false> pool;
+        free_energy_batch(pool, *static_cast<const parent_t*>(this), samples, energies);
+    }
+
+    /*!
+     * \brief Compute the free energy of each of the given samples, the
+     * blocks of samples being distributed on the given thread pool.
+     */
+    template<bool Parallel, typename Samples, typename Energies>
+    void free_energy_batch(thread_pool<Parallel>& pool, const Samples& samples, Energies&& energies) const {
+        free_energy_batch(pool, *static_cast<const parent_t*>(this), samples, energies);
+    }
+
     //Various functions
 
     template<typename Iterator>
@@ -271,34 +297,225 @@ protected:
         return free_energy(rbm, ev);
     }
 
+    //The batched free energy uses the same formulas. The samples are copied
+    //by blocks in the buffers of the thread, the products of a block are
+    //computed with a single GEMM and then reduced row by row.
+
+    template<bool Parallel, typename RBM, typename Samples, typename Energies>
+    static void free_energy_batch(thread_pool<Parallel>& pool, const RBM& rbm, const Samples& samples, Energies&& energies){
+        using rbm_weight = typename RBM::weight;
+
+        const std::size_t n = detail::batch_samples(samples);
+        const std::size_t nv = num_visible(rbm);
+        const std::size_t nh = num_hidden(rbm);
+
+        constexpr const bool binary_visible = RBM::desc::visible_unit == unit_type::BINARY;
+        constexpr const bool gaussian_visible = RBM::desc::visible_unit == unit_type::GAUSSIAN;
+
+        if(RBM::desc::hidden_unit != unit_type::BINARY || !(binary_visible || gaussian_visible)){
+            for(std::size_t i = 0; i < n; ++i){
+                energies[i] = 0.0;
+            }
+
+            return;
+        }
+
+        for_each_block(pool, n, free_energy_block, [&](std::size_t first, std::size_t last){
+            auto& buffers = detail::thread_free_energy_buffers<rbm_weight>(nv, nh);
+
+            auto& v = buffers.v;
+            auto& t = buffers.t;
+
+            for(std::size_t i = first; i < last; ++i){
+                const auto& sample = detail::batch_sample(samples, i);
+
+                for(std::size_t k = 0; k < nv; ++k){
+                    v(i - first, k) = sample[k];
+                }
+            }
+
+            //The rows after the last sample must not keep older samples
+            for(std::size_t r = last - first; r < free_energy_block; ++r){
+                for(std::size_t k = 0; k < nv; ++k){
+                    v(r, k) = 0.0;
+                }
+            }
+
+            std_batch_hidden_product(v, rbm.w, t);
+
+            for(std::size_t r = 0; r < last - first; ++r){
+                rbm_weight visible = 0.0;
+
+                if(binary_visible){
+                    //-sum(ai*vi)
+                    for(std::size_t k = 0; k < nv; ++k){
+                        visible -= rbm.c(k) * v(r, k);
+                    }
+                } else {
+                    //sum((vi-ai)^2/2)
+                    for(std::size_t k = 0; k < nv; ++k){
+                        visible += (v(r, k) - rbm.c(k)) * (v(r, k) - rbm.c(k)) / 2.0;
+                    }
+                }
+
+                //sum(log(1 + e^(xj)))
+                rbm_weight hidden = 0.0;
+
+                for(std::size_t j = 0; j < nh; ++j){
+                    hidden += stable_softplus(rbm.b(j) + t(r, j));
+                }
+
+                energies[first + r] = visible - hidden;
+            }
+        });
+    }
+
+    //Products with the weights
+    //With packed states, binary inputs are packed in 64-bit words and only
+    //the weights of the active units are accumulated. The dense product is
+    //used as soon as an input is not binary (activation probabilities).
+    //With sparse inputs, mostly-zero visible inputs only accumulate the rows
+    //of the weights of their non-zero units.
+
+    static constexpr bool packed_visible(){
+        return rbm_traits<parent_t>::packed_states() && visible_unit == unit_type::BINARY;
+    }
+
+    static constexpr bool packed_hidden(){
+        return rbm_traits<parent_t>::packed_states() && hidden_unit == unit_type::BINARY;
+    }
+
+    static constexpr bool sparse_visible(){
+        return rbm_traits<parent_t>::sparse_input();
+    }
+
+    template<typename V, typename W, typename T>
+    static void std_hidden_product(const V& v_a, const W& w, T&& t){
+        if(packed_visible()){
+            auto& bits = thread_bit_states();
+
+            if(bits.pack(v_a)){
+                packed_vmmul(bits, w, t);
+                return;
+            }
+        }
+
+        if(sparse_visible()){
+            auto& sparse = thread_sparse_vector<weight>();
+
+            if(sparse.gather(v_a, sparse_max_nnz(etl::size(v_a)))){
+                sparse_vmmul(sparse, w, t);
+                return;
+            }
+        }
+
+        etl::auto_vmmul(v_a, w, t);
+    }
+
+    template<typename S, typename W, typename T>
+    static void std_hidden_product(const sparse_vector<S>& v_a, const W& w, T&& t){
+        sparse_vmmul(v_a, w, t);
+    }
+
+    template<typename H, typename W, typename T>
+    static void std_visible_product(const H& h_s, const W& w, T&& t){
+        if(packed_hidden()){
+            auto& bits = thread_bit_states();
+
+            if(bits.pack(h_s)){
+                packed_mvmul(w, bits, t);
+                return;
+            }
+        }
+
+        etl::auto_vmmul(w, h_s, t);
+    }
+
+    template<typename V, typename W, typename T>
+    static void std_batch_hidden_product(const V& v_a, const W& w, T&& t){
+        //The whole batch is checked before any row is computed
+        if(packed_visible() && is_binary(v_a)){
+            auto& bits = thread_bit_states();
+
+            for(std::size_t i = 0; i < etl::rows(v_a); ++i){
+                bits.pack(v_a(i));
+                packed_vmmul(bits, w, t(i));
+            }
+
+            return;
+        }
+
+        //The density is measured on the whole batch, which is then computed
+        //by a single product
+        if(sparse_visible()){
+            auto& sparse = thread_sparse_matrix<weight>();
+
+            if(sparse.gather(v_a, sparse_max_nnz(etl::size(v_a)))){
+                sparse_mmul(sparse, w, t);
+                return;
+            }
+        }
+
+        etl::mmul(v_a, w, t);
+    }
+
+    template<typename S, typename W, typename T>
+    static void std_batch_hidden_product(const sparse_matrix<S>& v_a, const W& w, T&& t){
+        sparse_mmul(v_a, w, t);
+    }
+
+    template<typename H, typename W, typename T>
+    static void std_batch_visible_product(const H& h_s, const W& w, T&& t){
+        //The whole batch is checked before any row is computed
+        if(packed_hidden() && is_binary(h_s)){
+            auto& bits = thread_bit_states();
+
+            for(std::size_t i = 0; i < etl::rows(h_s); ++i){
+                bits.pack(h_s(i));
+                packed_mvmul(w, bits, t(i));
+            }
+
+            return;
+        }
+
+        etl::mmul(h_s, etl::transpose(w), t);
+    }
+
     template<bool P = true, bool S = true, typename H1, typename H2, typename V, typename B, typename W, typename T>
     static void std_activate_hidden(H1&& h_a, H2&& h_s, const V& v_a, const V&, const B& b, const W& w, T&& t){
         using namespace etl;
 
+        //The product is only computed once for both probabilities and samples
+        std_hidden_product(v_a, w, t);
+
+        //Binary units are activated and sampled in a single sweep
+        if(hidden_unit == unit_type::BINARY && S){
+            fused_sigmoid_bernoulli<P>(h_a, h_s, b, t);
+            return;
+        }
+
         //Compute activation probabilities
         if(P){
             if(hidden_unit == unit_type::BINARY){
-                h_a = sigmoid(b + auto_vmmul(v_a, w, t));
+                h_a = sigmoid(b + t);
             } else if(hidden_unit == unit_type::RELU){
-                h_a = max(b + auto_vmmul(v_a, w, t), 0.0);
+                h_a = max(b + t, 0.0);
             } else if(hidden_unit == unit_type::RELU6){
-                h_a = min(max(b + auto_vmmul(v_a, w, t), 0.0), 6.0);
+                h_a = min(max(b + t, 0.0), 6.0);
             } else if(hidden_unit == unit_type::RELU1){
-                h_a = min(max(b + auto_vmmul(v_a, w, t), 0.0), 1.0);
+                h_a = min(max(b + t, 0.0), 1.0);
             } else if(hidden_unit == unit_type::SOFTMAX){
-                h_a = softmax(b + auto_vmmul(v_a, w, t));
+                h_a = softmax(b + t);
             }
 
             //Compute sampled values directly
             if(S){
-                if(hidden_unit == unit_type::BINARY){
-                    h_s = bernoulli(h_a);
-                } else if(hidden_unit == unit_type::RELU){
-                    h_s = logistic_noise(h_a); //TODO This is probably wrong
+                if(hidden_unit == unit_type::RELU){
+                    sample_logistic_noise(h_s, h_a); //TODO This is probably wrong
                 } else if(hidden_unit == unit_type::RELU6){
-                    h_s = ranged_noise(h_a, 6.0); //TODO This is probably wrong
+                    sample_ranged_noise(h_s, h_a, 6.0); //TODO This is probably wrong
                 } else if(hidden_unit == unit_type::RELU1){
-                    h_s = ranged_noise(h_a, 1.0); //TODO This is probably wrong
+                    sample_ranged_noise(h_s, h_a, 1.0); //TODO This is probably wrong
                 } else if(hidden_unit == unit_type::SOFTMAX){
                     h_s = one_if_max(h_a);
                 }
@@ -306,16 +523,14 @@ protected:
         }
         //Compute sampled values
         else if(S){
-            if(hidden_unit == unit_type::BINARY){
-                h_s = bernoulli(sigmoid(b + auto_vmmul(v_a, w, t)));
-            } else if(hidden_unit == unit_type::RELU){
-                h_s = logistic_noise(max(b + auto_vmmul(v_a, w, t), 0.0)); //TODO This is probably wrong
+            if(hidden_unit == unit_type::RELU){
+                sample_logistic_noise(h_s, max(b + t, 0.0)); //TODO This is probably wrong
             } else if(hidden_unit == unit_type::RELU6){
-                h_s = ranged_noise(min(max(b + auto_vmmul(v_a, w, t), 0.0), 6.0), 6.0); //TODO This is probably wrong
+                sample_ranged_noise(h_s, min(max(b + t, 0.0), 6.0), 6.0); //TODO This is probably wrong
             } else if(hidden_unit == unit_type::RELU1){
-                h_s = ranged_noise(min(max(b + auto_vmmul(v_a, w, t), 0.0), 1.0), 1.0); //TODO This is probably wrong
+                sample_ranged_noise(h_s, min(max(b + t, 0.0), 1.0), 1.0); //TODO This is probably wrong
             } else if(hidden_unit == unit_type::SOFTMAX){
-                h_s = one_if_max(softmax(b + auto_vmmul(v_a, w, t)));
+                h_s = one_if_max(softmax(b + t));
             }
         }
 
@@ -327,23 +542,136 @@ protected:
     static void std_activate_visible(const H&, const H& h_s, V&& v_a, V&& v_s, const C& c, const W& w, T&& t){
         using namespace etl;
 
+        //The product is only computed once for both probabilities and samples
+        std_visible_product(h_s, w, t);
+
+        //Binary units are activated and sampled in a single sweep
+        if(visible_unit == unit_type::BINARY && S){
+            fused_sigmoid_bernoulli<P>(v_a, v_s, c, t);
+            return;
+        }
+
         if(P){
             if(visible_unit == unit_type::BINARY){
-                v_a = sigmoid(c + auto_vmmul(w, h_s, t));
+                v_a = sigmoid(c + t);
             } else if(visible_unit == unit_type::GAUSSIAN){
-                v_a = c + auto_vmmul(w, h_s, t);
+                v_a = c + t;
             } else if(visible_unit == unit_type::RELU){
-                v_a = max(c + auto_vmmul(w, h_s, t), 0.0);
+                v_a = max(c + t, 0.0);
             }
         }
 
         if(S){
-            if(visible_unit == unit_type::BINARY){
-                v_s = bernoulli(sigmoid(c + auto_vmmul(w, h_s, t)));
-            } else if(visible_unit == unit_type::GAUSSIAN){
-                v_s = c + auto_vmmul(w, h_s, t);
+            if(visible_unit == unit_type::GAUSSIAN){
+                v_s = c + t;
             } else if(visible_unit == unit_type::RELU){
-                v_s = logistic_noise(max(c + auto_vmmul(w, h_s, t), 0.0));
+                sample_logistic_noise(v_s, max(c + t, 0.0));
+            }
+        }
+
+        nan_check_deep(v_a);
+        nan_check_deep(v_s);
+    }
+
+    //Batch versions of the activation functions
+    //The complete batch is propagated with a single matrix-matrix
+    //multiplication instead of one vector-matrix multiplication per sample
+
+    template<bool P = true, bool S = true, typename H1, typename H2, typename V, typename B, typename W, typename T>
+    static void std_batch_activate_hidden(H1&& h_a, H2&& h_s, const V& v_a, const V&, const B& b, const W& w, T&& t){
+        using namespace etl;
+
+        //t = v_a * w (batch_size x num_hidden)
+        std_batch_hidden_product(v_a, w, t);
+
+        //One sampling pass for the batch, each row has its own stream
+        const auto stream = next_random_stream();
+
+        for(std::size_t i = 0; i < etl::rows(t); ++i){
+            //Binary units are activated and sampled in a single sweep
+            if(hidden_unit == unit_type::BINARY && S){
+                fused_sigmoid_bernoulli<P>(h_a(i), h_s(i), b, t(i), stream.row(i));
+                continue;
+            }
+
+            //Compute activation probabilities
+            if(P){
+                if(hidden_unit == unit_type::BINARY){
+                    h_a(i) = sigmoid(b + t(i));
+                } else if(hidden_unit == unit_type::RELU){
+                    h_a(i) = max(b + t(i), 0.0);
+                } else if(hidden_unit == unit_type::RELU6){
+                    h_a(i) = min(max(b + t(i), 0.0), 6.0);
+                } else if(hidden_unit == unit_type::RELU1){
+                    h_a(i) = min(max(b + t(i), 0.0), 1.0);
+                } else if(hidden_unit == unit_type::SOFTMAX){
+                    h_a(i) = softmax(b + t(i));
+                }
+
+                //Compute sampled values directly
+                if(S){
+                    if(hidden_unit == unit_type::RELU){
+                        sample_logistic_noise(h_s(i), h_a(i), stream.row(i)); //TODO This is probably wrong
+                    } else if(hidden_unit == unit_type::RELU6){
+                        sample_ranged_noise(h_s(i), h_a(i), 6.0, stream.row(i)); //TODO This is probably wrong
+                    } else if(hidden_unit == unit_type::RELU1){
+                        sample_ranged_noise(h_s(i), h_a(i), 1.0, stream.row(i)); //TODO This is probably wrong
+                    } else if(hidden_unit == unit_type::SOFTMAX){
+                        h_s(i) = one_if_max(h_a(i));
+                    }
+                }
+            }
+            //Compute sampled values
+            else if(S){
+                if(hidden_unit == unit_type::RELU){
+                    sample_logistic_noise(h_s(i), max(b + t(i), 0.0), stream.row(i)); //TODO This is probably wrong
+                } else if(hidden_unit == unit_type::RELU6){
+                    sample_ranged_noise(h_s(i), min(max(b + t(i), 0.0), 6.0), 6.0, stream.row(i)); //TODO This is probably wrong
+                } else if(hidden_unit == unit_type::RELU1){
+                    sample_ranged_noise(h_s(i), min(max(b + t(i), 0.0), 1.0), 1.0, stream.row(i)); //TODO This is probably wrong
+                } else if(hidden_unit == unit_type::SOFTMAX){
+                    h_s(i) = one_if_max(softmax(b + t(i)));
+                }
+            }
+        }
+
+        nan_check_deep(h_a);
+        nan_check_deep(h_s);
+    }
+
+    template<bool P = true, bool S = true, typename H1, typename H2, typename V1, typename V2, typename C, typename W, typename T>
+    static void std_batch_activate_visible(const H1&, const H2& h_s, V1&& v_a, V2&& v_s, const C& c, const W& w, T&& t){
+        using namespace etl;
+
+        //t = h_s * w^T (batch_size x num_visible)
+        std_batch_visible_product(h_s, w, t);
+
+        //One sampling pass for the batch, each row has its own stream
+        const auto stream = next_random_stream();
+
+        for(std::size_t i = 0; i < etl::rows(t); ++i){
+            //Binary units are activated and sampled in a single sweep
+            if(visible_unit == unit_type::BINARY && S){
+                fused_sigmoid_bernoulli<P>(v_a(i), v_s(i), c, t(i), stream.row(i));
+                continue;
+            }
+
+            if(P){
+                if(visible_unit == unit_type::BINARY){
+                    v_a(i) = sigmoid(c + t(i));
+                } else if(visible_unit == unit_type::GAUSSIAN){
+                    v_a(i) = c + t(i);
+                } else if(visible_unit == unit_type::RELU){
+                    v_a(i) = max(c + t(i), 0.0);
+                }
+            }
+
+            if(S){
+                if(visible_unit == unit_type::GAUSSIAN){
+                    v_s(i) = c + t(i);
+                } else if(visible_unit == unit_type::RELU){
+                    sample_logistic_noise(v_s(i), max(c + t(i), 0.0), stream.row(i));
+                }
             }
         }
 
@@ -12,6 +12,13 @@
 
 #ifdef DLL_SVM_SUPPORT
 
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
 #include "io.hpp"
 #include "nice_svm.hpp"
 
@@ -29,61 +36,310 @@ inline svm_parameter default_svm_parameters(){
     return parameters;
 }
 
-template<typename DBN>
-void svm_store(const DBN& dbn, std::ostream& os){
-    if(dbn.svm_loaded){
-        binary_write(os, true);
+namespace detail {
 
-        svm::save(dbn.svm_model, "..tmp.svm");
+//The SVM model is serialized directly in the stream. Only the fields used
+//for prediction are stored, as in the libsvm model files.
 
-        std::ifstream svm_is("..tmp.svm", std::ios::binary);
+//Size of a stored node (index, then value, without padding)
+constexpr const std::size_t svm_node_bytes = sizeof(int) + sizeof(double);
 
-        char buffer[1024];
+/*!
+ * \brief Return the number of nodes of the support vectors of the model,
+ * with their terminating nodes
+ */
+inline std::uint64_t svm_nodes(const svm_model& model){
+    std::uint64_t nodes = 0;
 
-        while(true){
-            svm_is.read(buffer, 1024);
+    for(int i = 0; i < model.l; ++i){
+        const svm_node* node = model.SV[i];
+        while((node++)->index != -1){}
+        nodes += node - model.SV[i];
+    }
+
+    return nodes;
+}
+
+/*!
+ * \brief Return the number of bytes written by svm_write_model for the model
+ */
+inline std::uint64_t svm_model_size(const svm_model& model){
+    const std::uint64_t k = model.nr_class;
+    const std::uint64_t l = model.l;
+    const std::uint64_t pairs = k * (k - 1) / 2;
+
+    std::uint64_t size = 3 * sizeof(int) + 2 * sizeof(double) + 2 * sizeof(int) + 4 * sizeof(bool);
+
+    size += pairs * sizeof(double);
+    size += model.label ? k * sizeof(int) : 0;
+    size += model.probA ? pairs * sizeof(double) : 0;
+    size += model.probB ? pairs * sizeof(double) : 0;
+    size += model.nSV ? k * sizeof(int) : 0;
+    size += (k - 1) * l * sizeof(double);
+    size += sizeof(std::uint64_t) + svm_nodes(model) * svm_node_bytes;
+
+    return size;
+}
+
+inline void svm_write_model(std::ostream& os, const svm_model& model){
+    const int k = model.nr_class;
+    const int l = model.l;
+    const int pairs = k * (k - 1) / 2;
+
+    binary_write(os, model.param.svm_type);
+    binary_write(os, model.param.kernel_type);
+    binary_write(os, model.param.degree);
+    binary_write(os, model.param.gamma);
+    binary_write(os, model.param.coef0);
+
+    binary_write(os, k);
+    binary_write(os, l);
+
+    os.write(reinterpret_cast<const char*>(model.rho), pairs * sizeof(double));
+
+    binary_write(os, model.label != nullptr);
+    if(model.label){
+        os.write(reinterpret_cast<const char*>(model.label), k * sizeof(int));
+    }
+
+    binary_write(os, model.probA != nullptr);
+    if(model.probA){
+        os.write(reinterpret_cast<const char*>(model.probA), pairs * sizeof(double));
+    }
+
+    binary_write(os, model.probB != nullptr);
+    if(model.probB){
+        os.write(reinterpret_cast<const char*>(model.probB), pairs * sizeof(double));
+    }
+
+    binary_write(os, model.nSV != nullptr);
+    if(model.nSV){
+        os.write(reinterpret_cast<const char*>(model.nSV), k * sizeof(int));
+    }
+
+    for(int i = 0; i < k - 1; ++i){
+        os.write(reinterpret_cast<const char*>(model.sv_coef[i]), l * sizeof(double));
+    }
+
+    //The nodes of each support vector, with their terminating node, are
+    //packed in a buffer written at once
+    const auto nodes = svm_nodes(model);
+
+    binary_write(os, nodes);
+
+    std::vector<char> packed(nodes * svm_node_bytes);
+    char* out = packed.data();
+
+    for(int i = 0; i < l; ++i){
+        const svm_node* node = model.SV[i];
+        do {
+            std::memcpy(out, &node->index, sizeof(int));
+            std::memcpy(out + sizeof(int), &node->value, sizeof(double));
+            out += svm_node_bytes;
+        } while((node++)->index != -1);
+    }
+
+    os.write(packed.data(), packed.size());
+}
+
+template<typename T>
+T* svm_read_array(std::istream& is, std::size_t n){
+    auto* array = static_cast<T*>(std::malloc(std::max(n, std::size_t(1)) * sizeof(T)));
+    is.read(reinterpret_cast<char*>(array), n * sizeof(T));
+    return array;
+}
+
+/*!
+ * \brief Read a SVM model of size bytes written by svm_write_model.
+ *
+ * The model is allocated as libsvm does, it can be released with
+ * svm_free_and_destroy_model.
+ *
+ * The sizes read from the stream are checked against the number of bytes
+ * left in the model before anything is allocated. The stream must support
+ * tellg.
+ *
+ * \return the model or nullptr if the stream is invalid
+ */
+inline svm_model* svm_read_model(std::istream& is, std::uint64_t size){
+    const auto start = is.tellg();
+
+    //The number of bytes of the model that have not been read yet
+    auto remaining = [&is, start, size]() -> std::uint64_t {
+        const auto position = is.tellg();
+
+        if(start < 0 || position < start || static_cast<std::uint64_t>(position - start) > size){
+            return 0;
+        }
+
+        return size - static_cast<std::uint64_t>(position - start);
+    };
+
+    //calloc leaves all the optional fields to nullptr
+    auto* model = static_cast<svm_model*>(std::calloc(1, sizeof(svm_model)));
+
+    binary_load(is, model->param.svm_type);
+    binary_load(is, model->param.kernel_type);
+    binary_load(is, model->param.degree);
+    binary_load(is, model->param.gamma);
+    binary_load(is, model->param.coef0);
+
+    binary_load(is, model->nr_class);
+    binary_load(is, model->l);
+
+    const int k = model->nr_class;
+    const int l = model->l;
+
+    if(!is || k < 1 || l < 0){
+        std::free(model);
+        return nullptr;
+    }
+
+    const std::size_t pairs = static_cast<std::size_t>(k) * (k - 1) / 2;
+    const std::uint64_t left = remaining();
+
+    //The arrays cannot be larger than the rest of the model
+    if(pairs > left / sizeof(double) || static_cast<std::uint64_t>(k) > left / sizeof(int)
+            || static_cast<std::uint64_t>(k - 1) * l > left / sizeof(double)){
+        std::free(model);
+        return nullptr;
+    }
+
+    model->rho = svm_read_array<double>(is, pairs);
+
+    bool present = false;
 
-            if(svm_is.gcount() == 0){
+    binary_load(is, present);
+    if(present){
+        model->label = svm_read_array<int>(is, k);
+    }
+
+    binary_load(is, present);
+    if(present){
+        model->probA = svm_read_array<double>(is, pairs);
+    }
+
+    binary_load(is, present);
+    if(present){
+        model->probB = svm_read_array<double>(is, pairs);
+    }
+
+    binary_load(is, present);
+    if(present){
+        model->nSV = svm_read_array<int>(is, k);
+    }
+
+    model->sv_coef = static_cast<double**>(std::malloc(std::max(k - 1, 1) * sizeof(double*)));
+    for(int i = 0; i < k - 1; ++i){
+        model->sv_coef[i] = svm_read_array<double>(is, l);
+    }
+
+    std::uint64_t nodes = 0;
+    binary_load(is, nodes);
+
+    //The fixed-size arrays and the number of nodes must have been read completely
+    if(!is || nodes > remaining() / svm_node_bytes){
+        svm_free_and_destroy_model(&model);
+        return nullptr;
+    }
+
+    //As in libsvm, all the nodes are in one block, released through SV[0]
+    model->SV = static_cast<svm_node**>(std::malloc(std::max(l, 1) * sizeof(svm_node*)));
+    auto* block = static_cast<svm_node*>(std::malloc(std::max(nodes, std::uint64_t(1)) * sizeof(svm_node)));
+    model->free_sv = 1;
+
+    //The packed nodes are read at once, their number has been checked
+    std::vector<char> packed(nodes * svm_node_bytes);
+    is.read(packed.data(), packed.size());
+
+    bool valid = static_cast<bool>(is);
+    std::uint64_t n = 0;
+
+    for(int i = 0; i < l && valid; ++i){
+        model->SV[i] = block + n;
+
+        while(true){
+            if(n == nodes){
+                valid = false;
                 break;
             }
 
-            os.write(buffer, svm_is.gcount());
+            const char* in = packed.data() + n * svm_node_bytes;
+
+            std::memcpy(&block[n].index, in, sizeof(int));
+            std::memcpy(&block[n].value, in + sizeof(int), sizeof(double));
+
+            if(block[n++].index == -1){
+                break;
+            }
         }
+    }
+
+    if(l == 0){
+        std::free(block);
+    }
+
+    //The whole model, and only the model, must have been read
+    if(!valid || n != nodes || remaining() != 0){
+        svm_free_and_destroy_model(&model);
+        return nullptr;
+    }
+
+    return model;
+}
+
+} //end of namespace detail
+
+/*!
+ * \brief Write the SVM of the DBN in the stream.
+ *
+ * The model is preceded by its size in bytes.
+ */
+template<typename DBN>
+void svm_store(const DBN& dbn, std::ostream& os){
+    if(dbn.svm_loaded){
+        binary_write(os, true);
+
+        const auto& model = *dbn.svm_model.get();
+
+        binary_write(os, detail::svm_model_size(model));
+        detail::svm_write_model(os, model);
     } else {
         binary_write(os, false);
     }
 }
 
+/*!
+ * \brief Read the SVM of the DBN from the stream, if there is one.
+ *
+ * \return false if the stream contains a SVM section that cannot be read
+ */
 template<typename DBN>
-void svm_load(DBN& dbn, std::istream& is){
+bool svm_load(DBN& dbn, std::istream& is){
     dbn.svm_loaded = false;
 
-    if(is.good()){
-        bool svm;
-        binary_load(is, svm);
-
-        if(svm){
-            std::ofstream svm_os("..tmp.svm", std::ios::binary);
-
-            char buffer[1024];
+    bool svm = false;
+    binary_load(is, svm);
 
-            while(true){
-                is.read(buffer, 1024);
+    if(!is || !svm){
+        return true;
+    }
 
-                if(is.gcount() ==0){
-                    break;
-                }
+    std::uint64_t size = 0;
+    binary_load(is, size);
 
-                svm_os.write(buffer, is.gcount());
-            }
+    //The model is parsed directly from the stream, its size bounds all the
+    //allocations
+    auto* sub = detail::svm_read_model(is, size);
 
-            svm_os.close();
+    if(!sub){
+        return false;
+    }
 
-            dbn.svm_model = svm::load("..tmp.svm");
+    dbn.svm_model = svm::model(sub);
+    dbn.svm_loaded = true;
 
-            dbn.svm_loaded = true;
-        }
-    }
+    return true;
 }
 
 template<typename DBN, typename Result, typename Sample, cpp::enable_if_u<dbn_traits<std::decay_t<DBN>>::concatenate()> = cpp::detail::dummy>
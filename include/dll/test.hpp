@@ -8,6 +8,8 @@
 #ifndef DLL_TEST_HPP
 #define DLL_TEST_HPP
 
+#include <vector>
+
 #include "cpp_utils/stop_watch.hpp"
 
 namespace dll {
@@ -85,6 +87,41 @@ double test_set(DBN& dbn, Iterator first, Iterator last, LIterator lfirst, LIter
     return (images - success) / static_cast<double>(images);
 }
 
+/*!
+ * \brief The results of the comparison of a network and of a copy of it
+ */
+struct comparison_report {
+    double error;        //Error rate of the network
+    double other_error;  //Error rate of the copy
+    double disagreement; //Rate of samples on which the two networks disagree
+};
+
+/*!
+ * \brief Compare the accuracy of a network and of a copy of it (quantized,
+ * pruned, ...) on the given samples.
+ */
+template<typename DBN, typename Other, typename Samples, typename Labels>
+comparison_report compare_networks(DBN& dbn, const Other& other, const Samples& images, const Labels& labels){
+    auto other_ptr = &other;
+
+    comparison_report report;
+
+    report.error = test_set(dbn, images, labels, predictor());
+    report.other_error = test_set(other_ptr, images, labels, predictor());
+
+    //The predictions of the full network are used as labels
+    std::vector<std::size_t> reference;
+    reference.reserve(images.size());
+
+    for(auto& image : images){
+        reference.push_back(dbn->predict(image));
+    }
+
+    report.disagreement = test_set(other_ptr, images, reference, predictor());
+
+    return report;
+}
+
 } //end of dll namespace
 
 #endif
\ No newline at end of file
@@ -0,0 +1,134 @@
+//=======================================================================
+// Copyright (c) 2014 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file Top-k selection of the output units
+ *
+ * The k best units are selected with a partial insertion sort into the
+ * output arrays, in a single pass over the units. For softmax units, the
+ * normalization is computed during the same pass (online softmax), so the
+ * probabilities of the other units are never computed.
+ */
+
+#ifndef DLL_TOPK_HPP
+#define DLL_TOPK_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "cpp_utils/assert.hpp"
+
+#include "unit_type.hpp"
+#include "math.hpp"
+
+namespace dll {
+
+namespace detail {
+
+/*!
+ * \brief Insert the value x of the unit j into the k sorted (decreasing)
+ * best values, of which there are already m
+ */
+template<typename Weight, typename Indices, typename Scores>
+void topk_insert(Weight x, std::size_t j, std::size_t k, std::size_t m, Indices&& indices, Scores&& scores){
+    std::size_t p = std::min(m, k - 1);
+
+    //The last slot is only overwritten if x is better
+    if(m == k && !(x > scores[p])){
+        return;
+    }
+
+    while(p > 0 && x > scores[p - 1]){
+        scores[p] = scores[p - 1];
+        indices[p] = indices[p - 1];
+        --p;
+    }
+
+    scores[p] = x;
+    indices[p] = j;
+}
+
+template<typename Weight>
+Weight unit_activation(unit_type unit, Weight x){
+    switch(unit){
+        case unit_type::BINARY:
+            return logistic_sigmoid(x);
+        case unit_type::RELU:
+            return std::max(x, static_cast<Weight>(0.0));
+        case unit_type::RELU6:
+            return std::min(std::max(x, static_cast<Weight>(0.0)), static_cast<Weight>(6.0));
+        case unit_type::RELU1:
+            return std::min(std::max(x, static_cast<Weight>(0.0)), static_cast<Weight>(1.0));
+        default:
+            return x;
+    }
+}
+
+} //end of namespace detail
+
+/*!
+ * \brief Select the k largest of the n given activations.
+ *
+ * The indices and the activations of the k best units are written, by
+ * decreasing activation, in indices[0..k) and scores[0..k).
+ */
+template<typename X, typename Indices, typename Scores>
+void select_topk(const X& x, std::size_t n, std::size_t k, Indices&& indices, Scores&& scores){
+    cpp_assert(k > 0 && k <= n, "Invalid number of units to select");
+
+    for(std::size_t j = 0; j < n; ++j){
+        detail::topk_insert(x[j], j, k, std::min(j, k), indices, scores);
+    }
+}
+
+/*!
+ * \brief Activate the output units of the given type and select the k
+ * best ones.
+ *
+ * x contains the n pre-activations (without the bias). Since all the
+ * activation functions are monotonic, the selection is done on the
+ * pre-activations and only the k selected units are activated. For
+ * softmax units, the normalization is accumulated during the selection.
+ */
+template<typename Bias, typename X, typename Indices, typename Scores>
+void activate_topk(unit_type unit, const Bias& b, const X& x, std::size_t n, std::size_t k, Indices&& indices, Scores&& scores){
+    using weight = std::decay_t<decltype(b[0] + x[0])>;
+
+    cpp_assert(k > 0 && k <= n, "Invalid number of units to select");
+
+    weight max = -std::numeric_limits<weight>::infinity();
+    weight sum = 0.0;
+
+    for(std::size_t j = 0; j < n; ++j){
+        const weight value = b[j] + x[j];
+
+        if(unit == unit_type::SOFTMAX){
+            //Online softmax: the sum is rescaled when the maximum changes
+            if(value > max){
+                sum = sum * std::exp(max - value) + 1.0;
+                max = value;
+            } else {
+                sum += std::exp(value - max);
+            }
+        }
+
+        detail::topk_insert(value, j, k, std::min(j, k), indices, scores);
+    }
+
+    for(std::size_t p = 0; p < k; ++p){
+        if(unit == unit_type::SOFTMAX){
+            scores[p] = std::exp(scores[p] - max) / sum;
+        } else {
+            scores[p] = detail::unit_activation(unit, static_cast<weight>(scores[p]));
+        }
+    }
+}
+
+} //end of dll namespace
+
+#endif
@@ -0,0 +1,235 @@
+//=======================================================================
+// Copyright (c) 2014 Baptiste Wicht
+// Distributed under the terms of the MIT License.
+// (See accompanying file LICENSE or copy at
+//  http://opensource.org/licenses/MIT)
+//=======================================================================
+
+/*!
+ * \file Workspaces for inference
+ *
+ * A workspace holds all the temporary buffers needed to propagate one
+ * sample through a network. The inference functions taking a workspace
+ * are const and do not use any shared state, so several threads can use
+ * the same network concurrently, each with its own workspace.
+ */
+
+#ifndef DLL_WORKSPACE_HPP
+#define DLL_WORKSPACE_HPP
+
+#include <tuple>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "cpp_utils/assert.hpp"
+
+#include "etl/etl.hpp"
+
+#include "rbm_traits.hpp"
+
+namespace dll {
+
+/*!
+ * \brief Buffers used to propagate a sample through a dense RBM
+ */
+template<typename RBM, typename Enable = void>
+struct layer_workspace {
+    using rbm_t = RBM;
+    using weight = typename rbm_t::weight;
+
+    using input_t = etl::dyn_vector<weight>;
+
+    etl::dyn_vector<weight> a; //Activation probabilities of the hidden units
+    etl::dyn_vector<weight> s; //States of the hidden units
+    etl::dyn_matrix<weight> t; //Temporary for the vector-matrix product
+
+    explicit layer_workspace(const rbm_t& rbm) : a(num_hidden(rbm)), s(num_hidden(rbm)), t(1UL, num_hidden(rbm)) {
+        //Nothing else to init
+    }
+
+    static input_t make_input(const rbm_t& rbm){
+        return input_t(num_visible(rbm));
+    }
+
+    static std::size_t visible_size(const rbm_t& rbm){
+        return num_visible(rbm);
+    }
+};
+
+/*!
+ * \brief Buffers used to propagate a sample through a convolutional RBM.
+ *
+ * The convolution buffers are allocated on the heap, they can be too large
+ * for the stack.
+ */
+template<typename RBM>
+struct layer_workspace<RBM, std::enable_if_t<rbm_traits<RBM>::is_convolutional()>> {
+    using rbm_t = RBM;
+    using weight = typename rbm_t::weight;
+
+    static constexpr const auto NC = rbm_t::NC;
+    static constexpr const auto NV = rbm_t::NV;
+    static constexpr const auto NH = rbm_t::NH;
+    static constexpr const auto K = rbm_t::K;
+
+    using input_t = etl::dyn_matrix<weight, 3>;
+
+    struct buffers_t {
+        etl::fast_matrix<weight, NC, NV, NV> v;         //Input of the layer
+        etl::fast_matrix<weight, NC+1, K, NH, NH> v_cv; //Temporary convolution
+    };
+
+    etl::dyn_matrix<weight, 3> a; //Activation probabilities of the output units
+    etl::dyn_matrix<weight, 3> s; //States of the output units
+
+    std::unique_ptr<buffers_t> buffers;
+
+    explicit layer_workspace(const rbm_t&) : a(K, output_dim(), output_dim()), s(K, output_dim(), output_dim()), buffers(std::make_unique<buffers_t>()) {
+        //Nothing else to init
+    }
+
+    template<typename R = rbm_t, cpp::enable_if_u<rbm_traits<R>::has_probabilistic_max_pooling()> = cpp::detail::dummy>
+    static constexpr std::size_t output_dim(){
+        return R::NP;
+    }
+
+    template<typename R = rbm_t, cpp::disable_if_u<rbm_traits<R>::has_probabilistic_max_pooling()> = cpp::detail::dummy>
+    static constexpr std::size_t output_dim(){
+        return R::NH;
+    }
+
+    static input_t make_input(const rbm_t&){
+        return input_t(NC, NV, NV);
+    }
+
+    static std::size_t visible_size(const rbm_t&){
+        return 0;
+    }
+};
+
+namespace detail {
+
+template<typename Tuple>
+struct layer_workspaces;
+
+template<typename... R>
+struct layer_workspaces<std::tuple<R...>> {
+    using type = std::tuple<layer_workspace<R>...>;
+};
+
+template<typename Layers, typename Workspaces, typename Functor, std::size_t... I>
+void for_each_layer_impl(Layers& layers, Workspaces& workspaces, Functor&& fun, std::index_sequence<I...>){
+    int wormhole[] = {(fun(I, std::get<I>(layers), std::get<I>(workspaces)), 0)...};
+    cpp_unused(wormhole);
+}
+
+template<typename Layers, typename Functor, std::size_t... I>
+void for_each_layer_impl(Layers& layers, Functor&& fun, std::index_sequence<I...>){
+    int wormhole[] = {(fun(I, std::get<I>(layers)), 0)...};
+    cpp_unused(wormhole);
+}
+
+} //end of namespace detail
+
+/*!
+ * \brief Call fun(I, layer, workspace) for each layer of a network and its
+ * workspace, in order.
+ */
+template<typename... R, typename Workspaces, typename Functor>
+void for_each_layer(const std::tuple<R...>& layers, Workspaces& workspaces, Functor&& fun){
+    detail::for_each_layer_impl(layers, workspaces, std::forward<Functor>(fun), std::index_sequence_for<R...>());
+}
+
+/*!
+ * \brief Call fun(I, layer) for each layer of a network, in order.
+ */
+template<typename... R, typename Functor>
+void for_each_layer(const std::tuple<R...>& layers, Functor&& fun){
+    detail::for_each_layer_impl(layers, std::forward<Functor>(fun), std::index_sequence_for<R...>());
+}
+
+/*!
+ * \brief All the buffers needed to propagate a sample through a DBN.
+ *
+ * A workspace must not be shared by several threads.
+ */
+template<typename DBN>
+struct dbn_workspace {
+    using dbn_t = DBN;
+    using weight = typename dbn_t::weight;
+
+    using first_t = typename dbn_t::template rbm_type<0>;
+    using last_t = typename dbn_t::template rbm_type<dbn_t::layers - 1>;
+
+    using input_t = typename layer_workspace<first_t>::input_t;
+    using layers_t = typename detail::layer_workspaces<typename dbn_t::tuple_type>::type;
+
+    input_t input;   //Copy of the input sample
+    layers_t layers; //Buffers of each layer
+
+    //Only used when the last layer is trained with the labels
+
+    etl::dyn_vector<weight> joint;     //Input of the last layer, including the label units
+    etl::dyn_vector<weight> visible_a; //Reconstruction of the input of the last layer
+    etl::dyn_vector<weight> visible_s;
+    etl::dyn_matrix<weight> vt;        //Temporary for the matrix-vector product
+
+    explicit dbn_workspace(const dbn_t& dbn) :
+            input(layer_workspace<first_t>::make_input(dbn.template layer<0>())),
+            layers(dbn.tuples),
+            joint(layer_workspace<last_t>::visible_size(dbn.template layer<dbn_t::layers - 1>())),
+            visible_a(layer_workspace<last_t>::visible_size(dbn.template layer<dbn_t::layers - 1>())),
+            visible_s(layer_workspace<last_t>::visible_size(dbn.template layer<dbn_t::layers - 1>())),
+            vt(layer_workspace<last_t>::visible_size(dbn.template layer<dbn_t::layers - 1>()), 1UL) {
+        //Nothing else to init
+    }
+
+    template<std::size_t N>
+    auto& layer(){
+        return std::get<N>(layers);
+    }
+};
+
+/*!
+ * \brief All the buffers needed to propagate a batch of samples through a
+ * dense DBN.
+ *
+ * The buffers are sized for a number of samples and are only reallocated
+ * when a batch of another size is propagated. A batch workspace must not be
+ * shared by several threads.
+ */
+template<typename DBN>
+struct dbn_batch_workspace {
+    using dbn_t = DBN;
+    using weight = typename dbn_t::weight;
+
+    using batch_t = etl::dyn_matrix<weight>;
+
+    std::size_t n = 0;      //The number of samples of the buffers
+    std::vector<batch_t> a; //Activation probabilities of each layer
+    std::vector<batch_t> t; //Temporary for the matrix-matrix product of each layer
+
+    /*!
+     * \brief Prepare the buffers for a batch of n samples
+     */
+    void resize(const dbn_t& dbn, std::size_t n){
+        if(this->n == n){
+            return;
+        }
+
+        this->n = n;
+
+        a.clear();
+        t.clear();
+
+        for_each_layer(dbn.tuples, [this, n](std::size_t, const auto& rbm){
+            a.emplace_back(n, num_hidden(rbm));
+            t.emplace_back(n, num_hidden(rbm));
+        });
+    }
+};
+
+} //end of dll namespace
+
+#endif
@@ -11,8 +11,10 @@
 
 #define DLL_SVM_SUPPORT
 
+#include "dll/conv_rbm.hpp"
 #include "dll/conv_rbm_mp.hpp"
 #include "dll/conv_dbn.hpp"
+#include "dll/frozen_dbn.hpp"
 
 #include "mnist/mnist_reader.hpp"
 #include "mnist/mnist_utils.hpp"
@@ -86,3 +88,34 @@ TEST_CASE( "conv_dbn_mp/mnist_3", "conv_dbn::svm_concatenate" ) {
     std::cout << "test_error:" << test_error << std::endl;
     REQUIRE(test_error < 0.2);
 }
+
+TEST_CASE( "conv_dbn_mp/mnist_4", "conv_dbn::frozen" ) {
+    typedef dll::conv_dbn_desc<
+        dll::dbn_layers<
+        dll::conv_rbm_mp_desc<28, 1, 12, 40, 2, dll::momentum, dll::batch_size<25>>::rbm_t,
+        dll::conv_rbm_desc<6, 40, 4, 20, dll::momentum, dll::batch_size<25>>::rbm_t
+    >>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset<std::vector, std::vector, double>(100);
+
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->pretrain(dataset.training_images, 5);
+
+    auto frozen = dll::freeze(*dbn);
+
+    REQUIRE(frozen.output_size() == dbn_t::output_size());
+
+    for(std::size_t i = 0; i < 20; ++i){
+        auto expected = dbn->activation_probabilities(dataset.training_images[i]);
+        auto result = frozen.activation_probabilities(dataset.training_images[i]);
+
+        for(std::size_t j = 0; j < frozen.output_size(); ++j){
+            REQUIRE(std::abs(result[j] - expected[j]) < 1e-6);
+        }
+    }
+}
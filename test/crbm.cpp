@@ -397,3 +397,74 @@ TEST_CASE( "crbm/mnist_16", "crbm::momentum" ) {
 
     REQUIRE(error < 2e-2);
 }
+
+TEST_CASE( "crbm/mnist_17", "crbm::free_energy_batch" ) {
+    dll::conv_rbm_desc<
+        28, 1, 12, 40,
+        dll::batch_size<25>,
+        dll::momentum
+    >::rbm_t rbm;
+
+    auto dataset = mnist::read_dataset<std::vector, std::vector, double>(100);
+
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto error = rbm.train(dataset.training_images, 20);
+
+    REQUIRE(error < 5e-2);
+
+    const std::size_t n = 20;
+
+    dataset.training_images.resize(n);
+
+    std::vector<double> energies(n);
+    std::vector<double> parallel_energies(n);
+
+    dll::thread_pool<true> pool;
+
+    rbm.free_energy_batch(dataset.training_images, energies);
+    rbm.free_energy_batch(pool, dataset.training_images, parallel_energies);
+
+    for(std::size_t i = 0; i < n; ++i){
+        auto expected = rbm.free_energy(dataset.training_images[i]);
+
+        REQUIRE(std::abs(energies[i] - expected) < 1e-6 * std::max(1.0, std::abs(expected)));
+        REQUIRE(std::abs(parallel_energies[i] - expected) < 1e-6 * std::max(1.0, std::abs(expected)));
+    }
+}
+
+TEST_CASE( "crbm/mnist_18", "crbm::free_energy_batch_gaussian" ) {
+    dll::conv_rbm_desc<
+        28, 1, 12, 40,
+        dll::batch_size<25>,
+        dll::momentum,
+        dll::weight_decay<dll::decay_type::L2>,
+        dll::visible<dll::unit_type::GAUSSIAN>
+    >::rbm_t rbm;
+
+    auto dataset = mnist::read_dataset<std::vector, std::vector, double>(100);
+
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::normalize_dataset(dataset);
+
+    auto error = rbm.train(dataset.training_images, 20);
+
+    REQUIRE(error < 5e-2);
+
+    const std::size_t n = 20;
+
+    dataset.training_images.resize(n);
+
+    std::vector<double> energies(n);
+
+    rbm.free_energy_batch(dataset.training_images, energies);
+
+    for(std::size_t i = 0; i < n; ++i){
+        auto expected = rbm.free_energy(dataset.training_images[i]);
+
+        REQUIRE(std::abs(energies[i] - expected) < 1e-6 * std::max(1.0, std::abs(expected)));
+    }
+}
@@ -5,7 +5,13 @@
 //  http://opensource.org/licenses/MIT)
 //=======================================================================
 
+#include <cstdio>
+#include <cstdlib>
 #include <deque>
+#include <thread>
+#include <sstream>
+
+#include <unistd.h>
 
 #include "catch.hpp"
 
@@ -13,10 +19,37 @@
 
 #include "dll/dbn.hpp"
 #include "dll/stochastic_gradient_descent.hpp"
+#include "dll/inference_engine.hpp"
+#include "dll/frozen_dbn.hpp"
+#include "dll/quantized_dbn.hpp"
+#include "dll/pruning.hpp"
+#include "dll/mapped_dbn.hpp"
+#include "dll/mapped_dataset.hpp"
 
 #include "mnist/mnist_reader.hpp"
 #include "mnist/mnist_utils.hpp"
 
+namespace {
+
+//A unique temporary file, removed at the end of the test
+struct temporary_file {
+    std::string path = "/tmp/dll_test_XXXXXX";
+
+    temporary_file(){
+        auto fd = mkstemp(&path[0]);
+
+        if(fd >= 0){
+            close(fd);
+        }
+    }
+
+    ~temporary_file(){
+        std::remove(path.c_str());
+    }
+};
+
+} //end of anonymous namespace
+
 TEST_CASE( "dbn/mnist_1", "dbn::simple" ) {
     typedef dll::dbn_desc<
         dll::dbn_layers<
@@ -402,6 +435,569 @@ TEST_CASE( "dbn/mnist_15", "dbn::parallel" ) {
     REQUIRE(test_error < 0.2);
 }
 
+TEST_CASE( "dbn/mnist_16", "dbn::concurrent_predict" ) {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+        dll::rbm_desc<28 * 28, 100, dll::momentum, dll::batch_size<25>, dll::init_weights>::rbm_t,
+        dll::rbm_desc<100, 200, dll::momentum, dll::batch_size<25>>::rbm_t,
+        dll::rbm_desc<200, 10, dll::momentum, dll::batch_size<25>, dll::hidden<dll::unit_type::SOFTMAX>>::rbm_t>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset<std::vector, std::vector, double>(500);
+
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->pretrain(dataset.training_images, 20);
+
+    const dbn_t& model = *dbn;
+
+    const std::size_t n = 200;
+
+    std::vector<std::size_t> expected(n);
+    std::vector<std::size_t> predicted(n);
+
+    for(std::size_t i = 0; i < n; ++i){
+        expected[i] = model.predict(dataset.test_images[i]);
+    }
+
+    std::vector<std::thread> threads;
+
+    for(std::size_t t = 0; t < 4; ++t){
+        threads.emplace_back([&, t](){
+            dbn_t::workspace ws(model);
+
+            for(std::size_t i = t; i < n; i += 4){
+                predicted[i] = model.predict(dataset.test_images[i], ws);
+            }
+        });
+    }
+
+    for(auto& thread : threads){
+        thread.join();
+    }
+
+    REQUIRE(predicted == expected);
+}
+
+TEST_CASE( "dbn/mnist_17", "dbn::predict_batch" ) {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+        dll::rbm_desc<28 * 28, 100, dll::momentum, dll::batch_size<25>, dll::init_weights>::rbm_t,
+        dll::rbm_desc<100, 200, dll::momentum, dll::batch_size<25>>::rbm_t,
+        dll::rbm_desc<200, 10, dll::momentum, dll::batch_size<25>, dll::hidden<dll::unit_type::SOFTMAX>>::rbm_t>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset<std::vector, std::vector, double>(500);
+
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->pretrain(dataset.training_images, 20);
+
+    const std::size_t n = 100;
+
+    etl::dyn_matrix<double> inputs(n, 28 * 28);
+
+    for(std::size_t i = 0; i < n; ++i){
+        inputs(i) = dataset.test_images[i];
+    }
+
+    etl::dyn_matrix<double> outputs(n, 10);
+    std::vector<std::size_t> labels(n);
+
+    dbn->activation_probabilities_batch(inputs, outputs);
+
+    //The buffers of the workspace are reused for the following batches
+    dbn_t::batch_workspace ws;
+
+    dbn->predict_batch(inputs, labels, ws);
+
+    //An empty batch is not propagated
+    etl::dyn_matrix<double> empty(0UL, 28UL * 28);
+    dbn->predict_batch(empty, labels, ws);
+
+    for(std::size_t i = 0; i < n; ++i){
+        auto expected = dbn->activation_probabilities(dataset.test_images[i]);
+
+        for(std::size_t j = 0; j < 10; ++j){
+            REQUIRE(std::abs(outputs(i, j) - expected[j]) < 1e-6);
+        }
+
+        REQUIRE(labels[i] == dbn->predict(dataset.test_images[i]));
+    }
+}
+
+TEST_CASE( "dbn/mnist_18", "dbn::inference_engine" ) {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+        dll::rbm_desc<28 * 28, 100, dll::momentum, dll::batch_size<25>, dll::init_weights>::rbm_t,
+        dll::rbm_desc<100, 200, dll::momentum, dll::batch_size<25>>::rbm_t,
+        dll::rbm_desc<200, 10, dll::momentum, dll::batch_size<25>, dll::hidden<dll::unit_type::SOFTMAX>>::rbm_t>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset<std::vector, std::vector, double>(500);
+
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->pretrain(dataset.training_images, 20);
+
+    const std::size_t n = 200;
+
+    std::vector<std::future<std::size_t>> futures(n);
+
+    {
+        dll::inference_engine<dbn_t> engine(*dbn, 16, std::chrono::microseconds(2000));
+
+        std::vector<std::thread> threads;
+
+        for(std::size_t t = 0; t < 4; ++t){
+            threads.emplace_back([&, t](){
+                for(std::size_t i = t; i < n; i += 4){
+                    futures[i] = engine.predict(dataset.test_images[i]);
+                }
+            });
+        }
+
+        for(auto& thread : threads){
+            thread.join();
+        }
+    }
+
+    for(std::size_t i = 0; i < n; ++i){
+        REQUIRE(futures[i].get() == dbn->predict(dataset.test_images[i]));
+    }
+}
+
+TEST_CASE( "dbn/mnist_19", "dbn::frozen" ) {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+        dll::rbm_desc<28 * 28, 100, dll::momentum, dll::batch_size<25>, dll::init_weights>::rbm_t,
+        dll::rbm_desc<100, 200, dll::momentum, dll::batch_size<25>>::rbm_t,
+        dll::rbm_desc<200, 10, dll::momentum, dll::batch_size<25>, dll::hidden<dll::unit_type::SOFTMAX>>::rbm_t>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset<std::vector, std::vector, double>(500);
+
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->pretrain(dataset.training_images, 20);
+
+    std::stringstream stream;
+
+    dbn->store(stream);
+
+    const auto model = stream.str();
+
+    auto frozen = dll::freeze(*dbn);
+    auto loaded = dll::frozen_dbn<double>::load<dbn_t>(stream);
+
+    REQUIRE(loaded);
+    REQUIRE(frozen.input_size() == 28 * 28);
+
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+        dll::rbm_desc<28 * 28, 100, dll::momentum, dll::batch_size<25>>::rbm_t,
+        dll::rbm_desc<100, 10, dll::momentum, dll::batch_size<25>>::rbm_t>>::dbn_t other_dbn_t;
+
+    //The model does not match the network
+    std::stringstream other_stream(model);
+    REQUIRE(!dll::frozen_dbn<double>::load<other_dbn_t>(other_stream));
+    REQUIRE(frozen.output_size() == 10);
+
+    decltype(frozen)::workspace ws(frozen);
+
+    for(std::size_t i = 0; i < 100; ++i){
+        auto expected = dbn->activation_probabilities(dataset.test_images[i]);
+        auto a = frozen.activation_probabilities(dataset.test_images[i]);
+        auto b = loaded->activation_probabilities(dataset.test_images[i]);
+
+        for(std::size_t j = 0; j < 10; ++j){
+            REQUIRE(std::abs(a[j] - expected[j]) < 1e-6);
+            REQUIRE(std::abs(b[j] - expected[j]) < 1e-6);
+        }
+
+        REQUIRE(frozen.predict(dataset.test_images[i], ws) == dbn->predict(dataset.test_images[i]));
+    }
+}
+
+TEST_CASE( "dbn/mnist_20", "dbn::quantized" ) {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+        dll::rbm_desc<28 * 28, 100, dll::momentum, dll::batch_size<25>, dll::init_weights>::rbm_t,
+        dll::rbm_desc<100, 200, dll::momentum, dll::batch_size<25>>::rbm_t,
+        dll::rbm_desc<200, 10, dll::momentum, dll::batch_size<25>, dll::hidden<dll::unit_type::SOFTMAX>>::rbm_t>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset<std::vector, std::vector, double>(500);
+
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->pretrain(dataset.training_images, 20);
+
+    auto error = dbn->fine_tune(dataset.training_images, dataset.training_labels, 10, 50);
+
+    REQUIRE(error < 5e-2);
+
+    dll::quantized_dbn<double> quantized(*dbn);
+
+    //The int8 weights are 4 times smaller than the float weights of the
+    //frozen network, minus the padding of the rows and the scales
+    REQUIRE(quantized.memory_size() < dll::freeze(*dbn).memory_size() / 3);
+
+    auto report = dll::compare_networks(dbn, quantized, dataset.training_images, dataset.training_labels);
+
+    std::cout << "error:" << report.error << " quantized_error:" << report.other_error << " disagreement:" << report.disagreement << std::endl;
+
+    REQUIRE(report.disagreement < 0.05);
+    REQUIRE(std::abs(report.other_error - report.error) < 0.05);
+}
+
+TEST_CASE( "dbn/mnist_21", "dbn::pruning" ) {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+        dll::rbm_desc<28 * 28, 100, dll::momentum, dll::batch_size<25>, dll::init_weights>::rbm_t,
+        dll::rbm_desc<100, 200, dll::momentum, dll::batch_size<25>>::rbm_t,
+        dll::rbm_desc<200, 10, dll::momentum, dll::batch_size<25>, dll::hidden<dll::unit_type::SOFTMAX>>::rbm_t>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset<std::vector, std::vector, double>(500);
+
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->pretrain(dataset.training_images, 20);
+
+    auto error = dbn->fine_tune(dataset.training_images, dataset.training_labels, 10, 50);
+
+    REQUIRE(error < 5e-2);
+
+    //Without pruning, the sparse network is exact
+    dll::pruned_dbn<double> exact(*dbn, dll::magnitude_pruning(0.0));
+
+    REQUIRE(exact.density() == 1.0);
+
+    for(std::size_t i = 0; i < 50; ++i){
+        auto expected = dbn->activation_probabilities(dataset.training_images[i]);
+        auto result = exact.activation_probabilities(dataset.training_images[i]);
+
+        for(std::size_t j = 0; j < 10; ++j){
+            REQUIRE(std::abs(result[j] - expected[j]) < 1e-6);
+        }
+    }
+
+    dll::pruned_dbn<double> pruned(*dbn, dll::top_k_pruning(200));
+
+    REQUIRE(pruned.density() < 0.5);
+
+    auto report = dll::compare_networks(dbn, pruned, dataset.training_images, dataset.training_labels);
+
+    std::cout << "error:" << report.error << " pruned_error:" << report.other_error << " disagreement:" << report.disagreement << std::endl;
+
+    REQUIRE(report.other_error < 0.2);
+
+    //The batch version gives the same predictions
+    const std::size_t n = 50;
+
+    etl::dyn_matrix<double> inputs(n, 28 * 28);
+
+    for(std::size_t i = 0; i < n; ++i){
+        inputs(i) = dataset.training_images[i];
+    }
+
+    std::vector<std::size_t> labels(n);
+
+    pruned.predict_batch(inputs, labels);
+
+    for(std::size_t i = 0; i < n; ++i){
+        REQUIRE(labels[i] == pruned.predict(dataset.training_images[i]));
+    }
+
+    //A batch workspace can be reused for several batches
+    dll::pruned_dbn<double>::batch_workspace ws(pruned);
+
+    etl::dyn_matrix<double> outputs(n, 10);
+
+    pruned.activation_probabilities_batch(inputs, outputs, ws);
+    pruned.predict_batch(inputs, labels, ws);
+
+    for(std::size_t i = 0; i < n; ++i){
+        auto expected = pruned.activation_probabilities(dataset.training_images[i]);
+
+        for(std::size_t j = 0; j < 10; ++j){
+            REQUIRE(std::abs(outputs(i, j) - expected[j]) < 1e-6);
+        }
+
+        REQUIRE(labels[i] == pruned.predict(dataset.training_images[i]));
+    }
+
+    //Pruning the network itself gives the same network
+    dll::prune_dbn(*dbn, dll::top_k_pruning(200));
+
+    dll::pruned_dbn<double> copy(*dbn);
+
+    REQUIRE(copy.values.size() == pruned.values.size());
+}
+
+TEST_CASE( "dbn/mnist_22", "dbn::predict_topk" ) {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+        dll::rbm_desc<28 * 28, 100, dll::momentum, dll::batch_size<25>, dll::init_weights>::rbm_t,
+        dll::rbm_desc<100, 200, dll::momentum, dll::batch_size<25>>::rbm_t,
+        dll::rbm_desc<200, 10, dll::momentum, dll::batch_size<25>, dll::hidden<dll::unit_type::SOFTMAX>>::rbm_t>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset<std::vector, std::vector, double>(500);
+
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->pretrain(dataset.training_images, 20);
+
+    const std::size_t n = 50;
+    const std::size_t k = 5;
+
+    etl::dyn_matrix<double> inputs(n, 28 * 28);
+
+    for(std::size_t i = 0; i < n; ++i){
+        inputs(i) = dataset.test_images[i];
+    }
+
+    std::vector<std::size_t> indices(n * k);
+    std::vector<double> scores(n * k);
+
+    dbn->predict_topk(inputs, k, indices, scores);
+
+    for(std::size_t i = 0; i < n; ++i){
+        auto expected = dbn->activation_probabilities(dataset.test_images[i]);
+
+        REQUIRE(indices[i * k] == dbn->predict(dataset.test_images[i]));
+
+        for(std::size_t p = 0; p < k; ++p){
+            REQUIRE(std::abs(scores[i * k + p] - expected[indices[i * k + p]]) < 1e-6);
+
+            if(p > 0){
+                REQUIRE(scores[i * k + p] <= scores[i * k + p - 1]);
+            }
+        }
+    }
+}
+
+TEST_CASE( "dbn/mnist_23", "dbn::model_file" ) {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+        dll::rbm_desc<28 * 28, 100, dll::momentum, dll::batch_size<25>, dll::init_weights>::rbm_t,
+        dll::rbm_desc<100, 200, dll::momentum, dll::batch_size<25>>::rbm_t,
+        dll::rbm_desc<200, 10, dll::momentum, dll::batch_size<25>, dll::hidden<dll::unit_type::SOFTMAX>>::rbm_t>>::dbn_t dbn_t;
+
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+        dll::rbm_desc<28 * 28, 100, dll::momentum, dll::batch_size<25>, dll::init_weights>::rbm_t,
+        dll::rbm_desc<100, 150, dll::momentum, dll::batch_size<25>>::rbm_t,
+        dll::rbm_desc<150, 10, dll::momentum, dll::batch_size<25>, dll::hidden<dll::unit_type::SOFTMAX>>::rbm_t>>::dbn_t other_dbn_t;
+
+    auto dataset = mnist::read_dataset<std::vector, std::vector, double>(200);
+
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->pretrain(dataset.training_images, 5);
+
+    std::stringstream is;
+
+    dbn->store(is);
+
+    const auto model = is.str();
+
+    std::vector<dll::layer_header> headers;
+    REQUIRE(dll::read_model_headers(is, headers));
+    REQUIRE(headers.size() == 3);
+    REQUIRE(headers[1].dims[0] == 100);
+    REQUIRE(headers[1].dims[1] == 200);
+    REQUIRE(headers[2].hidden_unit == static_cast<std::uint32_t>(dll::unit_type::SOFTMAX));
+    REQUIRE(headers[1].offset % dll::model_alignment == 0);
+
+    auto loaded = std::make_unique<dbn_t>();
+    std::stringstream loaded_stream(model);
+    REQUIRE(loaded->load(loaded_stream));
+
+    //The shapes of the layers do not match
+    auto other = std::make_unique<other_dbn_t>();
+    std::stringstream other_stream(model);
+    REQUIRE(!other->load(other_stream));
+
+    //Only the first layer has the same shape
+    std::stringstream layer_stream(model);
+    REQUIRE(other->load_layer<0>(layer_stream));
+
+    for(std::size_t i = 0; i < 20; ++i){
+        auto expected = dbn->activation_probabilities(dataset.test_images[i]);
+        auto a = loaded->activation_probabilities(dataset.test_images[i]);
+
+        for(std::size_t j = 0; j < 10; ++j){
+            REQUIRE(a[j] == expected[j]);
+        }
+    }
+
+    for(std::size_t i = 0; i < 28 * 28; ++i){
+        for(std::size_t j = 0; j < 100; ++j){
+            REQUIRE(other->layer<0>().w(i, j) == dbn->layer<0>().w(i, j));
+        }
+    }
+}
+
+TEST_CASE( "dbn/mnist_24", "dbn::mapped" ) {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+        dll::rbm_desc<28 * 28, 100, dll::momentum, dll::batch_size<25>, dll::init_weights>::rbm_t,
+        dll::rbm_desc<100, 200, dll::momentum, dll::batch_size<25>>::rbm_t,
+        dll::rbm_desc<200, 10, dll::momentum, dll::batch_size<25>, dll::hidden<dll::unit_type::SOFTMAX>>::rbm_t>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset<std::vector, std::vector, double>(200);
+
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->pretrain(dataset.training_images, 5);
+
+    //The network is mapped from a real file
+    temporary_file file;
+
+    dbn->store(file.path);
+
+    auto mapped = dll::mapped_dbn<float>::open(file.path, true);
+
+    REQUIRE(mapped);
+    REQUIRE(mapped->layers() == 3);
+    REQUIRE(mapped->input_size() == 28 * 28);
+    REQUIRE(mapped->output_size() == 10);
+
+    //The weights are not of the requested type
+    REQUIRE(!dll::mapped_dbn<double>::open(file.path));
+
+    decltype(mapped)::element_type::workspace ws(*mapped);
+
+    for(std::size_t i = 0; i < 50; ++i){
+        auto expected = dbn->activation_probabilities(dataset.test_images[i]);
+
+        std::vector<float> sample(dataset.test_images[i].begin(), dataset.test_images[i].end());
+
+        auto a = mapped->activation_probabilities(sample);
+
+        for(std::size_t j = 0; j < 10; ++j){
+            REQUIRE(std::abs(a[j] - expected[j]) < 1e-5);
+        }
+
+        REQUIRE(mapped->predict(sample, ws) == dbn->predict(dataset.test_images[i]));
+    }
+}
+
+TEST_CASE( "dbn/mnist_25", "dbn::svm_store" ) {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+        dll::rbm_desc<28 * 28, 100, dll::momentum, dll::batch_size<25>, dll::init_weights>::rbm_t,
+        dll::rbm_desc<100, 200, dll::momentum, dll::batch_size<25>>::rbm_t>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset<std::vector, std::vector, double>(200);
+
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->pretrain(dataset.training_images, 5);
+
+    REQUIRE(dbn->svm_train(dataset.training_images, dataset.training_labels));
+
+    std::stringstream stream;
+
+    dbn->store(stream);
+
+    auto loaded = std::make_unique<dbn_t>();
+
+    const auto model = stream.str();
+
+    REQUIRE(loaded->load(stream));
+    REQUIRE(loaded->svm_loaded);
+
+    //A truncated SVM section is an error
+    std::stringstream truncated(model.substr(0, model.size() - 8));
+
+    auto invalid = std::make_unique<dbn_t>();
+
+    REQUIRE(!invalid->load(truncated));
+    REQUIRE(!invalid->svm_loaded);
+
+    for(std::size_t i = 0; i < 50; ++i){
+        REQUIRE(loaded->svm_predict(dataset.test_images[i]) == dbn->svm_predict(dataset.test_images[i]));
+    }
+}
+
+TEST_CASE( "dbn/mnist_26", "dbn::mapped_dataset" ) {
+    typedef dll::dbn_desc<
+        dll::dbn_layers<
+        dll::rbm_desc<28 * 28, 100, dll::momentum, dll::batch_size<25>, dll::init_weights>::rbm_t,
+        dll::rbm_desc<100, 200, dll::momentum, dll::batch_size<25>>::rbm_t,
+        dll::rbm_desc<200, 10, dll::momentum, dll::batch_size<25>, dll::hidden<dll::unit_type::SOFTMAX>>::rbm_t>>::dbn_t dbn_t;
+
+    auto dataset = mnist::read_dataset<std::vector, std::vector, double>(500);
+
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    //The dataset is mapped from a real file
+    temporary_file file;
+
+    REQUIRE(dll::write_dataset<float>(file.path, dataset.training_images, dataset.training_labels));
+
+    auto mapped = dll::mapped_dataset<float>::open(file.path);
+
+    REQUIRE(mapped);
+    REQUIRE(mapped->size() == dataset.training_images.size());
+    REQUIRE(mapped->features() == 28 * 28);
+    REQUIRE(mapped->has_labels());
+
+    for(std::size_t i = 0; i < mapped->size(); ++i){
+        REQUIRE(std::equal(mapped->samples[i].begin(), mapped->samples[i].end(), dataset.training_images[i].begin()));
+        REQUIRE(mapped->labels[i] == dataset.training_labels[i]);
+    }
+
+    //The values are not of the requested type
+    REQUIRE(!dll::mapped_dataset<double>::open(file.path));
+
+    auto dbn = std::make_unique<dbn_t>();
+
+    dbn->pretrain(mapped->samples, 20);
+    auto error = dbn->fine_tune(mapped->samples, mapped->labels, 10, 50);
+
+    REQUIRE(error < 5e-2);
+}
+
 //{{{ Performance debugging tests
 
 TEST_CASE( "dbn/mnist_101", "dbn::slow_parallel" ) {
@@ -6,6 +6,7 @@
 //=======================================================================
 
 #include <deque>
+#include <sstream>
 
 #include "catch.hpp"
 
@@ -152,3 +153,41 @@ TEST_CASE( "dyn_dbn/mnist_5", "dbn::simple_single" ) {
 
     dbn->pretrain(dataset.training_images, 20);
 }
+
+TEST_CASE( "dyn_dbn/mnist_6", "dbn::from_file" ) {
+    using dbn_t =
+        dll::dyn_dbn_desc<
+            dll::dbn_dyn_layers<
+                dll::dyn_rbm_desc<dll::momentum, dll::init_weights>::rbm_t,
+                dll::dyn_rbm_desc<dll::momentum>::rbm_t,
+                dll::dyn_rbm_desc<dll::momentum, dll::hidden<dll::unit_type::SOFTMAX>>::rbm_t
+        >>::dbn_t;
+
+    auto dataset = mnist::read_dataset<std::vector, std::vector, double>(200);
+
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto dbn = std::make_unique<dbn_t>(
+        std::make_tuple(28*28,100),
+        std::make_tuple(100,200),
+        std::make_tuple(200,10));
+
+    dbn->pretrain(dataset.training_images, 5);
+
+    std::stringstream stream;
+
+    dbn->store(stream);
+
+    //The dimensions of the layers come from the model
+    auto loaded = dbn_t::from_stream(stream);
+
+    REQUIRE(loaded);
+    REQUIRE(loaded->layer<1>().num_visible == 100);
+    REQUIRE(loaded->layer<1>().num_hidden == 200);
+
+    for(std::size_t i = 0; i < 20; ++i){
+        REQUIRE(loaded->predict(dataset.test_images[i]) == dbn->predict(dataset.test_images[i]));
+    }
+}
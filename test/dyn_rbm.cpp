@@ -287,3 +287,45 @@ TEST_CASE( "dyn_rbm/mnist_16", "rbm::parallel" ) {
 
     REQUIRE(error < 1e-3);
 }
+
+TEST_CASE( "dyn_rbm/mnist_17", "rbm::mean_field" ) {
+    dll::dyn_rbm_desc<
+       dll::visible<dll::unit_type::GAUSSIAN>,
+       dll::trainer<dll::mf_cd1_trainer_t>
+    >::rbm_t rbm(28 * 28, 100);
+
+    rbm.learning_rate *= 10;
+
+    auto dataset = mnist::read_dataset<std::vector, std::vector, double>();
+
+    REQUIRE(!dataset.training_images.empty());
+    dataset.training_images.resize(100);
+
+    mnist::normalize_dataset(dataset);
+
+    auto error = rbm.train(dataset.training_images, 200);
+
+    REQUIRE(error < 1e-2);
+}
+
+TEST_CASE( "dyn_rbm/mnist_18", "rbm::pcd_chains" ) {
+    dll::dyn_rbm_desc<
+        dll::momentum,
+        dll::pcd_chains<10>,
+        dll::trainer<dll::pcd1_trainer_t>
+    >::rbm_t rbm(28 * 28, 100);
+
+    //The batch is larger than the configured number of chains
+    rbm.batch_size = 50;
+
+    auto dataset = mnist::read_dataset<std::vector, std::vector, double>();
+
+    REQUIRE(!dataset.training_images.empty());
+    dataset.training_images.resize(100);
+
+    mnist::binarize_dataset(dataset);
+
+    auto error = rbm.train(dataset.training_images, 100);
+
+    REQUIRE(error < 1e-1);
+}
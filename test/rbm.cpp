@@ -6,6 +6,7 @@
 //=======================================================================
 
 #include <numeric>
+#include <sstream>
 
 #include "catch.hpp"
 
@@ -497,6 +498,355 @@ TEST_CASE( "rbm/mnist_23", "rbm::parallel" ) {
     REQUIRE(error < 1e-3);
 }
 
+TEST_CASE( "rbm/mnist_24", "rbm::parallel_pcd" ) {
+    dll::rbm_desc<
+        28 * 28, 100,
+       dll::batch_size<25>,
+       dll::momentum,
+       dll::parallel,
+       dll::trainer<dll::pcd1_trainer_t>
+    >::rbm_t rbm;
+
+    auto dataset = mnist::read_dataset<std::vector, std::vector, double>(100);
+
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto error = rbm.train(dataset.training_images, 100);
+
+    REQUIRE(error < 1e-1);
+}
+
+TEST_CASE( "rbm/mnist_25", "rbm::seed" ) {
+    using rbm_t = dll::rbm_desc<
+        28 * 28, 100,
+       dll::batch_size<25>,
+       dll::momentum,
+       dll::parallel,
+       dll::shuffle
+    >::rbm_t;
+
+    auto dataset = mnist::read_dataset<std::vector, std::vector, double>(100);
+
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto copy = dataset.training_images;
+
+    rbm_t rbm_a;
+    rbm_t rbm_b;
+
+    rbm_b.w = rbm_a.w;
+
+    rbm_a.seed = 42;
+    rbm_b.seed = 42;
+
+    rbm_a.train(dataset.training_images, 10);
+    rbm_b.train(copy, 10);
+
+    for(std::size_t i = 0; i < rbm_a.w.size(); ++i){
+        REQUIRE(rbm_a.w[i] == rbm_b.w[i]);
+    }
+
+    //The result does not depend on the number of threads
+
+    auto copy_c = copy;
+    auto copy_d = copy;
+
+    rbm_t rbm_c;
+    rbm_t rbm_d;
+
+    rbm_c.w = rbm_a.w;
+    rbm_d.w = rbm_a.w;
+
+    rbm_c.seed = 42;
+    rbm_d.seed = 42;
+
+    rbm_c.threads = 1;
+    rbm_d.threads = 4;
+
+    rbm_c.train(copy_c, 10);
+    rbm_d.train(copy_d, 10);
+
+    for(std::size_t i = 0; i < rbm_c.w.size(); ++i){
+        REQUIRE(rbm_c.w[i] == rbm_d.w[i]);
+    }
+}
+
+TEST_CASE( "rbm/mnist_26", "rbm::pcd_chains" ) {
+    dll::rbm_desc<
+        28 * 28, 100,
+       dll::batch_size<25>,
+       dll::momentum,
+       dll::pcd_chains<100>,
+       dll::trainer<dll::pcd1_trainer_t>
+    >::rbm_t rbm;
+
+    auto dataset = mnist::read_dataset<std::vector, std::vector, double>(100);
+
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto error = rbm.train(dataset.training_images, 100);
+
+    REQUIRE(error < 1e-1);
+}
+
+TEST_CASE( "rbm/mnist_27", "rbm::fpcd" ) {
+    dll::rbm_desc<
+        28 * 28, 100,
+       dll::batch_size<25>,
+       dll::momentum,
+       dll::trainer<dll::fpcd1_trainer_t>
+    >::rbm_t rbm;
+
+    rbm.fast_decay = 0.9;
+
+    auto dataset = mnist::read_dataset<std::vector, std::vector, double>(100);
+
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto error = rbm.train(dataset.training_images, 100);
+
+    REQUIRE(error < 1e-1);
+}
+
+TEST_CASE( "rbm/mnist_28", "rbm::parallel_tempering" ) {
+    dll::rbm_desc<
+        28 * 28, 100,
+       dll::batch_size<25>,
+       dll::momentum,
+       dll::trainer<dll::pt4_trainer_t>
+    >::rbm_t rbm;
+
+    auto dataset = mnist::read_dataset<std::vector, std::vector, double>(100);
+
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto error = rbm.train(dataset.training_images, 100);
+
+    REQUIRE(error < 1e-1);
+
+    //The replicas must exchange their states
+
+    dll::pt4_trainer_t<decltype(rbm)> trainer(rbm);
+
+    dll::rbm_training_context context;
+    context.seed = 42;
+
+    auto first = dataset.training_images.begin();
+    auto last = first + 25;
+
+    for(std::size_t b = 0; b < 10; ++b){
+        context.sample = b * 25;
+        trainer.train_batch(dll::make_batch(first, last), dll::make_batch(first, last), context);
+    }
+
+    REQUIRE(trainer.exchanges > 0);
+}
+
+TEST_CASE( "rbm/mnist_29", "rbm::packed_states" ) {
+    dll::rbm_desc<
+        28 * 28, 100,
+       dll::batch_size<25>,
+       dll::momentum,
+       dll::packed_states
+    >::rbm_t rbm;
+
+    dll::rbm_desc<
+        28 * 28, 100,
+       dll::batch_size<25>,
+       dll::momentum
+    >::rbm_t dense;
+
+    auto dataset = mnist::read_dataset<std::vector, std::vector, double>(100);
+
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto error = rbm.train(dataset.training_images, 100);
+
+    REQUIRE(error < 1e-1);
+
+    dense.w = rbm.w;
+    dense.b = rbm.b;
+    dense.c = rbm.c;
+
+    etl::dyn_vector<float> v(dataset.training_images[0]);
+    etl::dyn_vector<float> h_a(100);
+    etl::dyn_vector<float> h_b(100);
+
+    rbm.activate_hidden<true, false>(h_a, h_a, v, v);
+    dense.activate_hidden<true, false>(h_b, h_b, v, v);
+
+    for(std::size_t j = 0; j < 100; ++j){
+        REQUIRE(std::abs(h_a[j] - h_b[j]) < 1e-5);
+    }
+
+    //The binary hidden samples take the packed visible path
+    etl::dyn_vector<float> h_s(100);
+
+    dense.activate_hidden<false, true>(h_s, h_s, v, v);
+
+    etl::dyn_vector<float> v_a(28 * 28);
+    etl::dyn_vector<float> v_b(28 * 28);
+
+    rbm.activate_visible<true, false>(h_s, h_s, v_a, v_a);
+    dense.activate_visible<true, false>(h_s, h_s, v_b, v_b);
+
+    for(std::size_t j = 0; j < 28 * 28; ++j){
+        REQUIRE(std::abs(v_a[j] - v_b[j]) < 1e-5);
+    }
+}
+
+TEST_CASE( "rbm/mnist_30", "rbm::sparse_input" ) {
+    dll::rbm_desc<
+        28 * 28, 100,
+       dll::batch_size<25>,
+       dll::momentum,
+       dll::sparse_input
+    >::rbm_t rbm;
+
+    auto dataset = mnist::read_dataset<std::vector, std::vector, double>(100);
+
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto error = rbm.train(dataset.training_images, 100);
+
+    REQUIRE(error < 1e-1);
+
+    const std::size_t n = 10;
+
+    etl::dyn_matrix<float> batch(n, 28 * 28);
+
+    for(std::size_t i = 0; i < n; ++i){
+        batch(i) = dataset.training_images[i];
+    }
+
+    dll::sparse_matrix<float> sparse_batch(batch);
+
+    etl::dyn_matrix<float> h_b(n, 100);
+    etl::dyn_matrix<float> t(n, 100);
+
+    rbm.batch_activate_hidden<true, false>(h_b, h_b, sparse_batch, sparse_batch, t);
+
+    //The dense batch is gathered as a whole
+    etl::dyn_matrix<float> h_d(n, 100);
+
+    rbm.batch_activate_hidden<true, false>(h_d, h_d, batch, batch, t);
+
+    for(std::size_t i = 0; i < n; ++i){
+        dll::sparse_vector<float> v(batch(i));
+
+        etl::dyn_vector<float> h(100);
+        rbm.activate_hidden<true, false>(h, h, v, v);
+
+        for(std::size_t j = 0; j < 100; ++j){
+            double x = rbm.b(j);
+
+            for(std::size_t k = 0; k < 28 * 28; ++k){
+                x += batch(i, k) * rbm.w(k, j);
+            }
+
+            REQUIRE(std::abs(h[j] - dll::logistic_sigmoid(x)) < 1e-5);
+            REQUIRE(std::abs(h_b(i, j) - dll::logistic_sigmoid(x)) < 1e-5);
+            REQUIRE(std::abs(h_d(i, j) - dll::logistic_sigmoid(x)) < 1e-5);
+        }
+    }
+}
+
+TEST_CASE( "rbm/mnist_31", "rbm::free_energy_batch" ) {
+    dll::rbm_desc<
+        28 * 28, 100,
+       dll::batch_size<25>,
+       dll::momentum
+    >::rbm_t rbm;
+
+    auto dataset = mnist::read_dataset<std::vector, std::vector, double>(100);
+
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    auto error = rbm.train(dataset.training_images, 20);
+
+    REQUIRE(error < 1e-1);
+
+    //Not a multiple of the block size
+    const std::size_t n = 90;
+
+    etl::dyn_matrix<double> batch(n, 28 * 28);
+
+    for(std::size_t i = 0; i < n; ++i){
+        batch(i) = dataset.training_images[i];
+    }
+
+    std::vector<double> energies(n);
+    std::vector<double> matrix_energies(n);
+    std::vector<double> parallel_energies(n);
+
+    dll::thread_pool<true> pool;
+
+    rbm.free_energy_batch(dataset.training_images, energies);
+    rbm.free_energy_batch(batch, matrix_energies);
+    rbm.free_energy_batch(pool, batch, parallel_energies);
+
+    for(std::size_t i = 0; i < n; ++i){
+        auto expected = rbm.free_energy(dataset.training_images[i]);
+
+        REQUIRE(std::abs(energies[i] - expected) < 1e-6 * std::max(1.0, std::abs(expected)));
+        REQUIRE(std::abs(matrix_energies[i] - expected) < 1e-6 * std::max(1.0, std::abs(expected)));
+        REQUIRE(std::abs(parallel_energies[i] - expected) < 1e-6 * std::max(1.0, std::abs(expected)));
+    }
+}
+
+TEST_CASE( "rbm/mnist_32", "rbm::store_load" ) {
+    dll::rbm_desc<
+        28 * 28, 100,
+       dll::batch_size<25>,
+       dll::momentum
+    >::rbm_t rbm;
+
+    dll::dyn_rbm_desc<dll::momentum>::rbm_t dyn_rbm(28 * 28, 100);
+
+    auto dataset = mnist::read_dataset<std::vector, std::vector, double>(100);
+
+    REQUIRE(!dataset.training_images.empty());
+
+    mnist::binarize_dataset(dataset);
+
+    rbm.train(dataset.training_images, 5);
+
+    std::stringstream stream;
+
+    rbm.store(stream);
+
+    //The format is the same for the fast and the dynamic RBMs
+    REQUIRE(dyn_rbm.load(stream));
+
+    for(std::size_t i = 0; i < 28 * 28; ++i){
+        REQUIRE(dyn_rbm.c(i) == rbm.c(i));
+
+        for(std::size_t j = 0; j < 100; ++j){
+            REQUIRE(dyn_rbm.w(i, j) == rbm.w(i, j));
+        }
+    }
+
+    for(std::size_t j = 0; j < 100; ++j){
+        REQUIRE(dyn_rbm.b(j) == rbm.b(j));
+    }
+}
+
 //{{{ Performance debugging tests
 
 TEST_CASE( "rbm/mnist_101", "rbm::slow" ) {